@@ -0,0 +1,316 @@
+#include "Allocator.h"
+
+#include <iostream>
+#include <algorithm>
+
+// Round value up to the next multiple of alignment (alignments are always powers of two in Vulkan)
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void Allocator::Init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize preferredBlockSize) {
+	_device = device;
+	_preferredBlockSize = preferredBlockSize;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &_memoryProperties);
+
+	// Linear and optimal resources closer than this granularity can alias each other on some hardware
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	_bufferImageGranularity = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+	_maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+	_blocks.resize(_memoryProperties.memoryTypeCount);
+}
+
+void Allocator::Destroy() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	for (auto& typeBlocks : _blocks) {
+		for (auto& block : typeBlocks) {
+			if (block.memory != nullptr) {
+				if (block.allocationCount) {
+					std::cout << "ERROR::Allocator::Destroy::LeakedAllocations " << block.allocationCount << std::endl;
+				}
+				_DestroyBlock(block);
+			}
+		}
+	}
+	_blocks.clear();
+}
+
+bool Allocator::Allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, bool linear, Allocation& allocation) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	VkDeviceSize blockSize = _GetBlockSize(memoryType);
+	std::vector<Block>& typeBlocks = _blocks[memoryType];
+
+	uint32_t blockIndex = 0;
+	VkDeviceSize offset = 0;
+	bool found = false;
+
+	// Large resources get a block to themselves, they would only waste the space left over in a shared block
+	if (requirements.size > blockSize / 2) {
+		if (!_CreateBlock(memoryType, requirements.size, true, blockIndex)) {
+			return false;
+		}
+		found = _AllocateFromBlock(typeBlocks[blockIndex], requirements, linear, offset);
+	} else {
+		// Try to fit the allocation into one of the existing blocks first
+		for (uint32_t i = 0; i < typeBlocks.size() && !found; i++) {
+			if (typeBlocks[i].memory != nullptr && !typeBlocks[i].dedicated) {
+				found = _AllocateFromBlock(typeBlocks[i], requirements, linear, offset);
+				blockIndex = i;
+			}
+		}
+
+		// Otherwise create a new block, halving the size if the heap is running out
+		while (!found && blockSize >= requirements.size) {
+			if (_CreateBlock(memoryType, blockSize, false, blockIndex)) {
+				found = _AllocateFromBlock(typeBlocks[blockIndex], requirements, linear, offset);
+				break;
+			}
+			blockSize /= 2;
+		}
+	}
+
+	if (!found) {
+		std::cout << "ERROR::Allocator::Allocate::OutOfMemory" << std::endl;
+		return false;
+	}
+
+	Block& block = typeBlocks[blockIndex];
+	block.allocationCount++;
+
+	allocation.memory = block.memory;
+	allocation.offset = offset;
+	allocation.size = requirements.size;
+	allocation.memoryType = memoryType;
+	allocation.block = blockIndex;
+	allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+
+	return true;
+}
+
+void Allocator::Free(Allocation& allocation) {
+	if (allocation.memory == nullptr) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Block& block = _blocks[allocation.memoryType][allocation.block];
+	auto chunk = block.chunks.find(allocation.offset);
+	if (chunk == block.chunks.end() || chunk->second.free) {
+		std::cout << "ERROR::Allocator::Free::InvalidAllocation" << std::endl;
+		return;
+	}
+
+	chunk->second.free = true;
+	block.allocationCount--;
+
+	// Merge with the following chunk if it is free
+	auto next = std::next(chunk);
+	if (next != block.chunks.end() && next->second.free) {
+		chunk->second.size += next->second.size;
+		block.chunks.erase(next);
+	}
+
+	// Merge into the previous chunk if it is free
+	if (chunk != block.chunks.begin()) {
+		auto previous = std::prev(chunk);
+		if (previous->second.free) {
+			previous->second.size += chunk->second.size;
+			block.chunks.erase(chunk);
+		}
+	}
+
+	// Dedicated blocks are never reused so give the memory back straight away
+	if (block.dedicated && block.allocationCount == 0) {
+		_DestroyBlock(block);
+	}
+
+	allocation = Allocation();
+}
+
+AllocatorStats Allocator::GetStats() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	AllocatorStats stats;
+	for (auto& typeBlocks : _blocks) {
+		for (auto& block : typeBlocks) {
+			if (block.memory == nullptr) {
+				continue;
+			}
+
+			stats.blockCount++;
+			stats.reservedBytes += block.size;
+			for (auto& [offset, chunk] : block.chunks) {
+				if (chunk.free) {
+					stats.freeRangeCount++;
+					stats.freeBytes += chunk.size;
+					stats.largestFreeRange = std::max(stats.largestFreeRange, chunk.size);
+				} else {
+					stats.allocationCount++;
+					stats.usedBytes += chunk.size;
+				}
+			}
+		}
+	}
+
+	if (stats.freeBytes) {
+		stats.fragmentation = 1.0f - (float)stats.largestFreeRange / (float)stats.freeBytes;
+	}
+
+	return stats;
+}
+
+void Allocator::PrintStats() {
+	AllocatorStats stats = GetStats();
+	std::cout << "Allocator: " << stats.allocationCount << " allocations in " << stats.blockCount << " blocks, "
+		<< stats.usedBytes / 1024 << "KB used / " << stats.reservedBytes / 1024 << "KB reserved, "
+		<< stats.freeRangeCount << " free ranges (largest " << stats.largestFreeRange / 1024 << "KB), "
+		<< "fragmentation " << stats.fragmentation << std::endl;
+}
+
+VkDeviceSize Allocator::_GetBlockSize(uint32_t memoryType) {
+	// Small heaps (such as the 256MB host visible device local heap) get proportionally smaller blocks
+	VkDeviceSize heapSize = _memoryProperties.memoryHeaps[_memoryProperties.memoryTypes[memoryType].heapIndex].size;
+	if (heapSize <= 1024ull * 1024 * 1024) {
+		return std::min(_preferredBlockSize, AlignUp(heapSize / 8, 1024));
+	}
+
+	return _preferredBlockSize;
+}
+
+bool Allocator::_CreateBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated, uint32_t& blockIndex) {
+	if (_deviceAllocationCount >= _maxAllocationCount) {
+		std::cout << "ERROR::Allocator::CreateBlock::MaxMemoryAllocationCountReached" << std::endl;
+		return false;
+	}
+
+	Block block;
+	block.size = size;
+	block.dedicated = dedicated;
+
+	VkMemoryAllocateInfo memory_allocate_info{};
+	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memory_allocate_info.allocationSize = size;
+	memory_allocate_info.memoryTypeIndex = memoryType;
+
+	if (vkAllocateMemory(_device, &memory_allocate_info, nullptr, &block.memory) != VK_SUCCESS) {
+		return false;
+	}
+	_deviceAllocationCount++;
+
+	// Host visible memory is mapped once here, mapping a range per allocation is not allowed on shared memory objects
+	if (_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(_device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped) != VK_SUCCESS) {
+			std::cout << "ERROR::Allocator::CreateBlock::MapMemory" << std::endl;
+			block.mapped = nullptr;
+		}
+	}
+
+	// The whole block starts out as one free chunk
+	block.chunks[0] = { size, true, false };
+
+	// Reuse the slot of a previously destroyed block if there is one
+	std::vector<Block>& typeBlocks = _blocks[memoryType];
+	for (uint32_t i = 0; i < typeBlocks.size(); i++) {
+		if (typeBlocks[i].memory == nullptr) {
+			typeBlocks[i] = std::move(block);
+			blockIndex = i;
+			return true;
+		}
+	}
+
+	typeBlocks.push_back(std::move(block));
+	blockIndex = static_cast<uint32_t>(typeBlocks.size() - 1);
+	return true;
+}
+
+void Allocator::_DestroyBlock(Block& block) {
+	if (block.mapped) {
+		vkUnmapMemory(_device, block.memory);
+	}
+	vkFreeMemory(_device, block.memory, nullptr);
+	_deviceAllocationCount--;
+
+	block = Block();
+}
+
+// Best fit search over the free chunks of a block, respecting alignment and bufferImageGranularity
+bool Allocator::_AllocateFromBlock(Block& block, const VkMemoryRequirements& requirements, bool linear, VkDeviceSize& offset) {
+	auto best = block.chunks.end();
+	VkDeviceSize bestOffset = 0;
+	VkDeviceSize bestWaste = UINT64_MAX;
+
+	for (auto it = block.chunks.begin(); it != block.chunks.end(); it++) {
+		if (!it->second.free || it->second.size < requirements.size) {
+			continue;
+		}
+
+		VkDeviceSize chunkStart = it->first;
+		VkDeviceSize chunkEnd = chunkStart + it->second.size;
+		VkDeviceSize start = AlignUp(chunkStart, requirements.alignment);
+
+		// A linear and an optimal resource may not share a granularity page, so push past the page of the previous chunk
+		if (it != block.chunks.begin()) {
+			auto previous = std::prev(it);
+			if (!previous->second.free && previous->second.linear != linear && _OnSamePage(previous->first + previous->second.size, start)) {
+				start = AlignUp(start, _bufferImageGranularity);
+			}
+		}
+
+		VkDeviceSize end = start + requirements.size;
+		if (end > chunkEnd) {
+			continue;
+		}
+
+		// Likewise the allocation may not end on the page the next chunk starts on
+		auto next = std::next(it);
+		if (next != block.chunks.end() && !next->second.free && next->second.linear != linear && _OnSamePage(end, next->first)) {
+			continue;
+		}
+
+		VkDeviceSize waste = it->second.size - requirements.size;
+		if (waste < bestWaste) {
+			best = it;
+			bestOffset = start;
+			bestWaste = waste;
+		}
+	}
+
+	if (best == block.chunks.end()) {
+		return false;
+	}
+
+	// Split the chosen chunk into [padding][allocation][remainder]
+	VkDeviceSize chunkStart = best->first;
+	VkDeviceSize chunkEnd = chunkStart + best->second.size;
+	VkDeviceSize end = bestOffset + requirements.size;
+
+	if (bestOffset > chunkStart) {
+		best->second.size = bestOffset - chunkStart;
+	} else {
+		block.chunks.erase(best);
+	}
+	block.chunks[bestOffset] = { requirements.size, false, linear };
+	if (end < chunkEnd) {
+		block.chunks[end] = { chunkEnd - end, true, false };
+	}
+
+	offset = bestOffset;
+	return true;
+}
+
+// Returns true if the last byte before endOfFirst and the byte at startOfSecond fall on the same granularity page
+bool Allocator::_OnSamePage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond) {
+	if (_bufferImageGranularity <= 1 || endOfFirst == 0) {
+		return false;
+	}
+
+	VkDeviceSize firstPage = (endOfFirst - 1) & ~(_bufferImageGranularity - 1);
+	VkDeviceSize secondPage = startOfSecond & ~(_bufferImageGranularity - 1);
+	return firstPage == secondPage;
+}
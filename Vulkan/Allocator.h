@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <map>
+#include <mutex>
+
+/*
+
+Sub allocating device memory allocator
+Buffers and images are carved out of large VkDeviceMemory blocks (one list of blocks per memory type)
+instead of each getting their own vkAllocateMemory call
+
+*/
+
+// A range of device memory handed out by the allocator
+struct Allocation {
+	VkDeviceMemory memory = nullptr;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	uint32_t memoryType = 0;
+	uint32_t block = 0;
+
+	// Pointer to the start of the range if the memory type is host visible, blocks are mapped once for their lifetime
+	void* mapped = nullptr;
+};
+
+// Snapshot of how the allocator is using device memory
+struct AllocatorStats {
+	uint32_t blockCount = 0;
+	uint32_t allocationCount = 0;
+	uint32_t freeRangeCount = 0;
+	VkDeviceSize reservedBytes = 0;
+	VkDeviceSize usedBytes = 0;
+	VkDeviceSize freeBytes = 0;
+	VkDeviceSize largestFreeRange = 0;
+
+	// 0 when all free memory is in one contiguous range, approaches 1 as it gets split into small pieces
+	float fragmentation = 0.0f;
+};
+
+class Allocator {
+public:
+	void Init(VkPhysicalDevice, VkDevice, VkDeviceSize preferredBlockSize = 64ull * 1024 * 1024);
+	void Destroy();
+
+	// Linear is true for buffers and linear tiled images, false for optimal tiled images (needed for bufferImageGranularity)
+	bool Allocate(const VkMemoryRequirements&, uint32_t memoryType, bool linear, Allocation&);
+	void Free(Allocation&);
+
+	AllocatorStats GetStats();
+	void PrintStats();
+
+private:
+	// Each block is split into contiguous chunks keyed by their offset, neighbouring free chunks are always merged
+	struct Chunk {
+		VkDeviceSize size;
+		bool free;
+		bool linear;
+	};
+
+	struct Block {
+		VkDeviceMemory memory = nullptr;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr;
+		bool dedicated = false;
+		uint32_t allocationCount = 0;
+		std::map<VkDeviceSize, Chunk> chunks;
+	};
+
+	VkDevice _device = nullptr;
+	VkPhysicalDeviceMemoryProperties _memoryProperties{};
+	VkDeviceSize _bufferImageGranularity = 1;
+	VkDeviceSize _preferredBlockSize = 0;
+	uint32_t _maxAllocationCount = 0;
+	uint32_t _deviceAllocationCount = 0;
+
+	// Blocks for each memory type, a destroyed block leaves a null entry so indices held by allocations stay valid
+	std::vector<std::vector<Block>> _blocks;
+	std::mutex _mutex;
+
+	VkDeviceSize _GetBlockSize(uint32_t memoryType);
+	bool _CreateBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated, uint32_t& blockIndex);
+	void _DestroyBlock(Block&);
+	bool _AllocateFromBlock(Block&, const VkMemoryRequirements&, bool linear, VkDeviceSize& offset);
+	bool _OnSamePage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond);
+};
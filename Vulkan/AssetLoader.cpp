@@ -0,0 +1,59 @@
+#include "AssetLoader.h"
+
+#include <algorithm>
+
+void AssetLoader::Init(uint32_t threadCount) {
+	for (uint32_t i = 0; i < std::max(threadCount, 1u); i++) {
+		_threads.emplace_back(&AssetLoader::_WorkerLoop, this);
+	}
+}
+
+void AssetLoader::Destroy() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+		_jobs.clear();
+	}
+	_wake.notify_all();
+
+	for (auto& thread : _threads) {
+		thread.join();
+	}
+	_threads.clear();
+}
+
+void AssetLoader::Submit(std::function<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.push_back(std::move(job));
+	}
+	_wake.notify_one();
+}
+
+void AssetLoader::WaitIdle() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_idle.wait(lock, [this]() { return _jobs.empty() && _runningJobs == 0; });
+}
+
+void AssetLoader::_WorkerLoop() {
+	while (true) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_wake.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+		if (_stop) {
+			return;
+		}
+
+		std::function<void()> job = std::move(_jobs.front());
+		_jobs.pop_front();
+		_runningJobs++;
+		lock.unlock();
+
+		job();
+
+		lock.lock();
+		_runningJobs--;
+		if (_jobs.empty() && _runningJobs == 0) {
+			_idle.notify_all();
+		}
+	}
+}
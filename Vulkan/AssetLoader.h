@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/*
+
+Background asset loading
+Jobs are queued from the main thread and run on the loader's own threads, separate from the ThreadPool so a slow load
+never holds up the per frame parallel fors. A job does the whole load (reading the file, creating the resource and
+queuing its upload) and hands the result back to the renderer, which swaps it in once the upload has been acquired
+
+*/
+
+class AssetLoader {
+public:
+	void Init(uint32_t threadCount);
+
+	// Jobs that have not started yet are dropped, the ones already running are waited for
+	void Destroy();
+
+	void Submit(std::function<void()> job);
+
+	// Blocks until every queued job has finished
+	void WaitIdle();
+
+private:
+	std::vector<std::thread> _threads;
+
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _idle;
+	std::deque<std::function<void()>> _jobs;
+	uint32_t _runningJobs = 0;
+	bool _stop = false;
+
+	void _WorkerLoop();
+};
@@ -0,0 +1,293 @@
+#include "Renderer.h"
+
+#include <string>
+#include <sstream>
+#include <map>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+
+/*
+
+Headless benchmark suite
+Every scenario renders offscreen without a window or surface so it runs the same on a CPU only driver (lavapipe,
+SwiftShader) as on a GPU, results are written as JSON with p50/p95/p99 so runs can be compared by a script
+
+startup   time to the first frame and of each init and create stage of the renderer constructor over several runs
+uploads   throughput of copies into a device local buffer through the upload queue, from the call until the graphics
+          queue has acquired the buffer
+draws     frame time as the scene grows from 1 to 100k objects, every object is an instance of the indirect draws
+culling   time to frustum cull 1M bounding spheres on the calling thread alone and then across the worker threads
+
+*/
+
+struct BenchmarkOptions {
+	RendererSettings settings;
+	std::string scenario = "all";
+	std::string output = "benchmark.json";
+	uint32_t frames = 200;
+	uint32_t warmupFrames = 10;
+	uint32_t runs = 5;
+};
+
+class Benchmark {
+public:
+	Benchmark(const BenchmarkOptions& options) : _options(options) {
+		// Everything is headless and the validation layers would swamp the timings
+		_options.settings.headless = true;
+		_options.settings.validation = false;
+		_options.settings.profilePath.clear();
+	}
+
+	void RunStartup(std::ostream& json) {
+		std::vector<const char*> stages;
+		std::map<std::string, std::vector<double>> timings;
+		std::vector<double> totals;
+
+		for (uint32_t run = 0; run < _options.runs; run++) {
+			RendererSettings settings = _options.settings;
+			settings.frameCount = 1;
+			Renderer renderer(settings);
+
+			for (const auto& stage : renderer.GetStartupTimings()) {
+				if (!timings.count(stage.first)) {
+					stages.push_back(stage.first);
+				}
+				timings[stage.first].push_back(stage.second);
+			}
+			totals.push_back(renderer.GetStartupTime());
+		}
+
+		json << "\"startup\":{\"runs\":" << _options.runs << ",\"total_ms\":";
+		_WriteStats(json, totals);
+		json << ",\"stages\":[";
+		for (size_t i = 0; i < stages.size(); i++) {
+			json << (i ? "," : "") << "{\"name\":\"" << stages[i] << "\",\"ms\":";
+			_WriteStats(json, timings[stages[i]]);
+			json << "}";
+		}
+		json << "]}";
+
+		_Report("startup", totals);
+	}
+
+	void RunUploads(std::ostream& json) {
+		RendererSettings settings = _options.settings;
+		settings.frameCount = 1;
+		Renderer renderer(settings);
+
+		// The largest size doesn't fit in the staging ring so it takes the dedicated staging buffer path
+		const VkDeviceSize sizes[] = { 64ull * 1024, 1024ull * 1024, 16ull * 1024 * 1024, 64ull * 1024 * 1024 };
+		const VkDeviceSize bytesPerSize = 256ull * 1024 * 1024;
+
+		json << "\"uploads\":[";
+		for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+			VkDeviceSize size = sizes[i];
+			std::vector<uint8_t> data(size, 0xA5);
+
+			VkBuffer buffer;
+			Allocation memory;
+			renderer._CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+
+			// Frames keep being drawn until the batch is acquired, that is when the renderer could first use the data
+			std::vector<double> latencies;
+			auto start = std::chrono::steady_clock::now();
+			uint32_t copies = static_cast<uint32_t>(std::max<VkDeviceSize>(bytesPerSize / size, 1));
+			for (uint32_t copy = 0; copy < copies; copy++) {
+				auto copyStart = std::chrono::steady_clock::now();
+				uint64_t batch = renderer._uploadQueue.UploadBuffer(buffer, 0, data.data(), size, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+				renderer._uploadQueue.Flush();
+				while (!renderer._uploadQueue.IsComplete(batch)) {
+					renderer._DrawOffscreenFrame();
+				}
+				latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - copyStart).count());
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			double megabytesPerSecond = (static_cast<double>(size) * copies / (1024.0 * 1024.0)) / seconds;
+
+			vkDeviceWaitIdle(renderer._device);
+			vkDestroyBuffer(renderer._device, buffer, nullptr);
+			renderer._allocator.Free(memory);
+
+			json << (i ? "," : "") << "{\"bytes\":" << size << ",\"copies\":" << copies << ",\"mb_per_s\":" << megabytesPerSecond << ",\"latency_ms\":";
+			_WriteStats(json, latencies);
+			json << "}";
+
+			std::cout << "Benchmark: upload " << size / 1024 << " KiB x" << copies << " " << megabytesPerSecond << " MB/s" << std::endl;
+		}
+		json << "]";
+	}
+
+	void RunDraws(std::ostream& json) {
+		const uint32_t objectCounts[] = { 1, 10, 100, 1000, 10000, 100000 };
+
+		json << "\"draws\":[";
+		for (size_t i = 0; i < sizeof(objectCounts) / sizeof(objectCounts[0]); i++) {
+			RendererSettings settings = _options.settings;
+			settings.objectCount = objectCounts[i];
+			settings.frameCount = _options.warmupFrames + _options.frames;
+			Renderer renderer(settings);
+
+			// The first frames include pipeline and memory warm up so they're left out
+			const std::vector<double>& frameTimes = renderer.GetFrameTimes();
+			std::vector<double> times(frameTimes.begin() + std::min<size_t>(_options.warmupFrames, frameTimes.size()), frameTimes.end());
+
+			json << (i ? "," : "") << "{\"objects\":" << objectCounts[i] << ",\"frames\":" << times.size() << ",\"frame_ms\":";
+			_WriteStats(json, times);
+			json << "}";
+
+			_Report(("draws " + std::to_string(objectCounts[i])).c_str(), times);
+		}
+		json << "]";
+	}
+
+	void RunCulling(std::ostream& json) {
+		const uint32_t sphereCount = 1000000;
+		const uint32_t repeats = 100;
+
+		// Scattered through a cube around what the camera looks at so a good share of them are visible
+		BoundingSpheres spheres;
+		spheres.Resize(sphereCount);
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> position(-20.0f, 20.0f);
+		for (uint32_t i = 0; i < sphereCount; i++) {
+			spheres.x[i] = position(random);
+			spheres.y[i] = position(random);
+			spheres.z[i] = position(random);
+			spheres.radius[i] = 0.5f;
+		}
+
+		glm::mat4 viewProj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f) * glm::lookAt(glm::vec3(0.0f, -30.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		FrustumCuller culler;
+		culler.SetViewProjection(&viewProj[0][0]);
+
+		// Same default as the renderer, one worker less than the hardware threads
+		uint32_t workerThreads = _options.settings.workerThreads;
+		if (workerThreads == 0) {
+			workerThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+		}
+
+		json << "\"culling\":{\"spheres\":" << sphereCount << ",\"kernel\":\"" << culler.GetKernelName() << "\",\"runs\":[";
+		const uint32_t threadCounts[] = { 0, workerThreads };
+		for (size_t i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); i++) {
+			ThreadPool pool;
+			pool.Init(threadCounts[i]);
+
+			std::vector<uint32_t> visible;
+			uint32_t visibleCount = culler.Cull(spheres, pool, visible);
+			std::vector<double> times;
+			for (uint32_t repeat = 0; repeat < repeats; repeat++) {
+				auto start = std::chrono::steady_clock::now();
+				visibleCount = culler.Cull(spheres, pool, visible);
+				times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+			}
+			pool.Destroy();
+
+			json << (i ? "," : "") << "{\"worker_threads\":" << threadCounts[i] << ",\"visible\":" << visibleCount << ",\"cull_ms\":";
+			_WriteStats(json, times);
+			json << "}";
+
+			_Report(("culling 1M, " + std::to_string(threadCounts[i]) + " workers").c_str(), times);
+		}
+		json << "]}";
+	}
+
+private:
+	BenchmarkOptions _options;
+
+	// Nearest rank percentile of a sorted list
+	static double _Percentile(const std::vector<double>& sorted, double percent) {
+		if (sorted.empty()) {
+			return 0.0;
+		}
+		size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * sorted.size()));
+		return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+	}
+
+	static void _WriteStats(std::ostream& json, std::vector<double> samples) {
+		std::sort(samples.begin(), samples.end());
+		double mean = samples.empty() ? 0.0 : std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+
+		json << "{\"samples\":" << samples.size() << ",\"mean\":" << mean
+			<< ",\"min\":" << (samples.empty() ? 0.0 : samples.front()) << ",\"max\":" << (samples.empty() ? 0.0 : samples.back())
+			<< ",\"p50\":" << _Percentile(samples, 50.0) << ",\"p95\":" << _Percentile(samples, 95.0) << ",\"p99\":" << _Percentile(samples, 99.0) << "}";
+	}
+
+	static void _Report(const char* name, std::vector<double> samples) {
+		std::sort(samples.begin(), samples.end());
+		std::cout << "Benchmark: " << name << " p50 " << _Percentile(samples, 50.0) << " ms, p95 " << _Percentile(samples, 95.0)
+			<< " ms, p99 " << _Percentile(samples, 99.0) << " ms" << std::endl;
+	}
+};
+
+int main(int argc, char** argv) {
+	BenchmarkOptions options;
+
+	// --scenario startup|uploads|draws|culling|all picks what to run, --output sets where the JSON results go
+	// --frames N measured frames per draw scenario after --warmup N frames, --runs N constructions for the startup scenario
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--scenario" && i + 1 < argc) {
+			options.scenario = argv[++i];
+		} else if (arg == "--output" && i + 1 < argc) {
+			options.output = argv[++i];
+		} else if (arg == "--frames" && i + 1 < argc) {
+			options.frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--warmup" && i + 1 < argc) {
+			options.warmupFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--runs" && i + 1 < argc) {
+			options.runs = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+		} else if (arg == "--width" && i + 1 < argc) {
+			options.settings.width = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--height" && i + 1 < argc) {
+			options.settings.height = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--threads" && i + 1 < argc) {
+			options.settings.workerThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else {
+			std::cout << "Unknown argument " << arg << std::endl;
+			return -1;
+		}
+	}
+
+	if (options.scenario != "all" && options.scenario != "startup" && options.scenario != "uploads" && options.scenario != "draws" && options.scenario != "culling") {
+		std::cout << "Unknown scenario " << options.scenario << std::endl;
+		return -1;
+	}
+
+	Benchmark benchmark(options);
+	bool all = options.scenario == "all";
+
+	// Renderer logging goes to stdout so the results are kept in their own file
+	std::ostringstream json;
+	json << "{\"width\":" << options.settings.width << ",\"height\":" << options.settings.height << ",\"frames\":" << options.frames
+		<< ",\"warmup_frames\":" << options.warmupFrames;
+	if (all || options.scenario == "startup") {
+		json << ",";
+		benchmark.RunStartup(json);
+	}
+	if (all || options.scenario == "uploads") {
+		json << ",";
+		benchmark.RunUploads(json);
+	}
+	if (all || options.scenario == "draws") {
+		json << ",";
+		benchmark.RunDraws(json);
+	}
+	if (all || options.scenario == "culling") {
+		json << ",";
+		benchmark.RunCulling(json);
+	}
+	json << "}\n";
+
+	std::ofstream file(options.output, std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "ERROR::Benchmark::CannotOpenFile " << options.output << std::endl;
+		return -1;
+	}
+	file << json.str();
+	std::cout << "Benchmark: wrote results to " << options.output << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,212 @@
+#include "Culling.h"
+
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULLING_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC lets any function use AVX2 intrinsics, gcc and clang need the function marked
+#if defined(CULLING_X86) && !defined(_MSC_VER)
+#define CULLING_AVX2_FUNCTION __attribute__((target("avx2,fma")))
+#else
+#define CULLING_AVX2_FUNCTION
+#endif
+
+void BoundingSpheres::Resize(uint32_t newCount) {
+	count = newCount;
+	size_t padded = (static_cast<size_t>(newCount) + 7) & ~static_cast<size_t>(7);
+	x.resize(padded, 0.0f);
+	y.resize(padded, 0.0f);
+	z.resize(padded, 0.0f);
+	radius.resize(padded, -FLT_MAX);
+
+	// Shrinking can leave real spheres in the padding
+	std::fill(radius.begin() + newCount, radius.end(), -FLT_MAX);
+}
+
+// A sphere is visible unless it is entirely behind one of the planes
+static uint32_t CullScalar(const float planes[6][4], const BoundingSpheres& spheres, uint32_t begin, uint32_t end, uint32_t* out) {
+	uint32_t count = 0;
+	for (uint32_t i = begin; i < end; i++) {
+		bool visible = true;
+		for (uint32_t p = 0; p < 6; p++) {
+			float distance = planes[p][0] * spheres.x[i] + planes[p][1] * spheres.y[i] + planes[p][2] * spheres.z[i] + planes[p][3];
+			visible &= distance >= -spheres.radius[i];
+		}
+		out[count] = i;
+		count += visible;
+	}
+	return count;
+}
+
+#ifdef CULLING_X86
+static uint32_t CullSSE(const float planes[6][4], const BoundingSpheres& spheres, uint32_t begin, uint32_t end, uint32_t* out) {
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (uint32_t p = 0; p < 6; p++) {
+		planeX[p] = _mm_set1_ps(planes[p][0]);
+		planeY[p] = _mm_set1_ps(planes[p][1]);
+		planeZ[p] = _mm_set1_ps(planes[p][2]);
+		planeW[p] = _mm_set1_ps(planes[p][3]);
+	}
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	uint32_t count = 0;
+	for (uint32_t i = begin; i < end; i += 4) {
+		__m128 x = _mm_loadu_ps(&spheres.x[i]);
+		__m128 y = _mm_loadu_ps(&spheres.y[i]);
+		__m128 z = _mm_loadu_ps(&spheres.z[i]);
+		__m128 negativeRadius = _mm_xor_ps(_mm_loadu_ps(&spheres.radius[i]), signBit);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (uint32_t p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		// Branchless compaction, every lane is written and the count only moves past the visible ones
+		uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+		for (uint32_t lane = 0; lane < 4; lane++) {
+			out[count] = i + lane;
+			count += (mask >> lane) & 1;
+		}
+	}
+	return count;
+}
+
+CULLING_AVX2_FUNCTION
+static uint32_t CullAVX2(const float planes[6][4], const BoundingSpheres& spheres, uint32_t begin, uint32_t end, uint32_t* out) {
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (uint32_t p = 0; p < 6; p++) {
+		planeX[p] = _mm256_set1_ps(planes[p][0]);
+		planeY[p] = _mm256_set1_ps(planes[p][1]);
+		planeZ[p] = _mm256_set1_ps(planes[p][2]);
+		planeW[p] = _mm256_set1_ps(planes[p][3]);
+	}
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+	uint32_t count = 0;
+	for (uint32_t i = begin; i < end; i += 8) {
+		__m256 x = _mm256_loadu_ps(&spheres.x[i]);
+		__m256 y = _mm256_loadu_ps(&spheres.y[i]);
+		__m256 z = _mm256_loadu_ps(&spheres.z[i]);
+		__m256 negativeRadius = _mm256_xor_ps(_mm256_loadu_ps(&spheres.radius[i]), signBit);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (uint32_t p = 0; p < 6; p++) {
+			__m256 distance = _mm256_fmadd_ps(planeX[p], x, _mm256_fmadd_ps(planeY[p], y, _mm256_fmadd_ps(planeZ[p], z, planeW[p])));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+		}
+
+		// Whole groups of 8 are often all in or all out, skip the per lane writes for those
+		uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+		if (mask == 0) {
+			continue;
+		}
+		if (mask == 0xFF) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + count), _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+			count += 8;
+			continue;
+		}
+		for (uint32_t lane = 0; lane < 8; lane++) {
+			out[count] = i + lane;
+			count += (mask >> lane) & 1;
+		}
+	}
+	return count;
+}
+
+// AVX needs the OS to save the upper halves of the registers as well as the CPU supporting it
+static bool CpuSupportsAVX2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+
+	__cpuid(info, 1);
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!fma || !osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+#endif
+
+FrustumCuller::FrustumCuller() {
+#ifdef CULLING_X86
+	if (CpuSupportsAVX2()) {
+		_kernel = CullAVX2;
+		_kernelName = "AVX2";
+	} else {
+		_kernel = CullSSE;
+		_kernelName = "SSE";
+	}
+#else
+	_kernel = CullScalar;
+	_kernelName = "Scalar";
+#endif
+}
+
+void FrustumCuller::SetViewProjection(const float* matrix) {
+	// Row r of the matrix, it is stored column major
+	auto row = [matrix](uint32_t r, uint32_t c) { return matrix[c * 4 + r]; };
+
+	for (uint32_t c = 0; c < 4; c++) {
+		_planes[0][c] = row(3, c) + row(0, c);	// Left
+		_planes[1][c] = row(3, c) - row(0, c);	// Right
+		_planes[2][c] = row(3, c) + row(1, c);	// Bottom
+		_planes[3][c] = row(3, c) - row(1, c);	// Top
+		_planes[4][c] = row(2, c);				// Near
+		_planes[5][c] = row(3, c) - row(2, c);	// Far
+	}
+
+	// Normalised so the plane distance can be compared against the radius
+	for (uint32_t p = 0; p < 6; p++) {
+		float length = std::sqrt(_planes[p][0] * _planes[p][0] + _planes[p][1] * _planes[p][1] + _planes[p][2] * _planes[p][2]);
+		for (uint32_t c = 0; c < 4; c++) {
+			_planes[p][c] /= length;
+		}
+	}
+}
+
+uint32_t FrustumCuller::Cull(const BoundingSpheres& spheres, ThreadPool& pool, std::vector<uint32_t>& visible) {
+	uint32_t padded = static_cast<uint32_t>(spheres.x.size());
+	if (visible.size() < padded) {
+		visible.resize(padded);
+	}
+
+	uint32_t chunkCount = (padded + _chunkSize - 1) / _chunkSize;
+	_chunkCounts.resize(chunkCount);
+
+	// Chunks write into their own range of the output so they need no synchronisation
+	pool.ParallelFor(chunkCount, [this, &spheres, &visible, padded](uint32_t chunk, uint32_t worker) {
+		uint32_t begin = chunk * _chunkSize;
+		uint32_t end = std::min(begin + _chunkSize, padded);
+		_chunkCounts[chunk] = _kernel(_planes, spheres, begin, end, visible.data() + begin);
+	});
+
+	// Pack the chunks down, the first one is already in place
+	uint32_t count = chunkCount ? _chunkCounts[0] : 0;
+	for (uint32_t chunk = 1; chunk < chunkCount; chunk++) {
+		memmove(visible.data() + count, visible.data() + chunk * _chunkSize, _chunkCounts[chunk] * sizeof(uint32_t));
+		count += _chunkCounts[chunk];
+	}
+
+	return count;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "ThreadPool.h"
+
+/*
+
+Frustum culling over bounding spheres
+Spheres are stored as structure of arrays so one kernel pass tests 8 (AVX2) or 4 (SSE) objects at a time against the
+six frustum planes. The AVX2 kernel is picked at runtime when the CPU and OS support it, otherwise SSE2 is used on x86
+and a scalar loop anywhere else. Objects are split into chunks culled on the pool's workers, each chunk writes its
+visible indices into its own part of the output which is then packed down into one list
+
+*/
+
+// World space bounding spheres of every object. Sizes are padded to a multiple of 8 with spheres that can never be
+// visible so the kernels have no scalar tail
+struct BoundingSpheres {
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> radius;
+	uint32_t count = 0;
+
+	void Resize(uint32_t count);
+};
+
+class FrustumCuller {
+public:
+	// Picks the widest kernel the CPU supports
+	FrustumCuller();
+
+	// Pulls the planes out of a column major world to clip space matrix (Gribb/Hartmann), clip space depth is 0 to 1
+	void SetViewProjection(const float* matrix);
+
+	// Writes the indices of the spheres at least partly inside the frustum to the front of visible, in ascending order,
+	// and returns how many there are. visible is only grown, anything past the returned count is scratch
+	uint32_t Cull(const BoundingSpheres&, ThreadPool&, std::vector<uint32_t>& visible);
+
+	const char* GetKernelName() { return _kernelName; }
+
+private:
+	// Tests spheres [begin, end) and writes the visible ones to out, returns how many were written.
+	// Up to 8 entries past the returned count may be written to as scratch
+	typedef uint32_t (*Kernel)(const float planes[6][4], const BoundingSpheres&, uint32_t begin, uint32_t end, uint32_t* out);
+
+	Kernel _kernel;
+	const char* _kernelName;
+	float _planes[6][4] = {};
+
+	// Big enough that waking a worker is worth it, a multiple of 8
+	static const uint32_t _chunkSize = 16384;
+	std::vector<uint32_t> _chunkCounts;
+};
@@ -0,0 +1,111 @@
+#include "DynamicResolution.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+void DynamicResolution::Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t framesInFlight, bool enabled, float budgetMs, float minScale) {
+	_device = device;
+	_budgetMs = budgetMs;
+	_minScale = std::min(std::max(minScale, 0.1f), 1.0f);
+	_scale = 1.0f;
+	if (!enabled) {
+		return;
+	}
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+	uint32_t validBits = queueFamily < familyCount ? families[queueFamily].timestampValidBits : 0;
+	if (validBits == 0) {
+		std::cout << "DynamicResolution: timestamps are not supported on the graphics queue, rendering at full resolution" << std::endl;
+		return;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	_timestampPeriod = properties.limits.timestampPeriod;
+	_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	_frames.resize(framesInFlight);
+	for (auto& frame : _frames) {
+		VkQueryPoolCreateInfo query_pool_create_info{};
+		query_pool_create_info.sType		= VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		query_pool_create_info.queryType	= VK_QUERY_TYPE_TIMESTAMP;
+		query_pool_create_info.queryCount	= 2;
+
+		if (vkCreateQueryPool(_device, &query_pool_create_info, nullptr, &frame.pool) != VK_SUCCESS) {
+			std::cout << "ERROR::DynamicResolution::Init::CreateQueryPool" << std::endl;
+			exit(-1);
+		}
+	}
+	_enabled = true;
+}
+
+void DynamicResolution::Destroy() {
+	for (auto& frame : _frames) {
+		vkDestroyQueryPool(_device, frame.pool, nullptr);
+	}
+	_frames.clear();
+	_enabled = false;
+}
+
+void DynamicResolution::BeginFrame(VkCommandBuffer commandBuffer, uint32_t frame) {
+	if (!_enabled) {
+		return;
+	}
+
+	// The frame has been waited on so this never blocks, if the results somehow aren't there the sample is skipped
+	Frame& current = _frames[frame];
+	if (current.written) {
+		uint64_t timestamps[2];
+		if (vkGetQueryPoolResults(_device, current.pool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			uint64_t ticks = ((timestamps[1] & _timestampMask) - (timestamps[0] & _timestampMask)) & _timestampMask;
+			_Update(static_cast<float>(ticks * _timestampPeriod / 1e6));
+		}
+	}
+
+	vkCmdResetQueryPool(commandBuffer, current.pool, 0, 2);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, current.pool, 0);
+	current.written = false;
+	_currentFrame = frame;
+}
+
+void DynamicResolution::EndFrame(VkCommandBuffer commandBuffer) {
+	if (!_enabled) {
+		return;
+	}
+
+	Frame& current = _frames[_currentFrame];
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, current.pool, 1);
+	current.written = true;
+}
+
+VkExtent2D DynamicResolution::GetExtent(VkExtent2D fullExtent) const {
+	return {
+		std::max(static_cast<uint32_t>(fullExtent.width * _scale + 0.5f), 1u),
+		std::max(static_cast<uint32_t>(fullExtent.height * _scale + 0.5f), 1u)
+	};
+}
+
+void DynamicResolution::_Update(float frameMs) {
+
+	// Smoothed so a single slow frame doesn't drop the resolution
+	_gpuMs = _gpuMs == 0.0f ? frameMs : _gpuMs + (frameMs - _gpuMs) * 0.1f;
+
+	// Over budget moves quickly, under only once there's a clear margin so the scale settles rather than hunting
+	float rate = 0.0f;
+	if (_gpuMs > _budgetMs) {
+		rate = 0.5f;
+	} else if (_gpuMs < _budgetMs * 0.85f) {
+		rate = 0.05f;
+	}
+	if (rate == 0.0f || _gpuMs <= 0.0f) {
+		return;
+	}
+
+	float target = _scale * std::sqrt(_budgetMs * 0.92f / _gpuMs);
+	_scale = std::min(std::max(_scale + (target - _scale) * rate, _minScale), 1.0f);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+/*
+
+Dynamic resolution scaling driven by GPU frame time
+Each frame's command buffer is bracketed by a pair of timestamps, read back without waiting once that frame in flight
+comes round again. A smoothed GPU time feeds a controller that picks the fraction of the full resolution the scene is
+rendered at, the renderer then upscales that region into the swapchain image
+
+The attachments are always allocated at full size, a lower scale only shrinks the render area, viewport and scissor so
+changing it costs nothing. The GPU time is taken as proportional to the pixel count, so the scale moves by the square
+root of how far over or under budget the frame is. It drops quickly when over budget and only climbs back slowly once
+well under it, so it doesn't oscillate around the target
+
+*/
+
+class DynamicResolution {
+public:
+	// With enabled false, or without timestamp support on queueFamily, the scale stays at 1
+	void Init(VkPhysicalDevice, VkDevice, uint32_t queueFamily, uint32_t framesInFlight, bool enabled, float budgetMs, float minScale);
+	void Destroy();
+
+	// Feeds the GPU time of the last use of this frame in flight to the controller and resets its queries, must be
+	// called at the start of the frame's command buffer after the frame has been waited on
+	void BeginFrame(VkCommandBuffer, uint32_t frame);
+	void EndFrame(VkCommandBuffer);
+
+	// The region of a full size target to render to this frame, never smaller than a pixel
+	VkExtent2D GetExtent(VkExtent2D fullExtent) const;
+
+	float GetScale() const { return _scale; }
+	float GetGpuTime() const { return _gpuMs; }
+
+private:
+	struct Frame {
+		VkQueryPool pool = VK_NULL_HANDLE;
+		bool written = false;
+	};
+
+	VkDevice _device = VK_NULL_HANDLE;
+	bool _enabled = false;
+	double _timestampPeriod = 1.0;
+	uint64_t _timestampMask = ~0ull;
+	std::vector<Frame> _frames;
+	uint32_t _currentFrame = 0;
+
+	float _budgetMs = 16.0f;
+	float _minScale = 0.5f;
+	float _scale = 1.0f;
+	float _gpuMs = 0.0f;
+
+	void _Update(float frameMs);
+};
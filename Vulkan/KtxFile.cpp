@@ -0,0 +1,112 @@
+#include "KtxFile.h"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+// «KTX 20»\r\n\x1A\n
+static const uint8_t ktxIdentifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+bool KtxFile::Open(const std::string& path) {
+	if (!_file.Open(path)) {
+		std::cout << "ERROR::KtxFile::Open::CannotMapFile " << path << std::endl;
+		return false;
+	}
+
+	_header = reinterpret_cast<const Header*>(_file.GetData());
+	if (!_Validate()) {
+		std::cout << "ERROR::KtxFile::Open::UnsupportedTexture " << path << std::endl;
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void KtxFile::Close() {
+	_file.Close();
+	_header = nullptr;
+	_levelCount = 0;
+}
+
+bool KtxFile::GetFormatBlock(VkFormat format, uint32_t& blockWidth, uint32_t& blockHeight, uint32_t& blockBytes) {
+	switch (format) {
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		blockWidth = 4;
+		blockHeight = 4;
+		blockBytes = 8;
+		return true;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		blockWidth = 4;
+		blockHeight = 4;
+		blockBytes = 16;
+		return true;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		blockWidth = 1;
+		blockHeight = 1;
+		blockBytes = 4;
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Checks the header describes something the renderer can upload as is, and that every level is where it says and the size it should be
+bool KtxFile::_Validate() {
+	size_t fileSize = _file.GetSize();
+	if (fileSize < sizeof(Header) || memcmp(_header->identifier, ktxIdentifier, sizeof(ktxIdentifier)) != 0) {
+		return false;
+	}
+
+	uint32_t blockWidth, blockHeight, blockBytes;
+	if (!GetFormatBlock(GetFormat(), blockWidth, blockHeight, blockBytes)) {
+		return false;
+	}
+
+	// 2D, not an array or cube map, and no supercompression
+	const Header& header = *_header;
+	if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 || header.supercompressionScheme != 0) {
+		return false;
+	}
+
+	// Mipmap generation blits from the base level, which isn't possible for block compressed formats
+	_levelCount = std::max(header.levelCount, 1u);
+	if (_levelCount > maxLevels || (header.levelCount == 0 && blockWidth != 1)) {
+		return false;
+	}
+	uint32_t fullChain = 1;
+	for (uint32_t size = std::max(header.pixelWidth, header.pixelHeight); size > 1; size >>= 1) {
+		fullChain++;
+	}
+	if (_levelCount > fullChain) {
+		return false;
+	}
+
+	if (fileSize < sizeof(Header) + sizeof(LevelIndex) * _levelCount) {
+		return false;
+	}
+	const LevelIndex* index = reinterpret_cast<const LevelIndex*>(_file.GetData() + sizeof(Header));
+
+	for (uint32_t level = 0; level < _levelCount; level++) {
+		uint64_t width = std::max(header.pixelWidth >> level, 1u);
+		uint64_t height = std::max(header.pixelHeight >> level, 1u);
+		uint64_t expectedSize = ((width + blockWidth - 1) / blockWidth) * ((height + blockHeight - 1) / blockHeight) * blockBytes;
+
+		// Copies out of the staging buffer need offsets that are a multiple of the block size
+		const LevelIndex& entry = index[level];
+		if (entry.byteLength != expectedSize || entry.byteOffset % blockBytes != 0 || entry.byteOffset > fileSize || entry.byteLength > fileSize - entry.byteOffset) {
+			return false;
+		}
+
+		_levels[level] = { entry.byteOffset, entry.byteLength };
+	}
+
+	return true;
+}
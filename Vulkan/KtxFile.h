@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+
+#include "MappedFile.h"
+
+/*
+
+KTX2 texture container
+Only what the renderer uploads is supported: single 2D images without supercompression in BC1, BC3, BC7 or RGBA8.
+Every mip level is normally stored in the file already, the level data is handed to the upload queue straight from
+the mapping with one VkBufferImageCopy per level
+
+*/
+
+// Byte range of one mip level within the file
+struct KtxLevel {
+	uint64_t offset;
+	uint64_t size;
+};
+
+class KtxFile {
+public:
+	// Maps the file and checks the header and level index, the mapping stays open until Close
+	bool Open(const std::string& path);
+	void Close();
+
+	VkFormat GetFormat() const { return static_cast<VkFormat>(_header->vkFormat); }
+	uint32_t GetWidth() const { return _header->pixelWidth; }
+	uint32_t GetHeight() const { return _header->pixelHeight; }
+
+	// Levels stored in the file, level 0 is the full size image
+	uint32_t GetLevelCount() const { return _levelCount; }
+	const KtxLevel& GetLevel(uint32_t level) const { return _levels[level]; }
+	const char* GetData() const { return _file.GetData(); }
+
+	// A level count of 0 in the header means only the base level is stored and the rest should be generated at load
+	bool NeedsMipmapGeneration() const { return _header->levelCount == 0; }
+
+	// Size of a compression block in texels and bytes, 1x1 for uncompressed formats
+	static bool GetFormatBlock(VkFormat format, uint32_t& blockWidth, uint32_t& blockHeight, uint32_t& blockBytes);
+
+private:
+	struct Header {
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+
+	// Level index entry as stored after the header
+	struct LevelIndex {
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	static const uint32_t maxLevels = 16;
+
+	MappedFile _file;
+	const Header* _header = nullptr;
+	KtxLevel _levels[maxLevels];
+	uint32_t _levelCount = 0;
+
+	bool _Validate();
+};
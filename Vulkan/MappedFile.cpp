@@ -0,0 +1,94 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::Open(const std::string& path) {
+#ifdef _WIN32
+	// Sequential scan lets the cache manager read ahead since the whole file is about to be copied front to back
+	_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (_file == INVALID_HANDLE_VALUE) {
+		_file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(_file, &fileSize) || fileSize.QuadPart == 0) {
+		Close();
+		return false;
+	}
+	_size = static_cast<size_t>(fileSize.QuadPart);
+
+	_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping == nullptr) {
+		Close();
+		return false;
+	}
+
+	_data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (_data == nullptr) {
+		Close();
+		return false;
+	}
+	return true;
+#else
+	_file = open(path.c_str(), O_RDONLY);
+	if (_file == -1) {
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(_file, &fileStat) != 0 || fileStat.st_size == 0) {
+		Close();
+		return false;
+	}
+	_size = static_cast<size_t>(fileStat.st_size);
+
+	void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _file, 0);
+	if (data == MAP_FAILED) {
+		Close();
+		return false;
+	}
+	_data = static_cast<const char*>(data);
+
+	// The whole file is about to be copied front to back so have the kernel read ahead
+	madvise(data, _size, MADV_SEQUENTIAL);
+	madvise(data, _size, MADV_WILLNEED);
+	return true;
+#endif
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+	if (_data != nullptr) {
+		UnmapViewOfFile(_data);
+	}
+	if (_mapping != nullptr) {
+		CloseHandle(_mapping);
+	}
+	if (_file != nullptr) {
+		CloseHandle(_file);
+	}
+	_mapping = nullptr;
+	_file = nullptr;
+#else
+	if (_data != nullptr) {
+		munmap(const_cast<char*>(_data), _size);
+	}
+	if (_file != -1) {
+		close(_file);
+	}
+	_file = -1;
+#endif
+
+	_data = nullptr;
+	_size = 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+/*
+
+Read only memory mapping of a whole file
+Used by the asset loaders so file contents can be handed straight to the upload queue without being read into a
+temporary buffer first. The mapping is hinted for sequential access since assets are copied front to back
+
+*/
+
+class MappedFile {
+public:
+	bool Open(const std::string& path);
+	void Close();
+
+	const char* GetData() const { return _data; }
+	size_t GetSize() const { return _size; }
+
+private:
+	const char* _data = nullptr;
+	size_t _size = 0;
+
+#ifdef _WIN32
+	void* _file = nullptr;
+	void* _mapping = nullptr;
+#else
+	int _file = -1;
+#endif
+};
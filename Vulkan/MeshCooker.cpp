@@ -0,0 +1,203 @@
+#include "MeshFile.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <cstdlib>
+#include <cerrno>
+
+/*
+
+Mesh cooker
+Turns source geometry into the cooked format MeshFile loads, so the renderer never parses anything at load time
+
+MeshCooker input.obj output.mesh   cooks a Wavefront OBJ, positions and texture coordinates are kept and vertex colours
+                                   are white. Faces are fanned into triangles and every usemtl starts a new submesh
+MeshCooker --quads output.mesh     writes the two test quads that ship as shaders/quads.mesh
+
+*/
+
+// Laid out the same as Vertex in Renderer Structs.h, which can't be included here without the renderer's dependencies
+struct Vertex {
+	float position[3];
+	float colour[3];
+	float texCoord[2];
+};
+static_assert(sizeof(Vertex) == 32, "Vertex must match the renderer's vertex layout");
+
+static MeshDescription Describe(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<MeshSubmesh>& submeshes) {
+	MeshDescription mesh;
+	const char* data = reinterpret_cast<const char*>(vertices.data());
+	mesh.streams.emplace_back(data, data + vertices.size() * sizeof(Vertex));
+	mesh.streamStrides.push_back(sizeof(Vertex));
+	mesh.vertexCount = static_cast<uint32_t>(vertices.size());
+	mesh.indices = indices;
+	mesh.submeshes = submeshes;
+	return mesh;
+}
+
+// The geometry the renderer used to have compiled in, one submesh per quad
+static MeshDescription CookQuads() {
+	std::vector<Vertex> vertices = {
+		{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
+		{{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+		{{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
+		{{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}},
+
+		{{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
+		{{0.5f, -0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+		{{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
+		{{-0.5f, 0.5f, -0.5f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}}
+	};
+	std::vector<uint32_t> indices = {
+		0, 1, 2, 2, 3, 0,
+		4, 5, 6, 6, 7, 4
+	};
+	std::vector<MeshSubmesh> submeshes = { { 0, 6, 0, 0 }, { 6, 6, 0, 0 } };
+	return Describe(vertices, indices, submeshes);
+}
+
+// OBJ indices are 1 based, negative ones count back from the last element read so far. A token that isn't entirely a
+// number is rejected so the caller can report the line rather than throwing
+static bool ResolveIndex(const std::string& token, size_t count, uint32_t& index) {
+	if (token.empty()) {
+		return false;
+	}
+	char* end = nullptr;
+	errno = 0;
+	long value = std::strtol(token.c_str(), &end, 10);
+	if (end != token.c_str() + token.size() || errno == ERANGE) {
+		return false;
+	}
+	if (value < 0) {
+		value += static_cast<long>(count) + 1;
+	}
+	if (value < 1 || static_cast<size_t>(value) > count) {
+		return false;
+	}
+	index = static_cast<uint32_t>(value - 1);
+	return true;
+}
+
+static bool CookObj(const std::string& path, MeshDescription& mesh) {
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		std::cout << "ERROR::MeshCooker::CookObj::CannotOpenFile " << path << std::endl;
+		return false;
+	}
+
+	std::vector<std::array<float, 3>> positions;
+	std::vector<std::array<float, 2>> texCoords;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<MeshSubmesh> submeshes;
+
+	// Each distinct position/texture coordinate pair becomes one vertex
+	std::unordered_map<uint64_t, uint32_t> vertexLookup;
+
+	std::string line;
+	uint32_t lineNumber = 0;
+	while (std::getline(file, line)) {
+		lineNumber++;
+		std::istringstream stream(line);
+		std::string keyword;
+		stream >> keyword;
+
+		if (keyword == "v") {
+			std::array<float, 3> position{};
+			stream >> position[0] >> position[1] >> position[2];
+			positions.push_back(position);
+		} else if (keyword == "vt") {
+			std::array<float, 2> texCoord{};
+			stream >> texCoord[0] >> texCoord[1];
+			texCoords.push_back(texCoord);
+		} else if (keyword == "usemtl") {
+			if (!submeshes.empty() && submeshes.back().indexCount == 0) {
+				submeshes.pop_back();
+			}
+			submeshes.push_back({ static_cast<uint32_t>(indices.size()), 0, 0, static_cast<uint32_t>(submeshes.size()) });
+		} else if (keyword == "f") {
+			std::vector<uint32_t> face;
+			std::string corner;
+			while (stream >> corner) {
+				// v, v/vt, v//vn or v/vt/vn, normals aren't used
+				size_t slash = corner.find('/');
+				uint32_t position = 0;
+				uint32_t texCoord = UINT32_MAX;
+				if (!ResolveIndex(corner.substr(0, slash), positions.size(), position)) {
+					std::cout << "ERROR::MeshCooker::CookObj::InvalidFace " << path << ":" << lineNumber << std::endl;
+					return false;
+				}
+				if (slash != std::string::npos) {
+					size_t end = corner.find('/', slash + 1);
+					std::string token = corner.substr(slash + 1, end == std::string::npos ? std::string::npos : end - slash - 1);
+					if (!token.empty() && !ResolveIndex(token, texCoords.size(), texCoord)) {
+						std::cout << "ERROR::MeshCooker::CookObj::InvalidFace " << path << ":" << lineNumber << std::endl;
+						return false;
+					}
+				}
+
+				uint64_t key = (static_cast<uint64_t>(position) << 32) | texCoord;
+				auto found = vertexLookup.find(key);
+				if (found == vertexLookup.end()) {
+					Vertex vertex{};
+					vertex.position[0] = positions[position][0];
+					vertex.position[1] = positions[position][1];
+					vertex.position[2] = positions[position][2];
+					vertex.colour[0] = vertex.colour[1] = vertex.colour[2] = 1.0f;
+					if (texCoord != UINT32_MAX) {
+						// OBJ has v going up the image, Vulkan samples with it going down
+						vertex.texCoord[0] = texCoords[texCoord][0];
+						vertex.texCoord[1] = 1.0f - texCoords[texCoord][1];
+					}
+					found = vertexLookup.emplace(key, static_cast<uint32_t>(vertices.size())).first;
+					vertices.push_back(vertex);
+				}
+				face.push_back(found->second);
+			}
+
+			if (submeshes.empty()) {
+				submeshes.push_back({ static_cast<uint32_t>(indices.size()), 0, 0, 0 });
+			}
+			for (size_t i = 2; i < face.size(); i++) {
+				indices.push_back(face[0]);
+				indices.push_back(face[i - 1]);
+				indices.push_back(face[i]);
+				submeshes.back().indexCount += 3;
+			}
+		}
+	}
+
+	if (!submeshes.empty() && submeshes.back().indexCount == 0) {
+		submeshes.pop_back();
+	}
+	if (indices.empty()) {
+		std::cout << "ERROR::MeshCooker::CookObj::NoFaces " << path << std::endl;
+		return false;
+	}
+
+	mesh = Describe(vertices, indices, submeshes);
+	std::cout << path << ": " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles, " << submeshes.size() << " submeshes" << std::endl;
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 3) {
+		std::cout << "Usage: MeshCooker input.obj|--quads output.mesh" << std::endl;
+		return -1;
+	}
+
+	std::string input = argv[1];
+	MeshDescription mesh;
+	if (input == "--quads") {
+		mesh = CookQuads();
+	} else if (!CookObj(input, mesh)) {
+		return -1;
+	}
+
+	return MeshFile::Write(argv[2], mesh) ? 0 : -1;
+}
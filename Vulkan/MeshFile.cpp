@@ -0,0 +1,145 @@
+#include "MeshFile.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+// 'VKMS'
+static const uint32_t meshMagic = 0x534D4B56;
+static const uint32_t meshVersion = 1;
+
+static uint64_t AlignSection(uint64_t offset) {
+	return (offset + 15) & ~15ull;
+}
+
+bool MeshFile::Open(const std::string& path) {
+	if (!_file.Open(path)) {
+		std::cout << "ERROR::MeshFile::Open::CannotMapFile " << path << std::endl;
+		Close();
+		return false;
+	}
+
+	_header = reinterpret_cast<const Header*>(_file.GetData());
+	if (!_Validate()) {
+		std::cout << "ERROR::MeshFile::Open::InvalidMesh " << path << std::endl;
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MeshFile::Close() {
+	_file.Close();
+	_header = nullptr;
+}
+
+// Only the header and submesh table are looked at, the vertex and index data are trusted as they are
+bool MeshFile::_Validate() {
+	size_t fileSize = _file.GetSize();
+	if (fileSize < sizeof(Header)) {
+		return false;
+	}
+
+	const Header& header = *_header;
+	if (header.magic != meshMagic || header.version != meshVersion || header.fileSize != fileSize) {
+		return false;
+	}
+
+	auto inFile = [fileSize](uint64_t offset, uint64_t size) {
+		return offset % 16 == 0 && offset <= fileSize && size <= fileSize - offset;
+	};
+
+	if (header.streamCount == 0 || header.streamCount > maxStreams) {
+		return false;
+	}
+	for (uint32_t i = 0; i < header.streamCount; i++) {
+		const MeshStream& stream = header.streams[i];
+		if (stream.stride == 0 || stream.size != static_cast<uint64_t>(stream.stride) * header.vertexCount || !inFile(stream.offset, stream.size)) {
+			return false;
+		}
+	}
+
+	if ((header.indexSize != 2 && header.indexSize != 4) || !inFile(header.indexOffset, static_cast<uint64_t>(header.indexCount) * header.indexSize)) {
+		return false;
+	}
+
+	if (!inFile(header.submeshOffset, static_cast<uint64_t>(header.submeshCount) * sizeof(MeshSubmesh))) {
+		return false;
+	}
+	const MeshSubmesh* submeshes = GetSubmeshes();
+	for (uint32_t i = 0; i < header.submeshCount; i++) {
+		if (submeshes[i].firstIndex > header.indexCount || submeshes[i].indexCount > header.indexCount - submeshes[i].firstIndex) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool MeshFile::Write(const std::string& path, const MeshDescription& mesh) {
+	if (mesh.streams.empty() || mesh.streams.size() > maxStreams || mesh.streams.size() != mesh.streamStrides.size()) {
+		std::cout << "ERROR::MeshFile::Write::InvalidStreams" << std::endl;
+		return false;
+	}
+
+	// Submesh vertex offsets are added after the index is read so only the stored values have to fit in 16 bits
+	uint32_t maxIndex = 0;
+	for (uint32_t index : mesh.indices) {
+		maxIndex = std::max(maxIndex, index);
+	}
+	uint32_t indexSize = maxIndex <= 0xFFFF ? 2 : 4;
+
+	Header header{};
+	header.magic = meshMagic;
+	header.version = meshVersion;
+	header.vertexCount = mesh.vertexCount;
+	header.streamCount = static_cast<uint32_t>(mesh.streams.size());
+
+	uint64_t offset = AlignSection(sizeof(Header));
+	for (uint32_t i = 0; i < header.streamCount; i++) {
+		header.streams[i].stride = mesh.streamStrides[i];
+		header.streams[i].offset = offset;
+		header.streams[i].size = static_cast<uint64_t>(mesh.streamStrides[i]) * mesh.vertexCount;
+		if (mesh.streams[i].size() != header.streams[i].size) {
+			std::cout << "ERROR::MeshFile::Write::StreamSizeMismatch" << std::endl;
+			return false;
+		}
+		offset = AlignSection(offset + header.streams[i].size);
+	}
+
+	header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+	header.indexSize = indexSize;
+	header.indexOffset = offset;
+	offset = AlignSection(offset + static_cast<uint64_t>(header.indexCount) * indexSize);
+
+	header.submeshCount = static_cast<uint32_t>(mesh.submeshes.size());
+	header.submeshOffset = offset;
+	offset += header.submeshCount * sizeof(MeshSubmesh);
+	header.fileSize = offset;
+
+	// Lay the whole file out in memory so it goes to disk in one write
+	std::vector<char> file(static_cast<size_t>(header.fileSize), 0);
+	memcpy(file.data(), &header, sizeof(header));
+	for (uint32_t i = 0; i < header.streamCount; i++) {
+		memcpy(file.data() + header.streams[i].offset, mesh.streams[i].data(), mesh.streams[i].size());
+	}
+	if (indexSize == 2) {
+		uint16_t* indices = reinterpret_cast<uint16_t*>(file.data() + header.indexOffset);
+		for (size_t i = 0; i < mesh.indices.size(); i++) {
+			indices[i] = static_cast<uint16_t>(mesh.indices[i]);
+		}
+	} else {
+		memcpy(file.data() + header.indexOffset, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+	}
+	memcpy(file.data() + header.submeshOffset, mesh.submeshes.data(), mesh.submeshes.size() * sizeof(MeshSubmesh));
+
+	std::ofstream output(path, std::ios::binary | std::ios::trunc);
+	if (!output.is_open()) {
+		std::cout << "ERROR::MeshFile::Write::CannotOpenFile " << path << std::endl;
+		return false;
+	}
+	output.write(file.data(), file.size());
+	return static_cast<bool>(output);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+/*
+
+Cooked mesh files
+A mesh is stored exactly as it is laid out in the GPU buffers: a header, the vertex streams, the index data and a table
+of submesh ranges. Loading memory maps the file and hands pointers into the mapping straight to the upload queue, so
+there is no parsing or per vertex conversion and the time taken is however long the pages take to come off disk.
+
+Everything is little endian and every section starts on a 16 byte boundary. Files are written by MeshFile::Write, the
+MeshCooker project uses it to cook OBJ files
+
+*/
+
+// Byte range of one interleaved vertex stream, streams are bound to consecutive vertex input bindings
+struct MeshStream {
+	uint32_t stride;
+	uint32_t padding;
+	uint64_t offset;
+	uint64_t size;
+};
+
+// A range of indices drawn with one indirect command, typically one per material
+struct MeshSubmesh {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+	uint32_t materialIndex;
+};
+
+// Data for writing a mesh out, indices are narrowed to 16 bits when every vertex can be addressed with them
+struct MeshDescription {
+	std::vector<std::vector<char>> streams;
+	std::vector<uint32_t> streamStrides;
+	uint32_t vertexCount = 0;
+	std::vector<uint32_t> indices;
+	std::vector<MeshSubmesh> submeshes;
+};
+
+class MeshFile {
+public:
+	static const uint32_t maxStreams = 4;
+
+	// Maps the file and checks its header, the mapping stays open until Close
+	bool Open(const std::string& path);
+	void Close();
+
+	uint32_t GetVertexCount() const { return _header->vertexCount; }
+	uint32_t GetStreamCount() const { return _header->streamCount; }
+	const MeshStream& GetStream(uint32_t stream) const { return _header->streams[stream]; }
+	const void* GetStreamData(uint32_t stream) const { return _file.GetData() + _header->streams[stream].offset; }
+
+	// 16 bit indices when the mesh has few enough vertices, otherwise 32 bit
+	VkIndexType GetIndexType() const { return _header->indexSize == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32; }
+	uint32_t GetIndexCount() const { return _header->indexCount; }
+	uint64_t GetIndexDataSize() const { return static_cast<uint64_t>(_header->indexCount) * _header->indexSize; }
+	const void* GetIndexData() const { return _file.GetData() + _header->indexOffset; }
+
+	uint32_t GetSubmeshCount() const { return _header->submeshCount; }
+	const MeshSubmesh* GetSubmeshes() const { return reinterpret_cast<const MeshSubmesh*>(_file.GetData() + _header->submeshOffset); }
+
+	static bool Write(const std::string& path, const MeshDescription& mesh);
+
+private:
+	// Bump the version whenever the layout changes, old files are rejected rather than misread
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertexCount;
+		uint32_t streamCount;
+		MeshStream streams[maxStreams];
+		uint32_t indexCount;
+		uint32_t indexSize;
+		uint64_t indexOffset;
+		uint32_t submeshCount;
+		uint32_t padding;
+		uint64_t submeshOffset;
+		uint64_t fileSize;
+	};
+
+	MappedFile _file;
+	const Header* _header = nullptr;
+
+	bool _Validate();
+};
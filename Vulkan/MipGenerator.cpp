@@ -0,0 +1,472 @@
+#include "MipGenerator.h"
+
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+#include "shaders/DrawConstants.h"
+#include "shaders/SpecializationConstants.h"
+
+void MipGenerator::Init(VkPhysicalDevice physicalDevice, VkDevice device, Allocator* allocator, PipelineCache* pipelineCache, const std::vector<char>& shaderCode, uint32_t framesInFlight, bool enabled) {
+	_physicalDevice = physicalDevice;
+	_device = device;
+	_allocator = allocator;
+	_pipelineCache = pipelineCache;
+	_frames.resize(framesInFlight);
+
+	// A workgroup is 256 threads and binds every level at once, both above what every device has to support
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(_physicalDevice, &properties);
+	_enabled = enabled && !shaderCode.empty()
+		&& properties.limits.maxComputeWorkGroupInvocations >= 256
+		&& properties.limits.maxPerStageDescriptorStorageImages >= _maxLevels;
+	_extendedUsage = properties.apiVersion >= VK_API_VERSION_1_1;
+	if (!_enabled) {
+		return;
+	}
+
+	VkShaderModuleCreateInfo shader_module_create_info{};
+	shader_module_create_info.sType		= VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shader_module_create_info.codeSize	= shaderCode.size();
+	shader_module_create_info.pCode		= reinterpret_cast<const uint32_t*>(shaderCode.data());
+
+	if (vkCreateShaderModule(_device, &shader_module_create_info, nullptr, &_shaderModule) != VK_SUCCESS) {
+		std::cout << "ERROR::MipGenerator::Init::CreateShaderModule" << std::endl;
+		exit(-1);
+	}
+
+	// The base is only read with texelFetch, the sampler just has to exist
+	VkSamplerCreateInfo sampler_create_info{};
+	sampler_create_info.sType			= VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_create_info.magFilter		= VK_FILTER_NEAREST;
+	sampler_create_info.minFilter		= VK_FILTER_NEAREST;
+	sampler_create_info.mipmapMode		= VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_create_info.addressModeU	= VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.addressModeV	= VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.addressModeW	= VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.maxLod			= 0.0f;
+
+	if (vkCreateSampler(_device, &sampler_create_info, nullptr, &_sampler) != VK_SUCCESS) {
+		std::cout << "ERROR::MipGenerator::Init::CreateSampler" << std::endl;
+		exit(-1);
+	}
+
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+	bindings[0].binding			= 0;
+	bindings[0].descriptorType	= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount	= 1;
+	bindings[0].stageFlags		= VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding			= 1;
+	bindings[1].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount	= _maxLevels;
+	bindings[1].stageFlags		= VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[2].binding			= 2;
+	bindings[2].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[2].descriptorCount	= 1;
+	bindings[2].stageFlags		= VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layout_create_info{};
+	layout_create_info.sType		= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_create_info.bindingCount	= static_cast<uint32_t>(bindings.size());
+	layout_create_info.pBindings	= bindings.data();
+
+	if (vkCreateDescriptorSetLayout(_device, &layout_create_info, nullptr, &_setLayout) != VK_SUCCESS) {
+		std::cout << "ERROR::MipGenerator::Init::CreateDescriptorSetLayout" << std::endl;
+		exit(-1);
+	}
+
+	VkPushConstantRange push_constant_range{};
+	push_constant_range.stageFlags	= VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset		= 0;
+	push_constant_range.size		= sizeof(DownsampleConstants);
+
+	VkPipelineLayoutCreateInfo pipeline_layout_create_info{};
+	pipeline_layout_create_info.sType					= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_create_info.setLayoutCount			= 1;
+	pipeline_layout_create_info.pSetLayouts				= &_setLayout;
+	pipeline_layout_create_info.pushConstantRangeCount	= 1;
+	pipeline_layout_create_info.pPushConstantRanges		= &push_constant_range;
+
+	if (vkCreatePipelineLayout(_device, &pipeline_layout_create_info, nullptr, &_pipelineLayout) != VK_SUCCESS) {
+		std::cout << "ERROR::MipGenerator::Init::CreatePipelineLayout" << std::endl;
+		exit(-1);
+	}
+
+	// The counter then a vec4 of level 6 for each of up to 64x64 workgroups (std430 puts the array at 16)
+	_scratchSize = 16 + 64 * 64 * 16;
+
+	VkBufferCreateInfo buffer_create_info{};
+	buffer_create_info.sType		= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_create_info.size			= _scratchSize;
+	buffer_create_info.usage		= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	buffer_create_info.sharingMode	= VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(_device, &buffer_create_info, nullptr, &_scratchBuffer) != VK_SUCCESS) {
+		std::cout << "ERROR::MipGenerator::Init::CreateBuffer" << std::endl;
+		exit(-1);
+	}
+
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(_device, _scratchBuffer, &memory_requirements);
+
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &memoryProperties);
+	uint32_t memoryType = UINT32_MAX;
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount && memoryType == UINT32_MAX; i++) {
+		if ((memory_requirements.memoryTypeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+			memoryType = i;
+		}
+	}
+
+	if (memoryType == UINT32_MAX || !_allocator->Allocate(memory_requirements, memoryType, true, _scratchMemory)) {
+		std::cout << "ERROR::MipGenerator::Init::Allocate" << std::endl;
+		exit(-1);
+	}
+	vkBindBufferMemory(_device, _scratchBuffer, _scratchMemory.memory, _scratchMemory.offset);
+}
+
+void MipGenerator::Destroy() {
+	for (auto& frame : _frames) {
+		for (auto view : frame.views) {
+			vkDestroyImageView(_device, view, nullptr);
+		}
+		for (auto pool : frame.pools) {
+			vkDestroyDescriptorPool(_device, pool, nullptr);
+		}
+	}
+	_frames.clear();
+
+	if (!_enabled) {
+		return;
+	}
+
+	for (auto& pipeline : _pipelines) {
+		vkDestroyPipeline(_device, pipeline.second, nullptr);
+	}
+	_pipelines.clear();
+	vkDestroyBuffer(_device, _scratchBuffer, nullptr);
+	_allocator->Free(_scratchMemory);
+	vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(_device, _setLayout, nullptr);
+	vkDestroySampler(_device, _sampler, nullptr);
+	vkDestroyShaderModule(_device, _shaderModule, nullptr);
+}
+
+bool MipGenerator::CanGenerate(VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usage) {
+	if (!_enabled || std::max(width, height) > _maxBaseSize) {
+		return false;
+	}
+
+	// sRGB images can only be given storage usage for their UNORM views with VK_IMAGE_CREATE_EXTENDED_USAGE_BIT
+	bool srgb;
+	VkFormat storageFormat = _GetStorageFormat(format, srgb);
+	if (srgb && !_extendedUsage) {
+		return false;
+	}
+
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(_physicalDevice, format, &formatProperties);
+	VkFormatProperties storageFormatProperties;
+	vkGetPhysicalDeviceFormatProperties(_physicalDevice, storageFormat, &storageFormatProperties);
+
+	if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)
+		|| !(storageFormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+		return false;
+	}
+
+	// The image itself has to be creatable with exactly the usage and flags it will get
+	VkImageFormatProperties imageFormatProperties;
+	if (vkGetPhysicalDeviceImageFormatProperties(_physicalDevice, format, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_OPTIMAL,
+		usage | GetImageUsage(), GetImageFlags(format), &imageFormatProperties) != VK_SUCCESS) {
+		return false;
+	}
+	return width <= imageFormatProperties.maxExtent.width && height <= imageFormatProperties.maxExtent.height;
+}
+
+VkImageCreateFlags MipGenerator::GetImageFlags(VkFormat format) {
+	bool srgb;
+	_GetStorageFormat(format, srgb);
+	return srgb ? VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT : 0;
+}
+
+void MipGenerator::BeginFrame(uint32_t frame) {
+	_currentFrame = frame;
+	Frame& current = _frames[frame];
+	for (auto view : current.views) {
+		vkDestroyImageView(_device, view, nullptr);
+	}
+	current.views.clear();
+	for (auto pool : current.pools) {
+		vkResetDescriptorPool(_device, pool, 0);
+	}
+}
+
+void MipGenerator::Record(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels,
+	VkImageLayout oldLayout, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, DownsampleFilter filter) {
+
+	bool srgb;
+	VkFormat storageFormat = _GetStorageFormat(format, srgb);
+	mipLevels = std::min(mipLevels, _maxLevels + 1);
+
+	// A single level image only needs moving to shader read only
+	if (mipLevels == 1) {
+		VkImageMemoryBarrier image_memory_barrier{};
+		image_memory_barrier.sType							= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		image_memory_barrier.srcAccessMask					= srcAccess;
+		image_memory_barrier.dstAccessMask					= VK_ACCESS_SHADER_READ_BIT;
+		image_memory_barrier.oldLayout						= oldLayout;
+		image_memory_barrier.newLayout						= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		image_memory_barrier.srcQueueFamilyIndex			= VK_QUEUE_FAMILY_IGNORED;
+		image_memory_barrier.dstQueueFamilyIndex			= VK_QUEUE_FAMILY_IGNORED;
+		image_memory_barrier.image							= image;
+		image_memory_barrier.subresourceRange.aspectMask	= VK_IMAGE_ASPECT_COLOR_BIT;
+		image_memory_barrier.subresourceRange.baseMipLevel	= 0;
+		image_memory_barrier.subresourceRange.levelCount	= 1;
+		image_memory_barrier.subresourceRange.baseArrayLayer = 0;
+		image_memory_barrier.subresourceRange.layerCount	= 1;
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+		return;
+	}
+
+	// The base is sampled in its own format so sRGB is decoded on the way in, the levels are written through storage views
+	VkDescriptorSet set = _AllocateSet();
+	VkDescriptorImageInfo base_image_info{};
+	base_image_info.sampler		= _sampler;
+	base_image_info.imageView	= _CreateView(image, format, 0);
+	base_image_info.imageLayout	= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	// Levels the image doesn't have repeat the last one, the shader never writes past mipLevels
+	std::array<VkDescriptorImageInfo, _maxLevels> level_image_infos{};
+	for (uint32_t level = 1; level <= _maxLevels; level++) {
+		level_image_infos[level - 1].imageLayout	= VK_IMAGE_LAYOUT_GENERAL;
+		level_image_infos[level - 1].imageView		= level < mipLevels ? _CreateView(image, storageFormat, level) : level_image_infos[level - 2].imageView;
+	}
+
+	VkDescriptorBufferInfo scratch_buffer_info{};
+	scratch_buffer_info.buffer	= _scratchBuffer;
+	scratch_buffer_info.offset	= 0;
+	scratch_buffer_info.range	= _scratchSize;
+
+	std::array<VkWriteDescriptorSet, 3> writes{};
+	writes[0].sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writes[0].dstSet			= set;
+	writes[0].dstBinding		= 0;
+	writes[0].descriptorType	= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writes[0].descriptorCount	= 1;
+	writes[0].pImageInfo		= &base_image_info;
+	writes[1].sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writes[1].dstSet			= set;
+	writes[1].dstBinding		= 1;
+	writes[1].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writes[1].descriptorCount	= _maxLevels;
+	writes[1].pImageInfo		= level_image_infos.data();
+	writes[2].sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writes[2].dstSet			= set;
+	writes[2].dstBinding		= 2;
+	writes[2].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	writes[2].descriptorCount	= 1;
+	writes[2].pBufferInfo		= &scratch_buffer_info;
+	vkUpdateDescriptorSets(_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+	// The counter only needs clearing once, after that the scratch buffer just has to wait for the last dispatch
+	VkPipelineStageFlags scratchStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	VkAccessFlags scratchAccess = VK_ACCESS_SHADER_WRITE_BIT;
+	if (!_scratchCleared) {
+		vkCmdFillBuffer(commandBuffer, _scratchBuffer, 0, sizeof(uint32_t), 0);
+		scratchStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		scratchAccess = VK_ACCESS_TRANSFER_WRITE_BIT;
+		_scratchCleared = true;
+	}
+
+	VkBufferMemoryBarrier buffer_memory_barrier{};
+	buffer_memory_barrier.sType					= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	buffer_memory_barrier.srcAccessMask			= scratchAccess;
+	buffer_memory_barrier.dstAccessMask			= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	buffer_memory_barrier.srcQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+	buffer_memory_barrier.dstQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+	buffer_memory_barrier.buffer				= _scratchBuffer;
+	buffer_memory_barrier.offset				= 0;
+	buffer_memory_barrier.size					= VK_WHOLE_SIZE;
+
+	// The base is read as is, whatever was in the other levels is thrown away
+	std::array<VkImageMemoryBarrier, 2> image_memory_barriers{};
+	for (auto& image_memory_barrier : image_memory_barriers) {
+		image_memory_barrier.sType							= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		image_memory_barrier.srcQueueFamilyIndex			= VK_QUEUE_FAMILY_IGNORED;
+		image_memory_barrier.dstQueueFamilyIndex			= VK_QUEUE_FAMILY_IGNORED;
+		image_memory_barrier.image							= image;
+		image_memory_barrier.subresourceRange.aspectMask	= VK_IMAGE_ASPECT_COLOR_BIT;
+		image_memory_barrier.subresourceRange.baseArrayLayer = 0;
+		image_memory_barrier.subresourceRange.layerCount	= 1;
+	}
+	image_memory_barriers[0].srcAccessMask					= srcAccess;
+	image_memory_barriers[0].dstAccessMask					= VK_ACCESS_SHADER_READ_BIT;
+	image_memory_barriers[0].oldLayout						= oldLayout;
+	image_memory_barriers[0].newLayout						= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	image_memory_barriers[0].subresourceRange.baseMipLevel	= 0;
+	image_memory_barriers[0].subresourceRange.levelCount	= 1;
+	image_memory_barriers[1].srcAccessMask					= 0;
+	image_memory_barriers[1].dstAccessMask					= VK_ACCESS_SHADER_WRITE_BIT;
+	image_memory_barriers[1].oldLayout						= VK_IMAGE_LAYOUT_UNDEFINED;
+	image_memory_barriers[1].newLayout						= VK_IMAGE_LAYOUT_GENERAL;
+	image_memory_barriers[1].subresourceRange.baseMipLevel	= 1;
+	image_memory_barriers[1].subresourceRange.levelCount	= mipLevels - 1;
+
+	vkCmdPipelineBarrier(commandBuffer, srcStage | scratchStage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		0, nullptr,
+		1, &buffer_memory_barrier,
+		static_cast<uint32_t>(image_memory_barriers.size()), image_memory_barriers.data());
+
+	DownsampleConstants downsampleConstants{};
+	downsampleConstants.width		= width;
+	downsampleConstants.height		= height;
+	downsampleConstants.mipLevels	= mipLevels;
+
+	// A workgroup per 32x32 block of level 1
+	uint32_t groupsX = (std::max(width / 2, 1u) + 31) / 32;
+	uint32_t groupsY = (std::max(height / 2, 1u) + 31) / 32;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _GetPipeline(filter, srgb));
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &set, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DownsampleConstants), &downsampleConstants);
+	vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+
+	// Level 0 only needs making visible to dstStage, the written levels also move out of general
+	image_memory_barriers[0].srcAccessMask	= 0;
+	image_memory_barriers[0].oldLayout		= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	image_memory_barriers[1].srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	image_memory_barriers[1].dstAccessMask	= VK_ACCESS_SHADER_READ_BIT;
+	image_memory_barriers[1].oldLayout		= VK_IMAGE_LAYOUT_GENERAL;
+	image_memory_barriers[1].newLayout		= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStage, 0,
+		0, nullptr,
+		0, nullptr,
+		static_cast<uint32_t>(image_memory_barriers.size()), image_memory_barriers.data());
+}
+
+// The UNORM format sRGB levels are written through, anything else is written in its own format
+VkFormat MipGenerator::_GetStorageFormat(VkFormat format, bool& srgb) {
+	srgb = true;
+	switch (format) {
+	case VK_FORMAT_R8_SRGB:
+		return VK_FORMAT_R8_UNORM;
+	case VK_FORMAT_R8G8_SRGB:
+		return VK_FORMAT_R8G8_UNORM;
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		return VK_FORMAT_R8G8B8A8_UNORM;
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		return VK_FORMAT_B8G8R8A8_UNORM;
+	case VK_FORMAT_A8B8G8R8_SRGB_PACK32:
+		return VK_FORMAT_A8B8G8R8_UNORM_PACK32;
+	default:
+		srgb = false;
+		return format;
+	}
+}
+
+// A pipeline per filter and encoding, created the first time it's used
+VkPipeline MipGenerator::_GetPipeline(DownsampleFilter filter, bool srgb) {
+	uint32_t key = static_cast<uint32_t>(filter) * 2 + (srgb ? 1 : 0);
+	auto found = _pipelines.find(key);
+	if (found != _pipelines.end()) {
+		return found->second;
+	}
+
+	DownsampleSpecializationConstants constants{};
+	constants.filter	= static_cast<uint32_t>(filter);
+	constants.srgb		= srgb ? VK_TRUE : VK_FALSE;
+
+	std::array<VkSpecializationMapEntry, 2> entries{};
+	entries[0] = { DOWNSAMPLE_FILTER_CONSTANT_ID, offsetof(DownsampleSpecializationConstants, filter), sizeof(uint32_t) };
+	entries[1] = { DOWNSAMPLE_SRGB_CONSTANT_ID, offsetof(DownsampleSpecializationConstants, srgb), sizeof(uint32_t) };
+
+	VkSpecializationInfo specialization_info{};
+	specialization_info.mapEntryCount	= static_cast<uint32_t>(entries.size());
+	specialization_info.pMapEntries		= entries.data();
+	specialization_info.dataSize		= sizeof(constants);
+	specialization_info.pData			= &constants;
+
+	VkComputePipelineCreateInfo pipeline_create_info{};
+	pipeline_create_info.sType						= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_create_info.stage.sType				= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_create_info.stage.stage				= VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_create_info.stage.module				= _shaderModule;
+	pipeline_create_info.stage.pName				= "main";
+	pipeline_create_info.stage.pSpecializationInfo	= &specialization_info;
+	pipeline_create_info.layout						= _pipelineLayout;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	VkPipeline pipeline;
+	if (vkCreateComputePipelines(_device, _pipelineCache->Get(), 1, &pipeline_create_info, nullptr, &pipeline) != VK_SUCCESS) {
+		std::cout << "ERROR::MipGenerator::GetPipeline::CreateComputePipelines" << std::endl;
+		exit(-1);
+	}
+
+	float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+	_pipelineCache->RecordCreation("downsample", ms, nullptr);
+
+	_pipelines[key] = pipeline;
+	return pipeline;
+}
+
+// Sets come from the frame's pools, another pool is added when they're all full
+VkDescriptorSet MipGenerator::_AllocateSet() {
+	Frame& frame = _frames[_currentFrame];
+	for (size_t i = 0;; i++) {
+		if (i == frame.pools.size()) {
+			std::array<VkDescriptorPoolSize, 3> pool_sizes{};
+			pool_sizes[0] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _setsPerPool };
+			pool_sizes[1] = { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, _setsPerPool * _maxLevels };
+			pool_sizes[2] = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _setsPerPool };
+
+			VkDescriptorPoolCreateInfo descriptor_pool_create_info{};
+			descriptor_pool_create_info.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			descriptor_pool_create_info.poolSizeCount	= static_cast<uint32_t>(pool_sizes.size());
+			descriptor_pool_create_info.pPoolSizes		= pool_sizes.data();
+			descriptor_pool_create_info.maxSets			= _setsPerPool;
+
+			VkDescriptorPool pool;
+			if (vkCreateDescriptorPool(_device, &descriptor_pool_create_info, nullptr, &pool) != VK_SUCCESS) {
+				std::cout << "ERROR::MipGenerator::AllocateSet::CreateDescriptorPool" << std::endl;
+				exit(-1);
+			}
+			frame.pools.push_back(pool);
+		}
+
+		VkDescriptorSetAllocateInfo descriptor_set_allocate_info{};
+		descriptor_set_allocate_info.sType				= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		descriptor_set_allocate_info.descriptorPool		= frame.pools[i];
+		descriptor_set_allocate_info.descriptorSetCount	= 1;
+		descriptor_set_allocate_info.pSetLayouts		= &_setLayout;
+
+		VkDescriptorSet set;
+		if (vkAllocateDescriptorSets(_device, &descriptor_set_allocate_info, &set) == VK_SUCCESS) {
+			return set;
+		}
+	}
+}
+
+VkImageView MipGenerator::_CreateView(VkImage image, VkFormat format, uint32_t level) {
+	VkImageViewCreateInfo image_view_create_info{};
+	image_view_create_info.sType							= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	image_view_create_info.image							= image;
+	image_view_create_info.viewType							= VK_IMAGE_VIEW_TYPE_2D;
+	image_view_create_info.format							= format;
+	image_view_create_info.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	image_view_create_info.subresourceRange.baseMipLevel	= level;
+	image_view_create_info.subresourceRange.levelCount		= 1;
+	image_view_create_info.subresourceRange.baseArrayLayer	= 0;
+	image_view_create_info.subresourceRange.layerCount		= 1;
+
+	VkImageView view;
+	if (vkCreateImageView(_device, &image_view_create_info, nullptr, &view) != VK_SUCCESS) {
+		std::cout << "ERROR::MipGenerator::CreateView::CreateImageView" << std::endl;
+		exit(-1);
+	}
+	_frames[_currentFrame].views.push_back(view);
+	return view;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <unordered_map>
+
+#include "Allocator.h"
+#include "PipelineCache.h"
+
+/*
+
+Single pass mip chain generation
+Every level below the base is written by one compute dispatch instead of a blit and a pair of barriers per level.
+Each workgroup reduces a 64x64 block of the base to a single texel through shared memory, writing levels 1 to 6 on
+the way, and leaves that texel in a scratch buffer. The last workgroup to finish (counted with an atomic in the same
+buffer) carries on from them to write levels 7 to 12, so bases up to 4096 across need no barriers between levels
+
+The base is read with texelFetch and the levels are written as storage images, so neither linear filtering nor blit
+support is needed. sRGB formats can't be storage images, their levels are written through UNORM views with the
+encoding done in the shader. Those images need VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT for the views and, as the storage
+usage is only valid for them, VK_IMAGE_CREATE_EXTENDED_USAGE_BIT from Vulkan 1.1 (see GetImageFlags). On an odd
+sized base the trailing row or column is folded into the last texel of level 1, deeper levels reduce exact 2x2 blocks
+
+*/
+
+// How a 2x2 block becomes one texel, shaders/downsample.comp is specialised on it
+enum class DownsampleFilter {
+	Average,
+
+	// Colour is weighted by alpha so the transparent texels around a cutout don't bleed their colour into its edge
+	AlphaWeighted,
+	Min,
+	Max
+};
+
+class MipGenerator {
+public:
+	// Without shader code, or with enabled false, CanGenerate is always false
+	void Init(VkPhysicalDevice, VkDevice, Allocator*, PipelineCache*, const std::vector<char>& shaderCode, uint32_t framesInFlight, bool enabled);
+	void Destroy();
+
+	// Whether Record can fill the chain of an image of this format and base size, if so it needs to have been created
+	// with the usage and flags below as well as the usage passed in, whatever else it's used for
+	bool CanGenerate(VkFormat, uint32_t width, uint32_t height, VkImageUsageFlags usage);
+	VkImageUsageFlags GetImageUsage() { return VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT; }
+	VkImageCreateFlags GetImageFlags(VkFormat);
+
+	// Frees the views and descriptor sets recorded the last time this frame in flight was used, it must have completed
+	void BeginFrame(uint32_t frame);
+
+	// Fills levels 1 to mipLevels - 1 from level 0. All levels start in oldLayout with level 0 last written at
+	// srcStage/srcAccess, all of them are left shader read only for reads at dstStage
+	void Record(VkCommandBuffer, VkImage, VkFormat, uint32_t width, uint32_t height, uint32_t mipLevels,
+		VkImageLayout oldLayout, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage,
+		DownsampleFilter filter = DownsampleFilter::Average);
+
+private:
+	// Views and sets stay alive until the frame that used them has completed
+	struct Frame {
+		std::vector<VkDescriptorPool> pools;
+		std::vector<VkImageView> views;
+	};
+
+	static constexpr uint32_t _maxLevels = 12;
+	static constexpr uint32_t _maxBaseSize = 4096;
+	static constexpr uint32_t _setsPerPool = 16;
+
+	VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+	VkDevice _device = VK_NULL_HANDLE;
+	Allocator* _allocator = nullptr;
+	PipelineCache* _pipelineCache = nullptr;
+	bool _enabled = false;
+	bool _extendedUsage = false;
+
+	VkShaderModule _shaderModule = VK_NULL_HANDLE;
+	VkSampler _sampler = VK_NULL_HANDLE;
+	VkDescriptorSetLayout _setLayout = VK_NULL_HANDLE;
+	VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
+	std::unordered_map<uint32_t, VkPipeline> _pipelines;
+
+	// Level 6 of every workgroup and the counter that finds the last one, the counter is left at 0 by every dispatch
+	// so it's only cleared before the first
+	VkBuffer _scratchBuffer = VK_NULL_HANDLE;
+	Allocation _scratchMemory;
+	VkDeviceSize _scratchSize = 0;
+	bool _scratchCleared = false;
+
+	std::vector<Frame> _frames;
+	uint32_t _currentFrame = 0;
+
+	static VkFormat _GetStorageFormat(VkFormat, bool& srgb);
+	VkPipeline _GetPipeline(DownsampleFilter, bool srgb);
+	VkDescriptorSet _AllocateSet();
+	VkImageView _CreateView(VkImage, VkFormat, uint32_t level);
+};
@@ -0,0 +1,205 @@
+#include "PipelineCache.h"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+
+// 'VKPC', bump the file version whenever FileHeader changes
+static const uint32_t cacheMagic = 0x43504B56;
+static const uint32_t cacheFileVersion = 1;
+
+void PipelineCache::Load(VkPhysicalDevice physicalDevice, const std::string& path) {
+	_path = path;
+	vkGetPhysicalDeviceProperties(physicalDevice, &_properties);
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	_stats.loadedFromDisk = _Load(_initialData);
+	if (!_stats.loadedFromDisk) {
+		_initialData.clear();
+	}
+
+	_stats.loadedBytes = _initialData.size();
+	_stats.loadMs = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void PipelineCache::Init(VkDevice device) {
+	_device = device;
+
+	VkPipelineCacheCreateInfo pipeline_cache_create_info{};
+	pipeline_cache_create_info.sType			= VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipeline_cache_create_info.initialDataSize	= _initialData.size();
+	pipeline_cache_create_info.pInitialData		= _initialData.empty() ? nullptr : _initialData.data();
+
+	// A driver can still reject data that passed the header checks, start from an empty cache rather than fail
+	if (vkCreatePipelineCache(_device, &pipeline_cache_create_info, nullptr, &_cache) != VK_SUCCESS) {
+		std::cout << "ERROR::PipelineCache::Init::CreatePipelineCache::InitialDataRejected" << std::endl;
+		_stats.loadedFromDisk = false;
+		_stats.loadedBytes = 0;
+
+		pipeline_cache_create_info.initialDataSize = 0;
+		pipeline_cache_create_info.pInitialData = nullptr;
+		if (vkCreatePipelineCache(_device, &pipeline_cache_create_info, nullptr, &_cache) != VK_SUCCESS) {
+			std::cout << "ERROR::PipelineCache::Init::CreatePipelineCache" << std::endl;
+			exit(-1);
+		}
+	}
+
+	// The driver has its own copy now
+	std::vector<char>().swap(_initialData);
+}
+
+void PipelineCache::Destroy() {
+	if (_cache == nullptr) {
+		return;
+	}
+
+	if (!_Save()) {
+		std::cout << "ERROR::PipelineCache::Destroy::SaveFailed " << _path << std::endl;
+	}
+
+	vkDestroyPipelineCache(_device, _cache, nullptr);
+	_cache = nullptr;
+}
+
+void PipelineCache::RecordCreation(const char* name, float ms, const VkPipelineCreationFeedbackEXT* feedback) {
+	const char* result = "unknown";
+
+	if (feedback != nullptr && (feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)) {
+		if (feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) {
+			_stats.hits++;
+			_stats.hitMs += ms;
+			result = "hit";
+		} else {
+			_stats.misses++;
+			_stats.missMs += ms;
+			result = "miss";
+		}
+	} else {
+		_stats.unknown++;
+		_stats.unknownMs += ms;
+	}
+
+	std::cout << "PipelineCache: " << name << " created in " << ms << "ms (" << result << ")" << std::endl;
+}
+
+void PipelineCache::PrintStats() {
+	std::cout << "PipelineCache: " << (_stats.loadedFromDisk ? "loaded " : "cold start, read ") << _stats.loadedBytes / 1024 << "KB in " << _stats.loadMs << "ms, "
+		<< _stats.hits << " hits (" << _stats.hitMs << "ms), "
+		<< _stats.misses << " misses (" << _stats.missMs << "ms), "
+		<< _stats.unknown << " unknown (" << _stats.unknownMs << "ms)" << std::endl;
+}
+
+// Reads the file at _path into data, returns false if it is missing, corrupt or was written by a different device or driver
+bool PipelineCache::_Load(std::vector<char>& data) {
+	std::ifstream file(_path, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	if (fileSize < sizeof(FileHeader)) {
+		std::cout << "PipelineCache: discarding " << _path << ", file is truncated" << std::endl;
+		return false;
+	}
+
+	FileHeader header;
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (header.magic != cacheMagic || header.fileVersion != cacheFileVersion || header.dataSize != fileSize - sizeof(FileHeader)) {
+		std::cout << "PipelineCache: discarding " << _path << ", unrecognised file" << std::endl;
+		return false;
+	}
+
+	// Cache data is only valid for the exact device and driver build that produced it
+	if (header.vendorID != _properties.vendorID || header.deviceID != _properties.deviceID || header.driverVersion != _properties.driverVersion ||
+		memcmp(header.pipelineCacheUUID, _properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+		std::cout << "PipelineCache: discarding " << _path << ", written by a different device or driver" << std::endl;
+		return false;
+	}
+
+	data.resize(static_cast<size_t>(header.dataSize));
+	file.read(data.data(), data.size());
+	if (!file || _Checksum(data.data(), data.size()) != header.checksum) {
+		std::cout << "PipelineCache: discarding " << _path << ", checksum mismatch" << std::endl;
+		return false;
+	}
+
+	// The driver's own header should agree with ours, check it too rather than trust the driver to
+	VkPipelineCacheHeaderVersionOne driverHeader;
+	if (data.size() < sizeof(driverHeader)) {
+		return false;
+	}
+	memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+	if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || driverHeader.vendorID != _properties.vendorID || driverHeader.deviceID != _properties.deviceID ||
+		memcmp(driverHeader.pipelineCacheUUID, _properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+		std::cout << "PipelineCache: discarding " << _path << ", driver header mismatch" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+// Writes to a temporary file and renames it over the old one so a crash mid write never leaves a half written cache behind
+bool PipelineCache::_Save() {
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(_device, _cache, &dataSize, nullptr) != VK_SUCCESS) {
+		return false;
+	}
+
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(_device, _cache, &dataSize, data.data()) != VK_SUCCESS) {
+		return false;
+	}
+	data.resize(dataSize);
+
+	FileHeader header{};
+	header.magic = cacheMagic;
+	header.fileVersion = cacheFileVersion;
+	header.vendorID = _properties.vendorID;
+	header.deviceID = _properties.deviceID;
+	header.driverVersion = _properties.driverVersion;
+	memcpy(header.pipelineCacheUUID, _properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = data.size();
+	header.checksum = _Checksum(data.data(), data.size());
+
+	std::string tempPath = _path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), data.size());
+		file.flush();
+		if (!file) {
+			file.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, _path, error);
+	if (error) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+// 64 bit FNV-1a, only used to catch truncated or corrupted files
+uint64_t PipelineCache::_Checksum(const char* data, size_t size) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= static_cast<uint8_t>(data[i]);
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+/*
+
+Pipeline cache persisted to disk between runs
+The driver's cache blob is stored behind a small header identifying the device and driver that produced it,
+a file written by a different GPU or driver version is discarded instead of being handed to the driver
+
+*/
+
+// Startup numbers for tracking pipeline creation regressions
+struct PipelineCacheStats {
+	bool loadedFromDisk = false;
+	size_t loadedBytes = 0;
+	float loadMs = 0.0f;
+
+	// Hits and misses are only known when VK_EXT_pipeline_creation_feedback is supported, otherwise creations count as unknown
+	uint32_t hits = 0;
+	uint32_t misses = 0;
+	uint32_t unknown = 0;
+	float hitMs = 0.0f;
+	float missMs = 0.0f;
+	float unknownMs = 0.0f;
+};
+
+class PipelineCache {
+public:
+	// Reads the file at path and keeps it if it was written by this device and driver, this only needs the
+	// physical device so it can run while the logical device is still being created
+	void Load(VkPhysicalDevice, const std::string& path);
+
+	// Creates the cache, seeded from whatever Load kept
+	void Init(VkDevice);
+
+	// Saves the cache back to disk then destroys it
+	void Destroy();
+
+	VkPipelineCache Get() { return _cache; }
+
+	// Times a pipeline creation, feedback may be null if creation feedback is not supported
+	void RecordCreation(const char* name, float ms, const VkPipelineCreationFeedbackEXT* feedback);
+
+	PipelineCacheStats GetStats() { return _stats; }
+	void PrintStats();
+
+private:
+	// Written in front of the driver's data
+	struct FileHeader {
+		uint32_t magic;
+		uint32_t fileVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t dataSize;
+		uint64_t checksum;
+	};
+
+	VkDevice _device = nullptr;
+	VkPhysicalDeviceProperties _properties{};
+	VkPipelineCache _cache = nullptr;
+	std::string _path;
+	std::vector<char> _initialData;
+	PipelineCacheStats _stats;
+
+	bool _Load(std::vector<char>& data);
+	bool _Save();
+	static uint64_t _Checksum(const char* data, size_t size);
+};
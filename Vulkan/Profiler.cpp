@@ -0,0 +1,217 @@
+#include "Profiler.h"
+
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <algorithm>
+
+// Open CPU zones of the calling thread, zones nest so a stack is enough
+static thread_local std::vector<std::pair<const char*, uint64_t>> openZones;
+
+// Small stable ids for the trace's thread tracks
+static std::atomic<uint32_t> nextThreadIndex{ 1 };
+static uint32_t ThreadIndex() {
+	static thread_local uint32_t index = nextThreadIndex.fetch_add(1);
+	return index;
+}
+
+void Profiler::Init(bool enabled, size_t maxEvents) {
+	_enabled = enabled;
+	_maxEvents = maxEvents;
+	_start = std::chrono::steady_clock::now();
+
+	if (_enabled) {
+		_events.reserve(std::min<size_t>(_maxEvents, 1 << 16));
+	}
+}
+
+void Profiler::InitGpu(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t framesInFlight) {
+	if (!_enabled) {
+		return;
+	}
+	_device = device;
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+	uint32_t validBits = queueFamily < familyCount ? families[queueFamily].timestampValidBits : 0;
+	if (validBits == 0) {
+		std::cout << "Profiler: timestamps are not supported on the graphics queue, only CPU zones will be recorded" << std::endl;
+		return;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	_timestampPeriod = properties.limits.timestampPeriod;
+	_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	_gpuFrames.resize(framesInFlight);
+	for (auto& frame : _gpuFrames) {
+		VkQueryPoolCreateInfo query_pool_create_info{};
+		query_pool_create_info.sType		= VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		query_pool_create_info.queryType	= VK_QUERY_TYPE_TIMESTAMP;
+		query_pool_create_info.queryCount	= _maxGpuQueries;
+
+		if (vkCreateQueryPool(_device, &query_pool_create_info, nullptr, &frame.pool) != VK_SUCCESS) {
+			std::cout << "ERROR::Profiler::InitGpu::CreateQueryPool" << std::endl;
+			exit(-1);
+		}
+	}
+	_gpuEnabled = true;
+}
+
+void Profiler::Destroy() {
+	for (auto& frame : _gpuFrames) {
+		_ResolveGpuFrame(frame);
+		vkDestroyQueryPool(_device, frame.pool, nullptr);
+	}
+	_gpuFrames.clear();
+	_gpuEnabled = false;
+}
+
+void Profiler::BeginZone(const char* name) {
+	if (!_enabled) {
+		return;
+	}
+	openZones.push_back({ name, _Now() });
+}
+
+void Profiler::EndZone() {
+	if (!_enabled || openZones.empty()) {
+		return;
+	}
+
+	auto zone = openZones.back();
+	openZones.pop_back();
+	_AddEvent({ zone.first, zone.second, _Now() - zone.second, ThreadIndex(), false });
+}
+
+void Profiler::BeginGpuFrame(VkCommandBuffer commandBuffer, uint32_t frame) {
+	if (!_gpuEnabled) {
+		return;
+	}
+
+	// The frame has been waited on so this never blocks
+	GpuFrame& gpuFrame = _gpuFrames[frame];
+	_ResolveGpuFrame(gpuFrame);
+
+	vkCmdResetQueryPool(commandBuffer, gpuFrame.pool, 0, _maxGpuQueries);
+	gpuFrame.cpuStart = _Now();
+	_currentGpuFrame = frame;
+}
+
+void Profiler::BeginGpuZone(VkCommandBuffer commandBuffer, const char* name, VkPipelineStageFlagBits stage) {
+	if (!_gpuEnabled) {
+		return;
+	}
+
+	// Out of queries, the zone is just not recorded
+	GpuFrame& frame = _gpuFrames[_currentGpuFrame];
+	if (frame.used + 2 > _maxGpuQueries) {
+		frame.open.push_back(UINT32_MAX);
+		return;
+	}
+
+	vkCmdWriteTimestamp(commandBuffer, stage, frame.pool, frame.used);
+	frame.open.push_back(static_cast<uint32_t>(frame.zones.size()));
+	frame.zones.push_back({ name, frame.used, 0 });
+	frame.used += 2;
+}
+
+void Profiler::EndGpuZone(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage) {
+	if (!_gpuEnabled) {
+		return;
+	}
+
+	GpuFrame& frame = _gpuFrames[_currentGpuFrame];
+	if (frame.open.empty()) {
+		return;
+	}
+	uint32_t zone = frame.open.back();
+	frame.open.pop_back();
+	if (zone == UINT32_MAX) {
+		return;
+	}
+
+	frame.zones[zone].end = frame.zones[zone].begin + 1;
+	vkCmdWriteTimestamp(commandBuffer, stage, frame.pool, frame.zones[zone].end);
+}
+
+bool Profiler::WriteChromeTrace(const std::string& path) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "ERROR::Profiler::WriteChromeTrace::CannotOpenFile " << path << std::endl;
+		return false;
+	}
+
+	// Complete ('X') events with microsecond timestamps, the CPU and GPU get a process each so they show as separate groups
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}";
+	for (const Event& event : _events) {
+		file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0
+			<< ",\"pid\":" << (event.gpu ? 1 : 0) << ",\"tid\":" << event.thread << "}";
+	}
+	file << "\n]}\n";
+
+	if (_droppedEvents) {
+		std::cout << "Profiler: " << _droppedEvents << " events dropped after reaching the limit of " << _maxEvents << std::endl;
+	}
+	std::cout << "Profiler: wrote " << _events.size() << " events to " << path << std::endl;
+	return static_cast<bool>(file);
+}
+
+// Nanoseconds since Init
+uint64_t Profiler::_Now() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count());
+}
+
+void Profiler::_AddEvent(const Event& event) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_events.size() >= _maxEvents) {
+		_droppedEvents++;
+		return;
+	}
+	_events.push_back(event);
+}
+
+void Profiler::_ResolveGpuFrame(GpuFrame& frame) {
+	if (frame.used == 0) {
+		return;
+	}
+
+	// No wait flag, each timestamp comes with its availability so a zone that was never closed, or somehow isn't there
+	// yet, is dropped on its own rather than stalling or losing the whole frame
+	std::vector<uint64_t> results(frame.used * 2);
+	VkResult result = vkGetQueryPoolResults(_device, frame.pool, 0, frame.used, results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	if (result == VK_SUCCESS || result == VK_NOT_READY) {
+		auto available = [&](uint32_t query) { return results[query * 2 + 1] != 0; };
+		auto timestamp = [&](uint32_t query) { return results[query * 2] & _timestampMask; };
+
+		// Zones are timed relative to the first one that has a result
+		uint64_t base = 0;
+		bool hasBase = false;
+		for (const GpuZone& zone : frame.zones) {
+			if (zone.end == 0 || !available(zone.begin) || !available(zone.end)) {
+				continue;
+			}
+			if (!hasBase) {
+				base = timestamp(zone.begin);
+				hasBase = true;
+			}
+			uint64_t begin = (timestamp(zone.begin) - base) & _timestampMask;
+			uint64_t end = (timestamp(zone.end) - base) & _timestampMask;
+			uint64_t start = frame.cpuStart + static_cast<uint64_t>(begin * _timestampPeriod);
+			_AddEvent({ zone.name, start, static_cast<uint64_t>((end - begin) * _timestampPeriod), 0, true });
+		}
+	}
+
+	frame.zones.clear();
+	frame.open.clear();
+	frame.used = 0;
+}
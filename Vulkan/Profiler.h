@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <chrono>
+
+/*
+
+CPU and GPU frame profiler
+CPU zones are timed with ProfileScope on whichever thread they run, GPU zones are pairs of vkCmdWriteTimestamp in the
+frame's command buffer. Each frame in flight has its own query pool which is read back once that frame has
+completed, so results are never waited on. Everything is written out as Chrome trace JSON (chrome://tracing, Perfetto)
+
+GPU timestamps have their own timebase, each frame's GPU zones are placed on the CPU timeline by lining the first of
+them up with the time the frame's command buffer started recording, so GPU zones are only roughly in step with the CPU
+
+*/
+
+class Profiler {
+public:
+	// A disabled profiler records nothing, past maxEvents new events are dropped rather than growing without bound
+	void Init(bool enabled, size_t maxEvents = 1 << 20);
+
+	// GPU zones are skipped if queueFamily, the family they are recorded on, doesn't support timestamps
+	void InitGpu(VkPhysicalDevice, VkDevice, uint32_t queueFamily, uint32_t framesInFlight);
+	void Destroy();
+
+	bool IsEnabled() { return _enabled; }
+
+	// CPU zones, names must outlive the profiler (string literals)
+	void BeginZone(const char* name);
+	void EndZone();
+
+	// Reads back the GPU zones recorded the last time this frame in flight was used and resets its queries,
+	// must be called at the start of the frame's command buffer after the frame has been waited on
+	void BeginGpuFrame(VkCommandBuffer, uint32_t frame);
+	void BeginGpuZone(VkCommandBuffer, const char* name, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	void EndGpuZone(VkCommandBuffer, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+	bool WriteChromeTrace(const std::string& path);
+
+private:
+	struct Event {
+		const char* name;
+		uint64_t start;
+		uint64_t duration;
+		uint32_t thread;
+		bool gpu;
+	};
+
+	// An open GPU zone, begin and end are query indices in the frame's pool
+	struct GpuZone {
+		const char* name;
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	struct GpuFrame {
+		VkQueryPool pool = VK_NULL_HANDLE;
+		std::vector<GpuZone> zones;
+		std::vector<uint32_t> open;
+		uint32_t used = 0;
+		uint64_t cpuStart = 0;
+	};
+
+	bool _enabled = false;
+	size_t _maxEvents = 0;
+	size_t _droppedEvents = 0;
+	std::chrono::steady_clock::time_point _start;
+
+	std::mutex _mutex;
+	std::vector<Event> _events;
+
+	VkDevice _device = VK_NULL_HANDLE;
+	bool _gpuEnabled = false;
+	double _timestampPeriod = 1.0;
+	uint64_t _timestampMask = ~0ull;
+	const uint32_t _maxGpuQueries = 64;
+	std::vector<GpuFrame> _gpuFrames;
+	uint32_t _currentGpuFrame = 0;
+
+	uint64_t _Now();
+	void _AddEvent(const Event&);
+	void _ResolveGpuFrame(GpuFrame&);
+};
+
+// Times the enclosing scope as a CPU zone
+class ProfileScope {
+public:
+	ProfileScope(Profiler& profiler, const char* name) : _profiler(profiler) { _profiler.BeginZone(name); }
+	~ProfileScope() { _profiler.EndZone(); }
+
+private:
+	Profiler& _profiler;
+};
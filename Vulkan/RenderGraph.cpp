@@ -0,0 +1,283 @@
+#include "RenderGraph.h"
+
+#include <iostream>
+#include <algorithm>
+
+void RenderGraph::Init(VkPhysicalDevice physicalDevice, VkDevice device, Allocator* allocator) {
+	_physicalDevice = physicalDevice;
+	_device = device;
+	_allocator = allocator;
+}
+
+RenderGraphResources RenderGraph::Reset() {
+	RenderGraphResources resources = _resources;
+	_resources = RenderGraphResources();
+	_images.clear();
+	_memoryStates.clear();
+	_passes.clear();
+	return resources;
+}
+
+void RenderGraph::DestroyResources(RenderGraphResources& resources) {
+	for (auto view : resources.views) {
+		vkDestroyImageView(_device, view, nullptr);
+	}
+	for (auto image : resources.images) {
+		vkDestroyImage(_device, image, nullptr);
+	}
+	for (auto& memory : resources.memory) {
+		_allocator->Free(memory);
+	}
+	resources = RenderGraphResources();
+}
+
+uint32_t RenderGraph::ImportImage(VkImageAspectFlags aspect) {
+	Image image;
+	image.aspect = aspect;
+	image.memoryState = static_cast<uint32_t>(_memoryStates.size());
+	_memoryStates.emplace_back();
+	_images.push_back(image);
+	return static_cast<uint32_t>(_images.size() - 1);
+}
+
+void RenderGraph::SetImage(uint32_t image, VkImage handle, VkPipelineStageFlags availableStage) {
+	_images[image].image = handle;
+	_images[image].discard = true;
+	_memoryStates[_images[image].memoryState] = { availableStage, 0 };
+}
+
+uint32_t RenderGraph::CreateTransient(const TransientImageDesc& desc) {
+	Image image;
+	image.aspect = desc.aspect;
+	image.transient = true;
+	image.desc = desc;
+	image.usage = desc.usage;
+	_images.push_back(image);
+	return static_cast<uint32_t>(_images.size() - 1);
+}
+
+uint32_t RenderGraph::AddPass(const char* name, const std::vector<std::pair<uint32_t, ImageUse>>& uses, std::function<void(VkCommandBuffer)> record) {
+	uint32_t pass = static_cast<uint32_t>(_passes.size());
+	for (auto& use : uses) {
+		Image& image = _images[use.first];
+		image.firstPass = std::min(image.firstPass, pass);
+		image.lastPass = std::max(image.lastPass, pass);
+		image.usage |= _GetUseInfo(use.second).usage;
+	}
+	_passes.push_back({ name, uses, record });
+	return pass;
+}
+
+void RenderGraph::Compile() {
+
+	// A range of memory shared by transients whose passes never overlap
+	struct Slot {
+		VkMemoryRequirements requirements;
+		bool lazy;
+		std::vector<std::pair<uint32_t, uint32_t>> passRanges;
+		std::vector<uint32_t> images;
+	};
+	std::vector<Slot> slots;
+
+	// Placed in the order they're first used so each one can go in after the ones it follows
+	std::vector<uint32_t> order;
+	for (uint32_t i = 0; i < _images.size(); i++) {
+		if (_images[i].transient) {
+			order.push_back(i);
+		}
+	}
+	std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return _images[a].firstPass < _images[b].firstPass; });
+
+	for (uint32_t index : order) {
+		Image& image = _images[index];
+
+		// Only attachments can stay in tile memory, anything read outside a render pass needs to be backed
+		const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+		bool lazy = (image.usage & ~attachmentUsage) == 0;
+
+		VkImageCreateInfo image_create_info{};
+		image_create_info.sType			= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_create_info.imageType		= VK_IMAGE_TYPE_2D;
+		image_create_info.extent		= { image.desc.extent.width, image.desc.extent.height, 1 };
+		image_create_info.mipLevels		= 1;
+		image_create_info.arrayLayers	= 1;
+		image_create_info.format		= image.desc.format;
+		image_create_info.tiling		= VK_IMAGE_TILING_OPTIMAL;
+		image_create_info.initialLayout	= VK_IMAGE_LAYOUT_UNDEFINED;
+		image_create_info.usage			= image.usage | (lazy ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+		image_create_info.samples		= image.desc.samples;
+		image_create_info.sharingMode	= VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateImage(_device, &image_create_info, nullptr, &image.image) != VK_SUCCESS) {
+			std::cout << "ERROR::RenderGraph::Compile::CreateImage" << std::endl;
+			exit(-1);
+		}
+		_resources.images.push_back(image.image);
+
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(_device, image.image, &requirements);
+
+		// Any slot whose images are all done with before this one starts, or start after it's done, can take it
+		Slot* slot = nullptr;
+		for (auto& candidate : slots) {
+			bool overlaps = false;
+			for (auto& range : candidate.passRanges) {
+				overlaps |= image.firstPass <= range.second && range.first <= image.lastPass;
+			}
+			if (!overlaps && candidate.lazy == lazy && (candidate.requirements.memoryTypeBits & requirements.memoryTypeBits)) {
+				slot = &candidate;
+				break;
+			}
+		}
+		if (slot == nullptr) {
+			slots.push_back({ requirements, lazy });
+			slot = &slots.back();
+		} else {
+			slot->requirements.size = std::max(slot->requirements.size, requirements.size);
+			slot->requirements.alignment = std::max(slot->requirements.alignment, requirements.alignment);
+			slot->requirements.memoryTypeBits &= requirements.memoryTypeBits;
+		}
+		slot->passRanges.push_back({ image.firstPass, image.lastPass });
+		slot->images.push_back(index);
+	}
+
+	for (auto& slot : slots) {
+		Allocation memory;
+		if (!_allocator->Allocate(slot.requirements, _FindMemoryType(slot.requirements.memoryTypeBits, slot.lazy), false, memory)) {
+			std::cout << "ERROR::RenderGraph::Compile::Allocate" << std::endl;
+			exit(-1);
+		}
+		_resources.memory.push_back(memory);
+
+		// Aliased images share their barrier state through the slot's memory state
+		uint32_t memoryState = static_cast<uint32_t>(_memoryStates.size());
+		_memoryStates.emplace_back();
+
+		for (uint32_t index : slot.images) {
+			Image& image = _images[index];
+			vkBindImageMemory(_device, image.image, memory.memory, memory.offset);
+			image.memoryState = memoryState;
+
+			VkImageViewCreateInfo image_view_create_info{};
+			image_view_create_info.sType							= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			image_view_create_info.image							= image.image;
+			image_view_create_info.viewType							= VK_IMAGE_VIEW_TYPE_2D;
+			image_view_create_info.format							= image.desc.format;
+			image_view_create_info.subresourceRange.aspectMask		= image.aspect;
+			image_view_create_info.subresourceRange.baseMipLevel	= 0;
+			image_view_create_info.subresourceRange.levelCount		= 1;
+			image_view_create_info.subresourceRange.baseArrayLayer	= 0;
+			image_view_create_info.subresourceRange.layerCount		= 1;
+
+			if (vkCreateImageView(_device, &image_view_create_info, nullptr, &image.view) != VK_SUCCESS) {
+				std::cout << "ERROR::RenderGraph::Compile::CreateImageView" << std::endl;
+				exit(-1);
+			}
+			_resources.views.push_back(image.view);
+		}
+	}
+}
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer, Profiler& profiler) {
+	std::vector<VkImageMemoryBarrier> barriers;
+
+	for (uint32_t pass = 0; pass < _passes.size(); pass++) {
+		barriers.clear();
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+
+		for (auto& use : _passes[pass].uses) {
+			Image& image = _images[use.first];
+			MemoryState& memory = _memoryStates[image.memoryState];
+			UseInfo info = _GetUseInfo(use.second);
+
+			bool discard = image.discard || (image.transient && pass == image.firstPass);
+			VkImageLayout oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : image.layout;
+			image.layout = info.layout;
+			image.discard = false;
+
+			// Another read in the same layout only has to be waited on by whatever writes next
+			if (oldLayout == info.layout && memory.writeAccess == 0 && info.writeAccess == 0) {
+				memory.stages |= info.stages;
+				continue;
+			}
+
+			VkImageMemoryBarrier image_memory_barrier{};
+			image_memory_barrier.sType							= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			image_memory_barrier.srcAccessMask					= memory.writeAccess;
+			image_memory_barrier.dstAccessMask					= info.access;
+			image_memory_barrier.oldLayout						= oldLayout;
+			image_memory_barrier.newLayout						= info.layout;
+			image_memory_barrier.srcQueueFamilyIndex			= VK_QUEUE_FAMILY_IGNORED;
+			image_memory_barrier.dstQueueFamilyIndex			= VK_QUEUE_FAMILY_IGNORED;
+			image_memory_barrier.image							= image.image;
+			image_memory_barrier.subresourceRange.aspectMask	= image.aspect;
+			image_memory_barrier.subresourceRange.baseMipLevel	= 0;
+			image_memory_barrier.subresourceRange.levelCount	= 1;
+			image_memory_barrier.subresourceRange.baseArrayLayer = 0;
+			image_memory_barrier.subresourceRange.layerCount	= 1;
+			barriers.push_back(image_memory_barrier);
+
+			srcStages |= memory.stages;
+			dstStages |= info.stages;
+			memory.stages = info.stages;
+			memory.writeAccess = info.writeAccess;
+		}
+
+		if (!barriers.empty()) {
+			// Memory never used before has nothing to wait on
+			vkCmdPipelineBarrier(commandBuffer, srcStages ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStages, 0, 0, nullptr, 0, nullptr,
+				static_cast<uint32_t>(barriers.size()), barriers.data());
+		}
+
+		if (_passes[pass].record) {
+			profiler.BeginGpuZone(commandBuffer, _passes[pass].name);
+			_passes[pass].record(commandBuffer);
+			profiler.EndGpuZone(commandBuffer);
+		}
+	}
+}
+
+RenderGraph::UseInfo RenderGraph::_GetUseInfo(ImageUse use) {
+	switch (use) {
+	case ImageUse::ColorAttachment:
+		return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT };
+	case ImageUse::DepthAttachment:
+		return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT };
+	case ImageUse::Sampled:
+		return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_USAGE_SAMPLED_BIT };
+	case ImageUse::TransferSrc:
+		return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0, VK_IMAGE_USAGE_TRANSFER_SRC_BIT };
+	case ImageUse::TransferDst:
+		return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT };
+	case ImageUse::Present:
+		break;
+	}
+
+	// Presentation is ordered by the semaphore signalled with the submit, the barrier only needs the layout
+	return { VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, 0 };
+}
+
+// Lazily allocated memory if the device has it and the images can use it, otherwise plain device local
+uint32_t RenderGraph::_FindMemoryType(uint32_t typeBits, bool lazy) {
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &memoryProperties);
+
+	std::vector<VkMemoryPropertyFlags> preferred = { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT };
+	if (lazy) {
+		preferred.insert(preferred.begin(), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+	}
+
+	for (auto properties : preferred) {
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+			if ((typeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+				return i;
+			}
+		}
+	}
+
+	std::cout << "ERROR::RenderGraph::FindMemoryType::NoSuitableMemoryType" << std::endl;
+	exit(-1);
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <functional>
+
+#include "Allocator.h"
+#include "Profiler.h"
+
+/*
+
+Render graph for the frame
+Passes are declared once with the images they use and how, then recorded every frame in the order they were added.
+In front of each pass the graph works out what its uses need from the last use of each image (layout, stages, pending
+writes) and puts all of the pass' barriers into one vkCmdPipelineBarrier. Reads following reads in the same layout
+don't get a barrier at all. Image state carries over from one frame to the next, frames are recorded in the order they
+are submitted to the one queue so the first use in a frame waits on the last use in the frame before
+
+Transient images only hold anything during the frame and are created by the graph. Images only ever used as
+attachments get TRANSIENT_ATTACHMENT usage and lazily allocated memory where the device has it, on tiling GPUs they
+then never need real memory. Transients that are never used by the same range of passes are placed at the same memory,
+the first pass to use one waits on whatever last used the memory under it
+
+*/
+
+// How a pass uses an image, each maps to the layout, stages and accesses used for its barriers
+enum class ImageUse {
+	ColorAttachment,
+	DepthAttachment,
+	Sampled,
+	TransferSrc,
+	TransferDst,
+	Present
+};
+
+struct TransientImageDesc {
+	VkFormat format;
+	VkExtent2D extent;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+
+	// Usage beyond what the passes' uses imply, usually none
+	VkImageUsageFlags usage = 0;
+};
+
+// Everything the graph created, handed back by Reset so it can be destroyed once the frames using it have completed
+struct RenderGraphResources {
+	std::vector<VkImage> images;
+	std::vector<VkImageView> views;
+	std::vector<Allocation> memory;
+};
+
+class RenderGraph {
+public:
+	void Init(VkPhysicalDevice, VkDevice, Allocator*);
+
+	// Forgets every pass and image so the graph can be built again
+	RenderGraphResources Reset();
+	void DestroyResources(RenderGraphResources&);
+
+	// An image created elsewhere. SetImage swaps in the one to use for the coming frames (a swapchain image), its
+	// contents are discarded and its first use waits on availableStage, the stage its aquire semaphore is waited at
+	uint32_t ImportImage(VkImageAspectFlags aspect);
+	void SetImage(uint32_t image, VkImage, VkPipelineStageFlags availableStage);
+
+	uint32_t CreateTransient(const TransientImageDesc&);
+
+	// Passes are recorded in the order they are added, a pass with no record function only moves its images on
+	// (to be presented for example)
+	uint32_t AddPass(const char* name, const std::vector<std::pair<uint32_t, ImageUse>>& uses, std::function<void(VkCommandBuffer)> record = nullptr);
+
+	// Creates the transients and their views, must be called after every pass has been added
+	void Compile();
+
+	void Execute(VkCommandBuffer, Profiler&);
+
+	VkImage GetImage(uint32_t image) { return _images[image].image; }
+	VkImageView GetView(uint32_t image) { return _images[image].view; }
+
+private:
+	struct UseInfo {
+		VkImageLayout layout;
+		VkPipelineStageFlags stages;
+		VkAccessFlags access;
+		VkAccessFlags writeAccess;
+		VkImageUsageFlags usage;
+	};
+
+	// Stages that last used some memory and the writes not yet made available, shared by images aliasing it
+	struct MemoryState {
+		VkPipelineStageFlags stages = 0;
+		VkAccessFlags writeAccess = 0;
+	};
+
+	struct Image {
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		uint32_t memoryState = 0;
+
+		// Transients are discarded at their first pass every frame, imported images after SetImage
+		bool transient = false;
+		bool discard = true;
+		TransientImageDesc desc{};
+		VkImageUsageFlags usage = 0;
+		uint32_t firstPass = UINT32_MAX;
+		uint32_t lastPass = 0;
+	};
+
+	struct Pass {
+		const char* name;
+		std::vector<std::pair<uint32_t, ImageUse>> uses;
+		std::function<void(VkCommandBuffer)> record;
+	};
+
+	VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+	VkDevice _device = VK_NULL_HANDLE;
+	Allocator* _allocator = nullptr;
+
+	std::vector<Image> _images;
+	std::vector<MemoryState> _memoryStates;
+	std::vector<Pass> _passes;
+	RenderGraphResources _resources;
+
+	static UseInfo _GetUseInfo(ImageUse);
+	uint32_t _FindMemoryType(uint32_t typeBits, bool lazy);
+};
@@ -2,6 +2,10 @@
 
 #include <optional>
 #include <array>
+#include <string>
+
+#include "shaders/DrawConstants.h"
+#include "shaders/SpecializationConstants.h"
 
 /*
 
@@ -11,6 +15,101 @@ These are typically used in setup for validation
 */
 
 
+// Trade offs between input latency, throughput and power when presenting
+//   LowLatency  one frame in flight and the image is aquired after the frame's CPU work, MAILBOX then IMMEDIATE then FIFO
+//   Throughput  three frames in flight, MAILBOX then FIFO
+//   PowerSave   two frames in flight, FIFO, and frames are paced by sleeping to frameRateLimit (30 if that is 0)
+enum class PresentProfile {
+	LowLatency,
+	Throughput,
+	PowerSave
+};
+
+// Anti-aliasing tiers, cheapest first. MSAA is capped to what the device supports and runs without sample shading so
+// only triangle edges cost extra. FXAA renders single sampled and filters edges in one post process pass that also
+// does the upscale
+enum class AntiAliasing {
+	Off,
+	MSAA2,
+	MSAA4,
+	FXAA
+};
+
+// Options used to configure the renderer when it is constructed
+struct RendererSettings {
+
+	// When headless no window or surface is created, frames are rendered into a device owned image instead
+	bool headless = false;
+
+	// Size of the window, or of the offscreen target when headless
+	uint32_t width = 800;
+	uint32_t height = 600;
+
+	// Number of frames to render before returning, 0 runs until the window is closed (headless always renders at least one)
+	uint32_t frameCount = 0;
+
+	// Threads used to record draw commands, 0 picks one less than the number of hardware threads
+	uint32_t workerThreads = 0;
+
+	// Number of objects in the scene, more than one are spread out over a grid
+	uint32_t objectCount = 1;
+
+	// Sample textures out of one descriptor indexed array when the device supports it, rather than a set per texture
+	bool bindless = true;
+
+	// Shader options of the scene's pipeline variant, see PipelineVariant
+	bool texturing = true;
+	bool vertexColour = true;
+
+	// Cooked mesh drawn by every object, see MeshFile.h for the format
+	std::string meshPath = "shaders/quads.mesh";
+
+	// KTX2 texture sampled by every object, BC1/BC3/BC7 or RGBA8 with the mip chain already in the file
+	std::string texturePath = "shaders/texture.ktx2";
+
+	// Enables the validation layers when they are installed, they distort timings so benchmarks turn them off
+	bool validation = true;
+
+	// Chrome trace JSON of the CPU and GPU zones is written here on exit, empty disables the profiler
+	std::string profilePath;
+
+	AntiAliasing antiAliasing = AntiAliasing::MSAA4;
+
+	// Render the scene at a fraction of the output resolution picked to keep the GPU frame time within gpuFrameBudget
+	// milliseconds, never going below minResolutionScale of the width and height. See DynamicResolution.h
+	bool dynamicResolution = false;
+	float gpuFrameBudget = 16.0f;
+	float minResolutionScale = 0.5f;
+
+	// How frames are queued and presented, see PresentProfile. Any profile can be capped to frameRateLimit, 0 doesn't limit
+	PresentProfile presentProfile = PresentProfile::Throughput;
+	uint32_t frameRateLimit = 0;
+};
+
+// Everything a graphics pipeline variant is built from. The shader options are specialization constants
+// (shaders/SpecializationConstants.h) and the rest is fixed function state, variants with the same key share a pipeline
+struct PipelineVariant {
+	bool texturing = true;
+	bool vertexColour = true;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	bool sampleShading = false;
+
+	uint64_t Key() const {
+		return static_cast<uint64_t>(texturing) | static_cast<uint64_t>(vertexColour) << 1 | static_cast<uint64_t>(sampleShading) << 2
+			| static_cast<uint64_t>(samples) << 8;
+	}
+};
+
+// Command pool owned by one recording thread for one frame in flight, reset as a whole at the start of the frame
+// Aligned so neighbouring workers don't write to the same cache line
+struct alignas(64) WorkerCommands {
+	VkCommandPool pool = VK_NULL_HANDLE;
+
+	// Secondary command buffers allocated so far, the first used of them have been handed out this frame
+	std::vector<VkCommandBuffer> buffers;
+	uint32_t used = 0;
+};
+
 // Struct containting the indices of the queue families
 struct QueueFamilyIndices {
 
@@ -18,6 +117,9 @@ struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
 
+	// Family used for uploads, a transfer only family if the device has one otherwise the graphics family
+	std::optional<uint32_t> transferFamily;
+
 	// Check to see if the queue family is complete
 	bool IsComplete() {
 		return graphicsFamily.has_value() && presentFamily.has_value();
@@ -31,10 +133,11 @@ struct PhysicalDeviceSurface {
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
+// Interleaved vertex as stored in cooked mesh files and the vertex buffer, plain floats so the layout doesn't depend on GLM's alignment settings
 struct Vertex {
-	glm::vec3 position;
-	glm::vec3 colour;
-	glm::vec2 texCoord;
+	float position[3];
+	float colour[3];
+	float texCoord[2];
 
 	static VkVertexInputBindingDescription getBindingDescription() {
 		VkVertexInputBindingDescription input_binding_description{};
@@ -66,10 +169,44 @@ struct Vertex {
 		return input_attribute_description;
 	}
 };
+static_assert(sizeof(Vertex) == 32, "Vertex must match the stride of cooked mesh files");
+
+// An object drawn by the renderer, every object is one instance in the instance buffer and its transform lives in the scene
+struct RenderObject {
+	uint32_t materialIndex = 0;
+};
 
-// Temporary structure to hold the MVP matricies
-struct UniformBufferObject {
-	alignas(16) glm::mat4 model;
-	alignas(16) glm::mat4 view;
-	alignas(16) glm::mat4 proj;
-};
\ No newline at end of file
+// Per instance data read by the vertex shader through gl_InstanceIndex, matches InstanceData in shader.vert (std430)
+struct InstanceData {
+	alignas(16) glm::mat4 modelViewProj;
+	uint32_t materialIndex;
+	uint32_t padding[3];
+};
+static_assert(sizeof(InstanceData) == 80, "InstanceData must match the std430 layout in shader.vert");
+
+// A mesh's buffers and draw ranges, swapped in as a whole once its upload has been acquired
+struct MeshResource {
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	Allocation vertexMemory{};
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	Allocation indexMemory{};
+	VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+	std::vector<MeshSubmesh> submeshes;
+
+	// Object space sphere around every vertex, centre in xyz and radius in w
+	glm::vec4 boundingSphere = glm::vec4(0.0f);
+
+	// The mesh can't be drawn until this batch has been acquired
+	uint64_t uploadBatch = 0;
+};
+
+// A sampled texture, swapped in as a whole once its upload has been acquired
+struct TextureResource {
+	VkImage image = VK_NULL_HANDLE;
+	Allocation memory{};
+	VkImageView view = VK_NULL_HANDLE;
+	VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+	uint32_t mipLevels = 1;
+	uint64_t uploadBatch = 0;
+	uint32_t bindlessSlot = 0;
+};
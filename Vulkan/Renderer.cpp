@@ -1,73 +1,259 @@
 ﻿#include "Renderer.h"
 
-// For importing images
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image/stb_image.h>
-
 const char* appName = "Vulkan";
 
-Renderer::Renderer() {
-	_InitWindow();
-	_InitInstance();
-	if (_enableDebug) {
-		_InitDebugMessanger();
+Renderer::Renderer(const RendererSettings& settings) : _settings(settings) {
+	_width = _settings.width;
+	_height = _settings.height;
+	_enableDebug = _settings.validation;
+	_pipelineVariant.texturing = _settings.texturing;
+	_pipelineVariant.vertexColour = _settings.vertexColour;
+
+	// Frames in flight and the frame rate limit come from the present profile, the present mode is picked with the swapchain
+	switch (_settings.presentProfile) {
+	case PresentProfile::LowLatency:
+		_max_frames_in_flight = 1;
+		break;
+	case PresentProfile::Throughput:
+		_max_frames_in_flight = 3;
+		break;
+	case PresentProfile::PowerSave:
+		_max_frames_in_flight = 2;
+		break;
+	}
+	uint32_t frameRateLimit = _settings.frameRateLimit;
+	if (_settings.presentProfile == PresentProfile::PowerSave && frameRateLimit == 0) {
+		frameRateLimit = 30;
+	}
+	if (frameRateLimit) {
+		_frameInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / frameRateLimit));
+	}
+
+	// Profiling is only on when there is somewhere to write the trace
+	_profiler.Init(!_settings.profilePath.empty());
+	_profiler.BeginZone("Startup");
+	auto startupStart = std::chrono::steady_clock::now();
+
+	// Without a surface there is nothing to present to so the swapchain extension is not needed
+	if (_settings.headless) {
+		_requiredDeviceExtensions.erase(std::remove_if(_requiredDeviceExtensions.begin(), _requiredDeviceExtensions.end(), [](const char* extension) {
+			return !strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+		}), _requiredDeviceExtensions.end());
+	} else {
+		_InitWindow();
+	}
+
+	// Objects are laid out on a square grid shrunk to fit the view, a single object stays where it was
+	uint32_t objectCount = std::max(_settings.objectCount, 1u);
+	uint32_t gridSide = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(objectCount))));
+	float cellSize = 2.0f / gridSide;
+	_renderObjects.resize(objectCount);
+	_scene.Reserve(objectCount);
+	for (uint32_t i = 0; i < objectCount; i++) {
+		_scene.Add();
+		if (objectCount > 1) {
+			_scene.SetPosition(i, (i % gridSide + 0.5f) * cellSize - 1.0f, (i / gridSide + 0.5f) * cellSize - 1.0f, 0.0f);
+			_scene.SetScale(i, cellSize * 0.5f, cellSize * 0.5f, cellSize * 0.5f);
+		}
 	}
-	_CreateSurface();
-	_InitPhysicalDevice();
-	_InitDevice();
-	_CreateCommandPool();
 
-	_CreateTextureImage();
-	_CreateTextureImageView();
-	_CreateTextureSampler();
-	_CreateVertexBuffer();
-	_CreateIndexBuffer();
-	_CreateDescriptorSetLayout();
+	// Leave the main thread free to submit while the workers record
+	uint32_t workerThreads = _settings.workerThreads;
+	if (workerThreads == 0) {
+		workerThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	}
+	_threadPool.Init(workerThreads);
+	_assetLoader.Init(workerThreads);
 
-	_InitSwapChain();
-	_CreateImageViews();
-	_CreateRenderPass();
-	_CreateGraphicsPipeline();
-	_CreateColourResources();
-	_CreateDepthResources();
-	_CreateFramebuffers();
-	_CreateUniformBuffers();
-	_CreateDescriptorPool();
-	_CreateDescriptorSets();
-	_CreateCommandBuffers();
+	// The rest of initialisation runs as a dependency graph on the workers, each stage starts once the stages it lists
+	// are done. File reads and the asset loads overlap instance and device creation, the pipeline compiles alongside
+	// the attachments, buffers and descriptors
+	TaskGraph init;
+	uint32_t shaderCode = _AddStartupStage(init, "LoadShaderCode", [this]() { _LoadShaderCode(); });
+	uint32_t assetFiles = _AddStartupStage(init, "OpenAssetFiles", [this]() { _OpenAssetFiles(); });
+
+	uint32_t instance = _AddStartupStage(init, "InitInstance", [this]() { _InitInstance(); });
+	std::vector<uint32_t> instanceStages = { instance };
+	instanceStages.push_back(_AddStartupStage(init, "InitDebugMessanger", [this]() {
+		// Turned off in _InitInstance if the layers aren't installed
+		if (_enableDebug) {
+			_InitDebugMessanger();
+		}
+	}, { instance }));
+	if (!_settings.headless) {
+		instanceStages.push_back(_AddStartupStage(init, "CreateSurface", [this]() { _CreateSurface(); }, { instance }));
+	}
+
+	uint32_t physicalDevice = _AddStartupStage(init, "InitPhysicalDevice", [this]() { _InitPhysicalDevice(); }, instanceStages);
+	uint32_t pipelineCacheFile = _AddStartupStage(init, "LoadPipelineCache", [this]() {
+		// Seed the pipeline cache from the last run so pipeline creation skips the driver's shader compile
+		_pipelineCache.Load(_physicalDevice, "pipeline_cache.bin");
+	}, { physicalDevice });
+	// The device waits on the shaders since bindless textures are only used if their shader has been compiled
+	uint32_t device = _AddStartupStage(init, "InitDevice", [this]() { _InitDevice(); }, { physicalDevice, shaderCode });
+	uint32_t pipelineCache = _AddStartupStage(init, "CreatePipelineCache", [this]() { _pipelineCache.Init(_device); }, { device, pipelineCacheFile });
+
+	// The real assets are read and uploaded in the background and swapped in when they are ready
+	_AddStartupStage(init, "LoadAssetsAsync", [this]() { _LoadAssetsAsync(); }, { device, assetFiles });
+
+	// Tiny stand ins are uploaded straight away so the first frames have something to draw with
+	uint32_t placeholders = _AddStartupStage(init, "CreatePlaceholderAssets", [this]() { _CreatePlaceholderAssets(); }, { device });
+	uint32_t sampler = _AddStartupStage(init, "CreateTextureSampler", [this]() { _CreateTextureSampler(); }, { device });
+	uint32_t descriptorSetLayout = _AddStartupStage(init, "CreateDescriptorSetLayout", [this]() { _CreateDescriptorSetLayout(); }, { device });
+
+	uint32_t target;
+	if (_settings.headless) {
+		target = _AddStartupStage(init, "InitOffscreenTarget", [this]() { _InitOffscreenTarget(); }, { device });
+	} else {
+		target = _AddStartupStage(init, "InitSwapChain", [this]() { _InitSwapChain(); }, { device });
+	}
+	uint32_t imageViews = _AddStartupStage(init, "CreateImageViews", [this]() { _CreateImageViews(); }, { target });
+	uint32_t renderPass = _AddStartupStage(init, "CreateRenderPass", [this]() { _CreateRenderPass(); }, { target });
+	_AddStartupStage(init, "CreateGraphicsPipeline", [this]() { _CreateGraphicsPipeline(); }, { renderPass, descriptorSetLayout, shaderCode, pipelineCache });
+	uint32_t renderGraph = _AddStartupStage(init, "BuildRenderGraph", [this]() { _BuildRenderGraph(); }, { target });
+	_AddStartupStage(init, "CreateFramebuffers", [this]() { _CreateFramebuffers(); }, { renderPass, renderGraph });
+
+	// The FXAA stages only do anything if _InitDevice turned it on
+	uint32_t postProcess = _AddStartupStage(init, "CreatePostProcess", [this]() {
+		if (_fxaa) {
+			_CreatePostProcess();
+		}
+	}, { device });
+	uint32_t postProcessPipeline = _AddStartupStage(init, "CreatePostProcessPipeline", [this]() {
+		if (_fxaa) {
+			_CreatePostProcessPipeline();
+		}
+	}, { target, postProcess, shaderCode, pipelineCache });
+	_AddStartupStage(init, "CreatePostProcessTargets", [this]() {
+		if (_fxaa) {
+			_CreatePostProcessTargets();
+		}
+	}, { imageViews, renderGraph, postProcessPipeline });
+
+	uint32_t instanceBuffers = _AddStartupStage(init, "CreateInstanceBuffers", [this]() { _CreateInstanceBuffers(); }, { device });
+	uint32_t descriptorPool = _AddStartupStage(init, "CreateDescriptorPool", [this]() { _CreateDescriptorPool(); }, { device });
+	_AddStartupStage(init, "CreateDescriptorSets", [this]() {
+		_CreateDescriptorSets();
+		if (_bindless) {
+			_CreateBindlessSet();
+		}
+	}, { descriptorPool, descriptorSetLayout, instanceBuffers, placeholders, sampler });
+
+	uint32_t commandPool = _AddStartupStage(init, "CreateCommandPool", [this]() { _CreateCommandPool(); }, { device });
+	_AddStartupStage(init, "CreateCommandBuffers", [this]() { _CreateCommandBuffers(); }, { commandPool });
+	// Sizes _imageFrames to the swapchain (or offscreen) images so has to wait for the target
+	_AddStartupStage(init, "CreateSyncObjects", [this]() { _CreateSyncObjects(); }, { device, target });
+
+	init.Run(_threadPool);
 
-	_CreateSyncObjects();
+	// Everything queued above goes to the transfer queue as one batch
+	_uploadQueue.Flush();
+
+	// Headless output should not depend on how fast the loads and uploads finish so wait for them before the first frame
+	if (_settings.headless) {
+		_assetLoader.WaitIdle();
+		_InstallLoadedAssets(true);
+		_uploadQueue.Flush();
+		_uploadQueue.WaitIdle();
+	}
+	_startupTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count();
+	_profiler.EndZone();
 	
 	_MainLoop();
 }
 
 Renderer::~Renderer() {
+	// Stop the background loads before anything they use goes away, and let the uploads they queued finish
+	_assetLoader.Destroy();
+	_uploadQueue.WaitIdle();
+
+	// Loads dropped by the asset loader never closed their files
+	_meshFile.Close();
+	_textureFile.Close();
+
+	// The device is idle by now so everything retired can go
+	_DestroyRetiredResources(UINT64_MAX);
+
 	_DeconstructSwapChain();
 
+	// Destory the pipelines, pipeline layout and the render pass objects
+	_DestroyPipelines();
+	vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+	vkDestroyRenderPass(_device, _renderPass, nullptr);
+
+	// Everything here is null unless FXAA was used, the pool frees the set
+	vkDestroyPipeline(_device, _postPipeline, nullptr);
+	vkDestroyRenderPass(_device, _postRenderPass, nullptr);
+	vkDestroyPipelineLayout(_device, _postPipelineLayout, nullptr);
+	vkDestroyDescriptorPool(_device, _postPool, nullptr);
+	vkDestroyDescriptorSetLayout(_device, _postSetLayout, nullptr);
+	vkDestroySampler(_device, _postSampler, nullptr);
+
+	// Cleanup the mesh and texture, including any loaded ones that never got swapped in
 	vkDestroySampler(_device, _textureSampler, nullptr);
-	vkDestroyImageView(_device, _textureImageView, nullptr);
+	_DestroyTexture(_texture);
+	_DestroyMesh(_mesh);
+	for (auto& texture : _loadedTextures) {
+		_DestroyTexture(texture);
+	}
+	for (auto& mesh : _loadedMeshes) {
+		_DestroyMesh(mesh);
+	}
+
+	// Cleanup the descriptor sets
+	vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
 
-	vkDestroyImage(_device, _textureImage, nullptr);
-	vkFreeMemory(_device, _textureImageMemory, nullptr);
+	// Cleanup the instance and indirect command buffers
+	vkDestroyBuffer(_device, _instanceBuffer, nullptr);
+	_allocator.Free(_instanceMemory);
+	vkDestroyBuffer(_device, _indirectBuffer, nullptr);
+	_allocator.Free(_indirectMemory);
 
 	// Cleanup the descriptor set layout
 	vkDestroyDescriptorSetLayout(_device, _descriptorSetLayout, nullptr);
 
-	// Free the memory of the vertice and index buffers
-	vkDestroyBuffer(_device, _indexBuffer, nullptr);
-	vkFreeMemory(_device, _indexBufferMemory, nullptr);
-	vkDestroyBuffer(_device, _vertexBuffer, nullptr);
-	vkFreeMemory(_device, _vertexBufferMemory, nullptr);
+	// The bindless set is freed with its pool
+	if (_bindless) {
+		vkDestroyDescriptorPool(_device, _bindlessPool, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _bindlessSetLayout, nullptr);
+	}
 
 	// Cleanup syncronisation objects
 	for (size_t i = 0; i < _max_frames_in_flight; i++) {
 		vkDestroySemaphore(_device, _renderFinishedSemaphores[i], nullptr);
 		vkDestroySemaphore(_device, _imageAvailableSemaphores[i], nullptr);
-		vkDestroyFence(_device, _inFlightFences[i], nullptr);
 	}
+	vkDestroySemaphore(_device, _frameTimeline, nullptr);
 
-	// Cleanup the command pool
+	// Cleanup the command pools, the workers' secondary command buffers go with them
 	vkDestroyCommandPool(_device, _commandPool, nullptr);
+	for (auto& frameCommands : _workerCommands) {
+		for (auto& commands : frameCommands) {
+			vkDestroyCommandPool(_device, commands.pool, nullptr);
+		}
+	}
+	_threadPool.Destroy();
+
+	// Cleanup the upload queue and its staging memory
+	_uploadQueue.Destroy();
+	_mipGenerator.Destroy();
+
+	// Write the pipeline cache out for the next run
+	_pipelineCache.PrintStats();
+	_pipelineCache.Destroy();
+
+	// Read back the last frames' GPU zones and write the trace
+	_dynamicResolution.Destroy();
+	_profiler.Destroy();
+	if (_profiler.IsEnabled()) {
+		_profiler.WriteChromeTrace(_settings.profilePath);
+	}
+
+	// All memory blocks are released at once, everything sub allocated from them has been destroyed above
+	if (_enableDebug) {
+		_allocator.PrintStats();
+	}
+	_allocator.Destroy();
 
 	// Cleanup the device
 	vkDestroyDevice(_device, nullptr);
@@ -93,15 +279,19 @@ Renderer::~Renderer() {
 	}
 
 	// Now cleanup the surface
-	vkDestroySurfaceKHR(_instance, _surface, nullptr);
+	if (_surface != nullptr) {
+		vkDestroySurfaceKHR(_instance, _surface, nullptr);
+	}
 
 	// Cleanup the Vulkan instance
 	vkDestroyInstance(_instance, nullptr);
 	_instance = nullptr;
 
 	// Cleaup the window
-	glfwDestroyWindow(_window);
-	glfwTerminate();
+	if (_window != nullptr) {
+		glfwDestroyWindow(_window);
+		glfwTerminate();
+	}
 }
 
 // Notify the rest of the program when the framebuffer size has changed
@@ -110,6 +300,7 @@ void Renderer::_WindowResized(GLFWwindow* window, int width, int height) {
 	// Need to aquire pointer to class as this is a static member
 	Renderer* renderer = (Renderer*)glfwGetWindowUserPointer(window);
 	renderer->_framebufferResize = true;
+	renderer->_framebufferSize = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
 }
 
 void Renderer::_InitWindow() {
@@ -120,13 +311,21 @@ void Renderer::_InitWindow() {
 	// Set the pointer to the current class and set the window size change callback
 	glfwSetWindowUserPointer(_window, this);
 	glfwSetFramebufferSizeCallback(_window, _WindowResized);
+
+	// The swapchain is created on a worker and glfw only allows this on the main thread, so it is read here
+	int width, height;
+	glfwGetFramebufferSize(_window, &width, &height);
+	_framebufferSize = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
 }
 
 
 void Renderer::_InitInstance() {
+	ProfileScope scope(_profiler, "InitInstance");
 	// First check to see if validation layers are required and supported
+	// Render nodes typically do not have the SDK installed so carry on without them
 	if (_enableDebug && !_CheckValidationLayerSupport()) {
 		std::cout << "ERROR::Renderer::InitInstance::ValidationLayersRequestedButNotSupported" << std::endl;
+		_enableDebug = false;
 	}
 
 	VkApplicationInfo application_info = {};
@@ -135,6 +334,7 @@ void Renderer::_InitInstance() {
 	application_info.pApplicationName		= appName;
 	application_info.engineVersion			= VK_MAKE_VERSION(1, 0, 0);
 	application_info.pEngineName			= "Geton Engine";
+	application_info.apiVersion				= VK_API_VERSION_1_1; // For vkGetPhysicalDeviceFeatures2
 
 	// Get a list of all the required extensions
 	std::vector<const char*> extensions = _GetRequiredExtensions();
@@ -159,13 +359,15 @@ void Renderer::_InitInstance() {
 
 std::vector<const char*> Renderer::_GetRequiredExtensions() {
 
-	// Get the extensions needed to interface with GLFW
-	uint32_t glfwCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwCount);
+	std::vector<const char*> extensions;
 
-	// Create a vector with all of the extensions
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwCount);
+	// Get the extensions needed to interface with GLFW, not needed when there is no window
+	if (!_settings.headless) {
+		uint32_t glfwCount = 0;
+		const char** glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwCount);
+		extensions.assign(glfwExtensions, glfwExtensions + glfwCount);
+	}
 
 	// If validation layers are enabled add the debug messanger extension
 	if (_enableDebug) {
@@ -219,6 +421,7 @@ void Renderer::_CreateSurface() {
 }
 
 void Renderer::_InitPhysicalDevice() {
+	ProfileScope scope(_profiler, "InitPhysicalDevice");
 
 	// First of all get the number of physical devices
 	uint32_t deviceCount;
@@ -260,8 +463,15 @@ void Renderer::_InitPhysicalDevice() {
 	// If it is make it the current physical device
 	_physicalDevice = currentDevice;
 
-	// Get the maximum MSAA Sample count
-	_msaaSamples = _GetMaxUsableSampleCount();
+	// MSAA tiers ask for a sample count and get the closest the device can do, FXAA and off render single sampled
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	if (_settings.antiAliasing == AntiAliasing::MSAA2) {
+		samples = VK_SAMPLE_COUNT_2_BIT;
+	} else if (_settings.antiAliasing == AntiAliasing::MSAA4) {
+		samples = VK_SAMPLE_COUNT_4_BIT;
+	}
+	_msaaSamples = _GetUsableSampleCount(samples);
+	_pipelineVariant.samples = _msaaSamples;
 }
 
 int Renderer::_RatePhysicalDevice(VkPhysicalDevice device) {
@@ -281,8 +491,9 @@ int Renderer::_RatePhysicalDevice(VkPhysicalDevice device) {
 
 	// Get the capabilities of the swapchain in the device
 	// Only do this if it is known that the device extentions are supported (it contains the swapchain extension)
-	bool swapChainGood = false;
-	if (deviceExtensionsSupported) {
+	// When headless there is no surface so any device that can render is good enough
+	bool swapChainGood = _settings.headless;
+	if (deviceExtensionsSupported && !_settings.headless) {
 		// Bare minimum requirements for now
 		PhysicalDeviceSurface swapChainSupport = _GetSwapChainCapabilities(device);
 		swapChainGood = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -344,8 +555,13 @@ QueueFamilyIndices Renderer::_FindQueueFamilies(VkPhysicalDevice device) {
 		}
 
 		// Check that the queue family supports presentation to a surface
+		// Headless rendering never presents so the graphics family stands in for the present family
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, index, _surface, &presentSupport);
+		if (_settings.headless) {
+			presentSupport = indices.graphicsFamily.has_value() && indices.graphicsFamily.value() == index;
+		} else {
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, index, _surface, &presentSupport);
+		}
 		if (presentSupport) {
 			indices.presentFamily = index;
 		}
@@ -358,6 +574,26 @@ QueueFamilyIndices Renderer::_FindQueueFamilies(VkPhysicalDevice device) {
 		index++;
 	}
 
+	// Prefer a transfer only family (the DMA engines on discrete cards), then any family without graphics, then fall back to graphics
+	// Graphics and compute families always support transfers even if they don't report the bit
+	int bestScore = -1;
+	for (uint32_t i = 0; i < queueFamilyCount; i++) {
+		VkQueueFlags flags = queueFamilies[i].queueFlags;
+		int score = -1;
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			score = 2;
+		} else if ((flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+			score = 1;
+		} else if (indices.graphicsFamily.has_value() && indices.graphicsFamily.value() == i) {
+			score = 0;
+		}
+
+		if (score > bestScore) {
+			indices.transferFamily = i;
+			bestScore = score;
+		}
+	}
+
 	return indices;
 }
 
@@ -410,12 +646,13 @@ PhysicalDeviceSurface Renderer::_GetSwapChainCapabilities(VkPhysicalDevice devic
 
 
 void Renderer::_InitDevice() {
+	ProfileScope scope(_profiler, "InitDevice");
 	// Initalisation of the logical device
 	// Get the families supported by the device
 	QueueFamilyIndices indices = _FindQueueFamilies(_physicalDevice);
 
 	// Create a unique list of the queue family's indices
-	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value(), indices.transferFamily.value() };
 
 	// Create a vector of structs to add to the device create info struct
 	float queuePriority = 1.0f;
@@ -430,17 +667,111 @@ void Renderer::_InitDevice() {
 		device_queue_create_infos.push_back(device_queue_create_info);
 	}
 
+	// Optional extensions are enabled on top of the required ones if the device has them
+	std::vector<const char*> enabledExtensions = _requiredDeviceExtensions;
+	bool descriptorIndexingAvailable = false;
+	bool maintenance3Available = false;
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(_physicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(_physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+	for (auto& extension : availableExtensions) {
+		if (!strcmp(extension.extensionName, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)) {
+			enabledExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+			_creationFeedbackSupported = true;
+		}
+		if (!strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+			enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		}
+		if (!strcmp(extension.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+			descriptorIndexingAvailable = true;
+		}
+		if (!strcmp(extension.extensionName, VK_KHR_MAINTENANCE3_EXTENSION_NAME)) {
+			maintenance3Available = true;
+		}
+	}
+
+	// FXAA falls back to no anti-aliasing if its shaders haven't been compiled
+	_fxaa = _settings.antiAliasing == AntiAliasing::FXAA && !_fullscreenShaderCode.empty() && !_fxaaShaderCode.empty();
+	if (_settings.antiAliasing == AntiAliasing::FXAA && !_fxaa) {
+		std::cout << "Renderer: FXAA shaders are missing, rendering without anti-aliasing" << std::endl;
+	}
+
+	// Bindless textures need a runtime sized, partially bound array that can be written while it's bound
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptor_indexing_features{};
+	descriptor_indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(_physicalDevice, &deviceProperties);
+	if (_settings.bindless && descriptorIndexingAvailable && maintenance3Available && deviceProperties.apiVersion >= VK_API_VERSION_1_1 && !_fragBindlessShaderCode.empty()) {
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &descriptor_indexing_features;
+		vkGetPhysicalDeviceFeatures2(_physicalDevice, &features2);
+
+		_bindless = descriptor_indexing_features.runtimeDescriptorArray
+			&& descriptor_indexing_features.shaderSampledImageArrayNonUniformIndexing
+			&& descriptor_indexing_features.descriptorBindingPartiallyBound
+			&& descriptor_indexing_features.descriptorBindingSampledImageUpdateAfterBind
+			&& descriptor_indexing_features.descriptorBindingUpdateUnusedWhilePending;
+	}
+
+	if (_bindless) {
+		VkPhysicalDeviceDescriptorIndexingPropertiesEXT descriptor_indexing_properties{};
+		descriptor_indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2 properties2{};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &descriptor_indexing_properties;
+		vkGetPhysicalDeviceProperties2(_physicalDevice, &properties2);
+
+		// Combined image samplers count against both the sampler and the sampled image limits
+		_maxBindlessTextures = std::min({ _maxBindlessTextures,
+			descriptor_indexing_properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+			descriptor_indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			descriptor_indexing_properties.maxDescriptorSetUpdateAfterBindSamplers,
+			descriptor_indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages });
+
+		enabledExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+		enabledExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+
+		// Only what the bindless array uses is left switched on
+		descriptor_indexing_features = {};
+		descriptor_indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		descriptor_indexing_features.runtimeDescriptorArray = VK_TRUE;
+		descriptor_indexing_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		descriptor_indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+		descriptor_indexing_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		descriptor_indexing_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	}
+
+	// Multi draw lets one call consume a whole array of indirect commands
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(_physicalDevice, &supportedFeatures);
+	_multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect;
+	_drawIndirectFirstInstanceSupported = supportedFeatures.drawIndirectFirstInstance;
+	_textureCompressionBCSupported = supportedFeatures.textureCompressionBC;
+
+	// Timeline semaphores are a required extension, every device that has it supports the feature
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_semaphore_features{};
+	timeline_semaphore_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	timeline_semaphore_features.pNext = _bindless ? &descriptor_indexing_features : nullptr;
+	timeline_semaphore_features.timelineSemaphore = VK_TRUE;
+
 	// Ensure the logical device has the required families, extensions and validation layers
 	VkPhysicalDeviceFeatures physical_device_features{};
 	physical_device_features.samplerAnisotropy = VK_TRUE;
 	physical_device_features.sampleRateShading = VK_TRUE;
+	physical_device_features.multiDrawIndirect = _multiDrawIndirectSupported;
+	physical_device_features.drawIndirectFirstInstance = _drawIndirectFirstInstanceSupported;
+	physical_device_features.textureCompressionBC = _textureCompressionBCSupported;
+	physical_device_features.shaderStorageImageWriteWithoutFormat = supportedFeatures.shaderStorageImageWriteWithoutFormat;
 	VkDeviceCreateInfo device_create_info{};
 	device_create_info.sType					= VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	device_create_info.queueCreateInfoCount		= static_cast<uint32_t>(device_queue_create_infos.size());
 	device_create_info.pQueueCreateInfos		= device_queue_create_infos.data();
 	device_create_info.pEnabledFeatures			= &physical_device_features;
-	device_create_info.enabledExtensionCount	= static_cast<uint32_t>(_requiredDeviceExtensions.size());
-	device_create_info.ppEnabledExtensionNames	= _requiredDeviceExtensions.data();
+	device_create_info.enabledExtensionCount	= static_cast<uint32_t>(enabledExtensions.size());
+	device_create_info.ppEnabledExtensionNames	= enabledExtensions.data();
+	device_create_info.pNext					= &timeline_semaphore_features;
 	if (_enableDebug) {
 		device_create_info.enabledLayerCount	= static_cast<uint32_t>(_requestedLayers.size());
 		device_create_info.ppEnabledLayerNames	= _requestedLayers.data();
@@ -456,6 +787,23 @@ void Renderer::_InitDevice() {
 	// Get the handle of the queues created in the logical device
 	vkGetDeviceQueue(_device, indices.graphicsFamily.value(), 0, &_graphicsQueue);
 	vkGetDeviceQueue(_device, indices.presentFamily.value(), 0, &_presentQueue);
+	vkGetDeviceQueue(_device, indices.transferFamily.value(), 0, &_transferQueue);
+
+	// Null if VK_KHR_draw_indirect_count is not supported
+	_vkCmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(_device, "vkCmdDrawIndexedIndirectCountKHR");
+	_vkGetSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(_device, "vkGetSemaphoreCounterValueKHR");
+	_vkWaitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(_device, "vkWaitSemaphoresKHR");
+
+	_allocator.Init(_physicalDevice, _device);
+	_renderGraph.Init(_physicalDevice, _device, &_allocator);
+	_uploadQueue.Init(_physicalDevice, _device, &_allocator, _transferQueue, indices.transferFamily.value(), indices.graphicsFamily.value());
+
+	// GPU zones are recorded into the graphics command buffers
+	_profiler.InitGpu(_physicalDevice, _device, indices.graphicsFamily.value(), _max_frames_in_flight);
+	_dynamicResolution.Init(_physicalDevice, _device, indices.graphicsFamily.value(), _max_frames_in_flight, _settings.dynamicResolution, _settings.gpuFrameBudget, _settings.minResolutionScale);
+
+	// Levels are written as storage images without a format so one shader covers every format
+	_mipGenerator.Init(_physicalDevice, _device, &_allocator, &_pipelineCache, _downsampleShaderCode, _max_frames_in_flight, supportedFeatures.shaderStorageImageWriteWithoutFormat);
 }
 
 bool Renderer::_CheckValidationLayerSupport() {
@@ -498,7 +846,8 @@ bool Renderer::_CheckValidationLayerSupport() {
 }
 
 
-void Renderer::_InitSwapChain() {
+// When recreating, oldSwapChain lets the driver reuse its resources and keeps presenting until the new one is ready
+void Renderer::_InitSwapChain(VkSwapchainKHR oldSwapChain) {
 
 	// Get the swapchain parameters
 	PhysicalDeviceSurface support = _GetSwapChainCapabilities(_physicalDevice);
@@ -506,8 +855,20 @@ void Renderer::_InitSwapChain() {
 	VkPresentModeKHR presentMode = _GetPresentMode(support.presentModes);
 	VkExtent2D extent = _GetSwapExtent(support.capabilities);
 
-	// Define the amount of images in the swapchain
+	// The scene is upscaled into the swapchain image with a blit rather than rendered to it
+	if (!(support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+		std::cout << "ERROR::Renderer::InitSwapChain::SurfaceDoesNotSupportTransferDst" << std::endl;
+		exit(-1);
+	}
+
+	// Define the amount of images in the swapchain, one more than the minimum so there's always one free to render to
+	// and enough to keep every frame in flight busy. Power save doesn't queue up more than the surface needs
 	uint32_t images = support.capabilities.minImageCount + 1;
+	if (_settings.presentProfile == PresentProfile::Throughput) {
+		images = std::max<uint32_t>(images, _max_frames_in_flight + 1);
+	} else if (_settings.presentProfile == PresentProfile::PowerSave) {
+		images = support.capabilities.minImageCount;
+	}
 	if (support.capabilities.maxImageCount > 0 && images > support.capabilities.maxImageCount) {
 		images = support.capabilities.maxImageCount;
 	}
@@ -520,7 +881,7 @@ void Renderer::_InitSwapChain() {
 	swap_chain_create_info.imageColorSpace	= surfaceFormat.colorSpace;
 	swap_chain_create_info.imageExtent		= extent;
 	swap_chain_create_info.imageArrayLayers = 1;
-	swap_chain_create_info.imageUsage		= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	swap_chain_create_info.imageUsage		= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
 	// Get the indices of the graphics family and the present family
 	QueueFamilyIndices indices = _FindQueueFamilies(_physicalDevice);
@@ -539,7 +900,7 @@ void Renderer::_InitSwapChain() {
 	swap_chain_create_info.compositeAlpha	= VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swap_chain_create_info.presentMode		= presentMode;
 	swap_chain_create_info.clipped			= VK_TRUE;
-	swap_chain_create_info.oldSwapchain		= VK_NULL_HANDLE;
+	swap_chain_create_info.oldSwapchain		= oldSwapChain;
 
 	_swapChainFormat = surfaceFormat.format;
 	_swapChainExtent = extent;
@@ -557,45 +918,48 @@ void Renderer::_InitSwapChain() {
 
 }
 
-void Renderer::_DeconstructSwapChain() {
-	vkDestroyImageView(_device, _colorImageView, nullptr);
-	vkDestroyImage(_device, _colorImage, nullptr);
-	vkFreeMemory(_device, _colorImageMemory, nullptr);
+// Creates a device owned image that stands in for the swapchain when rendering headless
+void Renderer::_InitOffscreenTarget() {
 
-	// Destroy the depth buffer images
-	vkDestroyImageView(_device, _depthImageView, nullptr);
-	vkDestroyImage(_device, _depthImage, nullptr);
-	vkFreeMemory(_device, _depthImageMemory, nullptr);
+	// Prefer the same RGBA ordering as the readback so no swizzle is needed, the scene is rendered in the same format
+	// and blitted into it
+	VkFormat format = _FindSupportedFormat(
+		{ VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_UNORM },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT
+	);
 
-	// Destroy all uniform buffer objects
-	for (size_t i = 0; i < _swapChainImages.size(); i++) {
-		vkDestroyBuffer(_device, _uniformBuffers[i], nullptr);
-		vkFreeMemory(_device, _uniformBuffersMemory[i], nullptr);
-	}
+	_swapChainFormat = format;
+	_swapChainExtent = { _width, _height };
 
-	// Destroy the current descriptor pool
-	vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+	// The image is upscaled into and copied out of for readback
+	_swapChainImages.resize(1);
+	_CreateImage(_width, _height, 1, VK_SAMPLE_COUNT_1_BIT, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _swapChainImages[0], _offscreenImageMemory);
+}
 
-	// Destroy all the framebuffers
-	for (auto framebuffer : _framebuffers) {
-		vkDestroyFramebuffer(_device, framebuffer, nullptr);
-	}
+void Renderer::_DeconstructSwapChain() {
 
-	// Free command buffers and pools
-	vkFreeCommandBuffers(_device, _commandPool, static_cast<uint32_t>(_commandBuffers.size()), _commandBuffers.data());
+	// The colour, depth and scene images all belong to the render graph
+	RenderGraphResources renderGraphResources = _renderGraph.Reset();
+	_renderGraph.DestroyResources(renderGraphResources);
 
-	// Destory the pipeline, pipeline layout and the render pass objects
-	vkDestroyPipeline(_device, _pipeline, nullptr);
-	vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
-	vkDestroyRenderPass(_device, _renderPass, nullptr);
+	vkDestroyFramebuffer(_device, _framebuffer, nullptr);
+	for (auto framebuffer : _postFramebuffers) {
+		vkDestroyFramebuffer(_device, framebuffer, nullptr);
+	}
 
 	// Loop to destroy each image view from the vector member
 	for (auto& view : _swapChainImageViews) {
 		vkDestroyImageView(_device, view, nullptr);
 	}
 
-	// Cleaup the current swapchain
-	vkDestroySwapchainKHR(_device, _swapChain, nullptr);
+	// Cleaup the current swapchain, or the image standing in for it
+	if (_settings.headless) {
+		vkDestroyImage(_device, _swapChainImages[0], nullptr);
+		_allocator.Free(_offscreenImageMemory);
+	} else {
+		vkDestroySwapchainKHR(_device, _swapChain, nullptr);
+	}
 }
 
 void Renderer::_RecreateSwapChain() {
@@ -607,31 +971,79 @@ void Renderer::_RecreateSwapChain() {
 		glfwGetFramebufferSize(_window, &width, &height);
 		glfwWaitEvents();
 	}
+	_framebufferSize = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
 
-	// Wait on all async operations to finish
-	vkDeviceWaitIdle(_device);
+	// Frames in flight may still be rendering with the old swapchain's attachments, rather than wait for the device
+	// to go idle they are handed to the retire queue and destroyed once those frames have completed
+	VkSwapchainKHR oldSwapChain = _swapChain;
+	VkFormat oldFormat = _swapChainFormat;
+	std::vector<VkImageView> oldImageViews = _swapChainImageViews;
+	VkFramebuffer oldFramebuffer = _framebuffer;
+	RenderGraphResources oldRenderGraph = _renderGraph.Reset();
 
-	// Remove the old swapchain
-	_DeconstructSwapChain();
+	_InitSwapChain(oldSwapChain);
+
+	_RetireResource([this, oldSwapChain, oldImageViews, oldFramebuffer, oldRenderGraph]() mutable {
+		vkDestroyFramebuffer(_device, oldFramebuffer, nullptr);
+		_renderGraph.DestroyResources(oldRenderGraph);
+		for (auto view : oldImageViews) {
+			vkDestroyImageView(_device, view, nullptr);
+		}
+		vkDestroySwapchainKHR(_device, oldSwapChain, nullptr);
+	});
 
-	_InitSwapChain();
 	_CreateImageViews();
-	_CreateRenderPass();
-	_CreateGraphicsPipeline();
 
-	_CreateColourResources();
-	_CreateDepthResources();
+	// The viewport and scissor are dynamic so the pipeline only has to be rebuilt if the surface format changed
+	if (_swapChainFormat != oldFormat) {
+		VkRenderPass oldRenderPass = _renderPass;
+		std::unordered_map<uint64_t, VkPipeline> oldPipelines;
+		oldPipelines.swap(_pipelines);
+		VkPipelineLayout oldPipelineLayout = _pipelineLayout;
+		_RetireResource([this, oldRenderPass, oldPipelines, oldPipelineLayout]() {
+			for (auto& pipeline : oldPipelines) {
+				vkDestroyPipeline(_device, pipeline.second, nullptr);
+			}
+			vkDestroyPipelineLayout(_device, oldPipelineLayout, nullptr);
+			vkDestroyRenderPass(_device, oldRenderPass, nullptr);
+		});
+
+		_CreateRenderPass();
+		_CreateGraphicsPipeline();
+
+		if (_fxaa) {
+			VkRenderPass oldPostRenderPass = _postRenderPass;
+			VkPipeline oldPostPipeline = _postPipeline;
+			_RetireResource([this, oldPostRenderPass, oldPostPipeline]() {
+				vkDestroyPipeline(_device, oldPostPipeline, nullptr);
+				vkDestroyRenderPass(_device, oldPostRenderPass, nullptr);
+			});
+			_CreatePostProcessPipeline();
+		}
+	}
+
+	// The graph's images are sized to the window so it is built again, its passes are the same
+	_BuildRenderGraph();
 	_CreateFramebuffers();
-	_CreateUniformBuffers();
-	_CreateDescriptorPool();
-	_CreateDescriptorSets();
-	
-	// Cleanup the old command pool
-	vkDestroyCommandPool(_device, _commandPool, nullptr);
-	_CreateCommandPool();
 
-	_CreateCommandBuffers();
+	// The FXAA set reads the old scene image and the framebuffers write the old swapchain images
+	if (_fxaa) {
+		std::vector<VkFramebuffer> oldPostFramebuffers = _postFramebuffers;
+		VkDescriptorSet oldPostSet = _postSet;
+		_RetireResource([this, oldPostFramebuffers, oldPostSet]() {
+			for (auto framebuffer : oldPostFramebuffers) {
+				vkDestroyFramebuffer(_device, framebuffer, nullptr);
+			}
+			vkFreeDescriptorSets(_device, _postPool, 1, &oldPostSet);
+		});
+		_CreatePostProcessTargets();
+	}
+
+	// The new swapchain's images have not been used by any frame yet
+	_imageFrames.assign(_swapChainImages.size(), 0);
 
+	// The aspect ratio may have changed
+	_cameraDirty = true;
 }
 
 // Function to get the best format from a vector of surface formats
@@ -647,19 +1059,30 @@ VkSurfaceFormatKHR Renderer::_GetSurfaceFormat(std::vector<VkSurfaceFormatKHR>&
 	return avaliableFormats[0];
 }
 
-// Function to select the best presentation mode from a vector
+// Picks the present profile's preferred mode out of the ones the surface supports
 VkPresentModeKHR Renderer::_GetPresentMode(std::vector<VkPresentModeKHR>& avaliableModes) {
 
-	// For now return MAILBOX_KHR if it is avaliable
-	// mailbox is a triple buffering mode with less input lag than v-sync (double)
-	for (auto& mode : avaliableModes) {
-		if (mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-			return mode;
+	// Mailbox is a triple buffering mode with less input lag than v-sync (FIFO), immediate has no v-sync and tears
+	std::vector<VkPresentModeKHR> preferredModes;
+	switch (_settings.presentProfile) {
+	case PresentProfile::LowLatency:
+		preferredModes = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+		break;
+	case PresentProfile::Throughput:
+		preferredModes = { VK_PRESENT_MODE_MAILBOX_KHR };
+		break;
+	case PresentProfile::PowerSave:
+		break;
+	}
+
+	for (auto& preferred : preferredModes) {
+		if (std::find(avaliableModes.begin(), avaliableModes.end(), preferred) != avaliableModes.end()) {
+			return preferred;
 		}
 	}
 
-	// If mailbox not availiable just return the standard immediate (no v-sync)
-	return VK_PRESENT_MODE_IMMEDIATE_KHR;
+	// FIFO is the only mode every surface has to support
+	return VK_PRESENT_MODE_FIFO_KHR;
 }
 
 // Get the swapchain extent, this takes into account the width and height of the window
@@ -668,14 +1091,8 @@ VkExtent2D Renderer::_GetSwapExtent(VkSurfaceCapabilitiesKHR& capabilities) {
 	if (capabilities.currentExtent.width != UINT32_MAX) {
 		return capabilities.currentExtent;
 	} else {
-		// Set swapchain extent to width and height of window
-		int width, height;
-		glfwGetFramebufferSize(_window, &width, &height);
-
-		VkExtent2D extent = {
-			static_cast<uint32_t>(width),
-			static_cast<uint32_t>(height)
-		};
+		// Set swapchain extent to width and height of window, as last read on the main thread
+		VkExtent2D extent = _framebufferSize;
 
 		// Ensure it is within the bounds of the swapchain
 		extent.width = std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, extent.width));
@@ -722,12 +1139,6 @@ std::vector<char> ReadFile(const std::string& filename) {
 
 void Renderer::_CreateDescriptorSetLayout() {
 	// Every binding needs a new VkDescriptorSetLayoutBinding struct
-	VkDescriptorSetLayoutBinding ubo_layout_binding{};
-	ubo_layout_binding.binding = 0;
-	ubo_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	ubo_layout_binding.descriptorCount = 1;
-	ubo_layout_binding.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS; // Binding accessable in both shaders
-
 	VkDescriptorSetLayoutBinding sampler_layout_binding{};
 	sampler_layout_binding.binding = 1;
 	sampler_layout_binding.descriptorCount = 1;
@@ -735,7 +1146,18 @@ void Renderer::_CreateDescriptorSetLayout() {
 	sampler_layout_binding.pImmutableSamplers = nullptr;
 	sampler_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = { ubo_layout_binding, sampler_layout_binding };
+	// Instance data for every frame in flight, the pushed DrawConstants::instanceOffset selects the frame's region
+	VkDescriptorSetLayoutBinding instance_layout_binding{};
+	instance_layout_binding.binding = 2;
+	instance_layout_binding.descriptorCount = 1;
+	instance_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	instance_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	// With bindless textures the sampler moves out to its own set, see _CreateBindlessSet
+	std::vector<VkDescriptorSetLayoutBinding> bindings = { instance_layout_binding };
+	if (!_bindless) {
+		bindings.push_back(sampler_layout_binding);
+	}
 
 	VkDescriptorSetLayoutCreateInfo layout_create_info{};
 	layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -746,6 +1168,36 @@ void Renderer::_CreateDescriptorSetLayout() {
 		std::cout << "ERROR:Renderer::CreateDescriptorSetLayout::CreateDescriptorSetLayout" << std::endl;
 		exit(-1);
 	}
+
+	if (!_bindless) {
+		return;
+	}
+
+	// One array of every texture, slots are filled in as textures arrive and may be written while the set is bound.
+	// Update after bind layouts can't hold dynamic buffers which is why this is a second set
+	VkDescriptorSetLayoutBinding bindless_layout_binding{};
+	bindless_layout_binding.binding = 0;
+	bindless_layout_binding.descriptorCount = _maxBindlessTextures;
+	bindless_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindless_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorBindingFlagsEXT bindlessFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_create_info{};
+	binding_flags_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	binding_flags_create_info.bindingCount = 1;
+	binding_flags_create_info.pBindingFlags = &bindlessFlags;
+
+	VkDescriptorSetLayoutCreateInfo bindless_layout_create_info{};
+	bindless_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	bindless_layout_create_info.pNext = &binding_flags_create_info;
+	bindless_layout_create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	bindless_layout_create_info.bindingCount = 1;
+	bindless_layout_create_info.pBindings = &bindless_layout_binding;
+
+	if (vkCreateDescriptorSetLayout(_device, &bindless_layout_create_info, nullptr, &_bindlessSetLayout) != VK_SUCCESS) {
+		std::cout << "ERROR:Renderer::CreateDescriptorSetLayout::CreateBindlessSetLayout" << std::endl;
+		exit(-1);
+	}
 }
 
 void Renderer::_CreateRenderPass() {
@@ -756,7 +1208,9 @@ void Renderer::_CreateRenderPass() {
 	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	// The render graph moves every attachment into the layout it is used in and out of it after the pass, the render
+	// pass itself never changes them
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentDescription depthAttachment{};
@@ -766,7 +1220,7 @@ void Renderer::_CreateRenderPass() {
 	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentDescription colorAttachmentResolve{};
@@ -776,8 +1230,8 @@ void Renderer::_CreateRenderPass() {
 	colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentReference colorAttachmentRef{};
 	colorAttachmentRef.attachment = 0;
@@ -798,23 +1252,23 @@ void Renderer::_CreateRenderPass() {
 	subpass.pDepthStencilAttachment = &depthAttachmentRef;
 	subpass.pResolveAttachments = &colorAttachmentResolveRef;
 
-	VkSubpassDependency dependency{};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	// Single sampled there is nothing to resolve, the scene image is the colour attachment
+	std::vector<VkAttachmentDescription> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
+	if (_msaaSamples == VK_SAMPLE_COUNT_1_BIT) {
+		colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments = { colorAttachmentResolve, depthAttachment };
+		subpass.pResolveAttachments = nullptr;
+	}
 
-	std::array<VkAttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
+	// No dependencies, the barriers the render graph puts in front of the pass and after it cover the attachments
 	VkRenderPassCreateInfo render_pass_create_info{};
 	render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	render_pass_create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
 	render_pass_create_info.pAttachments = attachments.data();
 	render_pass_create_info.subpassCount = 1;
 	render_pass_create_info.pSubpasses = &subpass;
-	render_pass_create_info.dependencyCount = 1;
-	render_pass_create_info.pDependencies = &dependency;
+	render_pass_create_info.dependencyCount = 0;
+	render_pass_create_info.pDependencies = nullptr;
 
 	if (vkCreateRenderPass(_device, &render_pass_create_info, nullptr, &_renderPass) != VK_SUCCESS) {
 		std::cout << "ERROR::Renderer::CreateRenderPass::CreateRenderPass" << std::endl;
@@ -822,19 +1276,324 @@ void Renderer::_CreateRenderPass() {
 	}
 }
 
+// The SPIR-V is kept for the renderer's lifetime so pipelines recreated with the swapchain don't go back to disk
+void Renderer::_LoadShaderCode() {
+	_vertShaderCode = ReadFile("shaders/vert.spv");
+	_fragShaderCode = ReadFile("shaders/frag.spv");
+	_fragBindlessShaderCode = ReadFile("shaders/frag_bindless.spv");
+	if (_settings.antiAliasing == AntiAliasing::FXAA) {
+		_fullscreenShaderCode = ReadFile("shaders/fullscreen_vert.spv");
+		_fxaaShaderCode = ReadFile("shaders/fxaa_frag.spv");
+	}
+
+	// Mips fall back to blits without it
+	_downsampleShaderCode = ReadFile("shaders/downsample_comp.spv");
+}
+
+// Creates the pipeline layout shared by every variant then the scene's variant
 void Renderer::_CreateGraphicsPipeline() {
+	ProfileScope scope(_profiler, "CreateGraphicsPipeline");
+
+	VkPipelineLayoutCreateInfo pipeline_layout_create_info{};
+	pipeline_layout_create_info.sType					= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	// Draw constants are pushed rather than written to a buffer, see shaders/DrawConstants.h
+	VkPushConstantRange push_constant_range{};
+	push_constant_range.stageFlags	= VK_SHADER_STAGE_VERTEX_BIT;
+	push_constant_range.offset		= 0;
+	push_constant_range.size		= sizeof(DrawConstants);
+
+	VkDescriptorSetLayout setLayouts[] = { _descriptorSetLayout, _bindlessSetLayout };
+	pipeline_layout_create_info.setLayoutCount			= _bindless ? 2 : 1;
+	pipeline_layout_create_info.pSetLayouts				= setLayouts;
+	pipeline_layout_create_info.pushConstantRangeCount	= 1;
+	pipeline_layout_create_info.pPushConstantRanges		= &push_constant_range;
+
+	if (vkCreatePipelineLayout(_device, &pipeline_layout_create_info, nullptr, &_pipelineLayout) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreateGraphicsPipeline::CreatePipelineLayout" << std::endl;
+		exit(-1);
+	}
+
+	_pipeline = _GetPipeline(_pipelineVariant);
+}
+
+// Returns the pipeline for a variant, creating it the first time the variant is asked for
+VkPipeline Renderer::_GetPipeline(const PipelineVariant& variant) {
+	auto it = _pipelines.find(variant.Key());
+	if (it != _pipelines.end()) {
+		return it->second;
+	}
+
+	VkPipeline pipeline = _CreatePipelineVariant(variant);
+	_pipelines[variant.Key()] = pipeline;
+	return pipeline;
+}
 
-	// Read the code from file
-	auto vertCode = ReadFile("shaders/vert.spv");
-	auto fragCode = ReadFile("shaders/frag.spv");
+void Renderer::_DestroyPipelines() {
+	for (auto& pipeline : _pipelines) {
+		vkDestroyPipeline(_device, pipeline.second, nullptr);
+	}
+	_pipelines.clear();
+	_pipeline = VK_NULL_HANDLE;
+}
+
+// Everything FXAA needs that doesn't depend on the swapchain
+void Renderer::_CreatePostProcess() {
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.maxLod = 0.0f;
+
+	if (vkCreateSampler(_device, &samplerInfo, nullptr, &_postSampler) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreatePostProcess::CreateSampler" << std::endl;
+		exit(-1);
+	}
+
+	VkDescriptorSetLayoutBinding scene_layout_binding{};
+	scene_layout_binding.binding = 0;
+	scene_layout_binding.descriptorCount = 1;
+	scene_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	scene_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layout_create_info{};
+	layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_create_info.bindingCount = 1;
+	layout_create_info.pBindings = &scene_layout_binding;
+
+	if (vkCreateDescriptorSetLayout(_device, &layout_create_info, nullptr, &_postSetLayout) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreatePostProcess::CreateDescriptorSetLayout" << std::endl;
+		exit(-1);
+	}
+
+	// A new set is written whenever the scene image is recreated, the old one may be in use by every frame in flight
+	uint32_t maxSets = _max_frames_in_flight + 1;
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSize.descriptorCount = maxSets;
+
+	VkDescriptorPoolCreateInfo descriptor_pool_create_info{};
+	descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptor_pool_create_info.poolSizeCount = 1;
+	descriptor_pool_create_info.pPoolSizes = &poolSize;
+	descriptor_pool_create_info.maxSets = maxSets;
+	descriptor_pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+
+	if (vkCreateDescriptorPool(_device, &descriptor_pool_create_info, nullptr, &_postPool) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreatePostProcess::CreateDescriptorPool" << std::endl;
+		exit(-1);
+	}
+
+	VkPushConstantRange push_constant_range{};
+	push_constant_range.stageFlags	= VK_SHADER_STAGE_FRAGMENT_BIT;
+	push_constant_range.offset		= 0;
+	push_constant_range.size		= sizeof(PostConstants);
+
+	VkPipelineLayoutCreateInfo pipeline_layout_create_info{};
+	pipeline_layout_create_info.sType					= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_create_info.setLayoutCount			= 1;
+	pipeline_layout_create_info.pSetLayouts				= &_postSetLayout;
+	pipeline_layout_create_info.pushConstantRangeCount	= 1;
+	pipeline_layout_create_info.pPushConstantRanges		= &push_constant_range;
+
+	if (vkCreatePipelineLayout(_device, &pipeline_layout_create_info, nullptr, &_postPipelineLayout) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreatePostProcess::CreatePipelineLayout" << std::endl;
+		exit(-1);
+	}
+}
+
+// The FXAA render pass and pipeline, they depend on the swapchain format
+void Renderer::_CreatePostProcessPipeline() {
+	ProfileScope scope(_profiler, "CreatePostProcessPipeline");
+
+	// Every pixel is written so the old contents are never loaded
+	VkAttachmentDescription colorAttachment{};
+	colorAttachment.format = _swapChainFormat;
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	// The render graph moves the swapchain image in and out of the attachment layout
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference colorAttachmentRef{};
+	colorAttachmentRef.attachment = 0;
+	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorAttachmentRef;
+
+	VkRenderPassCreateInfo render_pass_create_info{};
+	render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	render_pass_create_info.attachmentCount = 1;
+	render_pass_create_info.pAttachments = &colorAttachment;
+	render_pass_create_info.subpassCount = 1;
+	render_pass_create_info.pSubpasses = &subpass;
+
+	if (vkCreateRenderPass(_device, &render_pass_create_info, nullptr, &_postRenderPass) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreatePostProcessPipeline::CreateRenderPass" << std::endl;
+		exit(-1);
+	}
+
+	VkShaderModule vertShaderModule = _GetShaderModule(_fullscreenShaderCode);
+	VkShaderModule fragShaderModule = _GetShaderModule(_fxaaShaderCode);
+
+	VkPipelineShaderStageCreateInfo shaderStages[2]{};
+	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module = vertShaderModule;
+	shaderStages[0].pName = "main";
+	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module = fragShaderModule;
+	shaderStages[1].pName = "main";
+
+	// The triangle is generated from the vertex index, there is no vertex input
+	VkPipelineVertexInputStateCreateInfo vertex_input_state_create_info{};
+	vertex_input_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly_state_create_info{};
+	input_assembly_state_create_info.sType		= VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	input_assembly_state_create_info.topology	= VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewport_state_create_info{};
+	viewport_state_create_info.sType			= VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewport_state_create_info.viewportCount	= 1;
+	viewport_state_create_info.scissorCount		= 1;
+
+	std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamic_state_create_info{};
+	dynamic_state_create_info.sType				= VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_state_create_info.dynamicStateCount	= static_cast<uint32_t>(dynamicStates.size());
+	dynamic_state_create_info.pDynamicStates	= dynamicStates.data();
+
+	VkPipelineRasterizationStateCreateInfo rasterizer_state_create_info{};
+	rasterizer_state_create_info.sType			= VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer_state_create_info.polygonMode	= VK_POLYGON_MODE_FILL;
+	rasterizer_state_create_info.lineWidth		= 1.0f;
+	rasterizer_state_create_info.cullMode		= VK_CULL_MODE_NONE;
+	rasterizer_state_create_info.frontFace		= VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+	VkPipelineMultisampleStateCreateInfo multisample_state_create_info{};
+	multisample_state_create_info.sType					= VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisample_state_create_info.rasterizationSamples	= VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState color_blend_attachment_state{};
+	color_blend_attachment_state.colorWriteMask	= VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	color_blend_attachment_state.blendEnable	= VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo color_blend_state_create_info{};
+	color_blend_state_create_info.sType				= VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	color_blend_state_create_info.attachmentCount	= 1;
+	color_blend_state_create_info.pAttachments		= &color_blend_attachment_state;
+
+	VkGraphicsPipelineCreateInfo pipeline_create_info{};
+	pipeline_create_info.sType					= VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeline_create_info.stageCount				= 2;
+	pipeline_create_info.pStages				= shaderStages;
+	pipeline_create_info.pVertexInputState		= &vertex_input_state_create_info;
+	pipeline_create_info.pInputAssemblyState	= &input_assembly_state_create_info;
+	pipeline_create_info.pViewportState			= &viewport_state_create_info;
+	pipeline_create_info.pRasterizationState	= &rasterizer_state_create_info;
+	pipeline_create_info.pMultisampleState		= &multisample_state_create_info;
+	pipeline_create_info.pColorBlendState		= &color_blend_state_create_info;
+	pipeline_create_info.pDynamicState			= &dynamic_state_create_info;
+	pipeline_create_info.layout					= _postPipelineLayout;
+	pipeline_create_info.renderPass				= _postRenderPass;
+	pipeline_create_info.subpass				= 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (vkCreateGraphicsPipelines(_device, _pipelineCache.Get(), 1, &pipeline_create_info, nullptr, &_postPipeline) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreatePostProcessPipeline::CreateGraphicsPipelines" << std::endl;
+		exit(-1);
+	}
+
+	float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+	_pipelineCache.RecordCreation("fxaa", ms, nullptr);
+
+	vkDestroyShaderModule(_device, fragShaderModule, nullptr);
+	vkDestroyShaderModule(_device, vertShaderModule, nullptr);
+}
+
+// A framebuffer per swapchain image and the set reading the current scene image
+void Renderer::_CreatePostProcessTargets() {
+	_postFramebuffers.resize(_swapChainImageViews.size());
+	for (size_t i = 0; i < _swapChainImageViews.size(); i++) {
+		VkFramebufferCreateInfo framebufferInfo{};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = _postRenderPass;
+		framebufferInfo.attachmentCount = 1;
+		framebufferInfo.pAttachments = &_swapChainImageViews[i];
+		framebufferInfo.width = _swapChainExtent.width;
+		framebufferInfo.height = _swapChainExtent.height;
+		framebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_postFramebuffers[i]) != VK_SUCCESS) {
+			std::cout << "ERROR::Renderer::CreatePostProcessTargets::CreateFramebuffer" << std::endl;
+			exit(-1);
+		}
+	}
+
+	VkDescriptorSetAllocateInfo descriptor_set_allocate_info{};
+	descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptor_set_allocate_info.descriptorPool = _postPool;
+	descriptor_set_allocate_info.descriptorSetCount = 1;
+	descriptor_set_allocate_info.pSetLayouts = &_postSetLayout;
+
+	if (vkAllocateDescriptorSets(_device, &descriptor_set_allocate_info, &_postSet) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreatePostProcessTargets::AllocateDescriptorSets" << std::endl;
+		exit(-1);
+	}
+
+	VkDescriptorImageInfo image_info{};
+	image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	image_info.imageView = _renderGraph.GetView(_sceneImage);
+	image_info.sampler = _postSampler;
+
+	VkWriteDescriptorSet write_descriptor_set{};
+	write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write_descriptor_set.dstSet = _postSet;
+	write_descriptor_set.dstBinding = 0;
+	write_descriptor_set.dstArrayElement = 0;
+	write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write_descriptor_set.descriptorCount = 1;
+	write_descriptor_set.pImageInfo = &image_info;
+	vkUpdateDescriptorSets(_device, 1, &write_descriptor_set, 0, nullptr);
+}
+
+VkPipeline Renderer::_CreatePipelineVariant(const PipelineVariant& variant) {
+	ProfileScope scope(_profiler, "CreatePipelineVariant");
+
+	// Load the code read by _LoadShaderCode into shader modules
+	VkShaderModule vertShaderModule = _GetShaderModule(_vertShaderCode);
+	VkShaderModule fragShaderModule = _GetShaderModule(_bindless ? _fragBindlessShaderCode : _fragShaderCode);
+
+	// The variant's shader options are folded into the fragment shader when the pipeline is compiled
+	SpecializationConstants specialization_constants{};
+	specialization_constants.texturing		= variant.texturing ? VK_TRUE : VK_FALSE;
+	specialization_constants.vertexColour	= variant.vertexColour ? VK_TRUE : VK_FALSE;
 
-	// Load the code into shader modules 
-	VkShaderModule vertShaderModule = _GetShaderModule(vertCode);
-	VkShaderModule fragShaderModule = _GetShaderModule(fragCode);
+	std::array<VkSpecializationMapEntry, 2> specialization_entries{};
+	specialization_entries[0].constantID	= TEXTURING_CONSTANT_ID;
+	specialization_entries[0].offset		= offsetof(SpecializationConstants, texturing);
+	specialization_entries[0].size			= sizeof(specialization_constants.texturing);
+	specialization_entries[1].constantID	= VERTEX_COLOUR_CONSTANT_ID;
+	specialization_entries[1].offset		= offsetof(SpecializationConstants, vertexColour);
+	specialization_entries[1].size			= sizeof(specialization_constants.vertexColour);
 
-	// The code can be freed now
-	vertCode.clear();
-	fragCode.clear();
+	VkSpecializationInfo specialization_info{};
+	specialization_info.mapEntryCount	= static_cast<uint32_t>(specialization_entries.size());
+	specialization_info.pMapEntries		= specialization_entries.data();
+	specialization_info.dataSize		= sizeof(specialization_constants);
+	specialization_info.pData			= &specialization_constants;
 
 	// Create structs to house the shader info
 	VkPipelineShaderStageCreateInfo vert_shader_stage_create_info{};
@@ -848,6 +1607,7 @@ void Renderer::_CreateGraphicsPipeline() {
 	frag_shader_stage_create_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 	frag_shader_stage_create_info.module = fragShaderModule;
 	frag_shader_stage_create_info.pName = "main";
+	frag_shader_stage_create_info.pSpecializationInfo = &specialization_info;
 
 	// Combine the shader info structs into an array
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vert_shader_stage_create_info, frag_shader_stage_create_info };
@@ -869,24 +1629,19 @@ void Renderer::_CreateGraphicsPipeline() {
 	input_assembly_state_create_info.topology				= VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	input_assembly_state_create_info.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)_swapChainExtent.width;
-	viewport.height = (float)_swapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = _swapChainExtent;
-
+	// The viewport and scissor are set when recording so the pipeline does not depend on the window size
 	VkPipelineViewportStateCreateInfo viewport_state_create_info{};
 	viewport_state_create_info.sType			= VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewport_state_create_info.viewportCount	= 1;
-	viewport_state_create_info.pViewports		= &viewport;
+	viewport_state_create_info.pViewports		= nullptr;
 	viewport_state_create_info.scissorCount		= 1;
-	viewport_state_create_info.pScissors		= &scissor;
+	viewport_state_create_info.pScissors		= nullptr;
+
+	std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamic_state_create_info{};
+	dynamic_state_create_info.sType				= VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_state_create_info.dynamicStateCount	= static_cast<uint32_t>(dynamicStates.size());
+	dynamic_state_create_info.pDynamicStates	= dynamicStates.data();
 
 	VkPipelineRasterizationStateCreateInfo rasterizer_state_create_info{};
 	rasterizer_state_create_info.sType						= VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -903,8 +1658,8 @@ void Renderer::_CreateGraphicsPipeline() {
 
 	VkPipelineMultisampleStateCreateInfo multisample_state_create_info{};
 	multisample_state_create_info.sType					= VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisample_state_create_info.sampleShadingEnable	= VK_TRUE;
-	multisample_state_create_info.rasterizationSamples	= _msaaSamples;;
+	multisample_state_create_info.sampleShadingEnable	= variant.sampleShading ? VK_TRUE : VK_FALSE;
+	multisample_state_create_info.rasterizationSamples	= variant.samples;
 	multisample_state_create_info.minSampleShading		= 0.2f; // Optional
 	multisample_state_create_info.pSampleMask			= nullptr; // Optional
 	multisample_state_create_info.alphaToCoverageEnable = VK_FALSE; // Optional
@@ -941,16 +1696,6 @@ void Renderer::_CreateGraphicsPipeline() {
 	color_blend_state_create_info.blendConstants[2] = 0.0f; // Optional
 	color_blend_state_create_info.blendConstants[3] = 0.0f; // Optional
 
-	VkPipelineLayoutCreateInfo pipeline_layout_create_info{};
-	pipeline_layout_create_info.sType					= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipeline_layout_create_info.setLayoutCount			= 1;
-	pipeline_layout_create_info.pSetLayouts				= &_descriptorSetLayout;
-
-	if (vkCreatePipelineLayout(_device, &pipeline_layout_create_info, nullptr, &_pipelineLayout) != VK_SUCCESS) {
-		std::cout << "ERROR::Renderer::CreateGraphicsPipeline::CreatePipelineLayout" << std::endl;
-		exit(-1);
-	}
-
 	VkGraphicsPipelineCreateInfo pipeline_create_info{};
 	pipeline_create_info.sType					= VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	pipeline_create_info.stageCount				= 2;
@@ -962,20 +1707,38 @@ void Renderer::_CreateGraphicsPipeline() {
 	pipeline_create_info.pMultisampleState		= &multisample_state_create_info;
 	pipeline_create_info.pDepthStencilState		= nullptr; // Optional
 	pipeline_create_info.pColorBlendState		= &color_blend_state_create_info;
-	pipeline_create_info.pDynamicState			= nullptr; // Optional
+	pipeline_create_info.pDynamicState			= &dynamic_state_create_info;
 	pipeline_create_info.layout					= _pipelineLayout;
 	pipeline_create_info.renderPass				= _renderPass;
 	pipeline_create_info.subpass				= 0;
 	pipeline_create_info.pDepthStencilState		= &depth_stencil_state_create_info;
 
-	if (vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &_pipeline) != VK_SUCCESS) {
-		std::cout << "ERROR::Renderer::CreateGraphicsPipeline::CreateGraphicsPipelines" << std::endl;
+	// Ask the driver whether the pipeline came out of the cache
+	VkPipelineCreationFeedbackEXT feedback{};
+	VkPipelineCreationFeedbackCreateInfoEXT feedback_create_info{};
+	feedback_create_info.sType								= VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+	feedback_create_info.pPipelineCreationFeedback			= &feedback;
+	feedback_create_info.pipelineStageCreationFeedbackCount	= 0;
+	if (_creationFeedbackSupported) {
+		pipeline_create_info.pNext = &feedback_create_info;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	VkPipeline pipeline;
+	if (vkCreateGraphicsPipelines(_device, _pipelineCache.Get(), 1, &pipeline_create_info, nullptr, &pipeline) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreatePipelineVariant::CreateGraphicsPipelines" << std::endl;
 		exit(-1);
 	}
 
+	float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+	_pipelineCache.RecordCreation("graphics", ms, _creationFeedbackSupported ? &feedback : nullptr);
+
 	// Cleanup the shader modules
 	vkDestroyShaderModule(_device, fragShaderModule, nullptr);
 	vkDestroyShaderModule(_device, vertShaderModule, nullptr);
+
+	return pipeline;
 }
 
 // Function that takes a char vector of bytecode and converts it to a VkShaderModule
@@ -994,32 +1757,27 @@ VkShaderModule Renderer::_GetShaderModule(const std::vector<char>& code) {
 	return module;
 }
 
+// The framebuffer is always full size, a lower resolution scale only renders to part of it
 void Renderer::_CreateFramebuffers() {
-	// Resize the vector to hold all of the framebuffers
-	_framebuffers.resize(_swapChainImageViews.size());
-
-	// Itterate over the image views and create frame buffers from them
-	for (size_t i = 0; i < _swapChainImageViews.size(); i++) {
-
-		std::array<VkImageView, 3> attachments = {
-			_colorImageView,
-			_depthImageView,
-			_swapChainImageViews[i]
-		};
-
-		VkFramebufferCreateInfo framebufferInfo{};
-		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		framebufferInfo.renderPass = _renderPass;
-		framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-		framebufferInfo.pAttachments = attachments.data();
-		framebufferInfo.width = _swapChainExtent.width;
-		framebufferInfo.height = _swapChainExtent.height;
-		framebufferInfo.layers = 1;
-
-		if (vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_framebuffers[i]) != VK_SUCCESS) {
-			std::cout << "ERROR::Renderer::CreateFramebuffers::CreateFramebuffer" << std::endl;
-			exit(-1);
-		}
+	// Same order as the render pass's attachments, colour 0, depth 1 and when multisampled the scene image is the resolve
+	// target 2. The multisampled colour image only exists with MSAA on
+	std::vector<VkImageView> attachments = { _renderGraph.GetView(_sceneImage), _renderGraph.GetView(_depthImage) };
+	if (_msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		attachments = { _renderGraph.GetView(_colorImage), _renderGraph.GetView(_depthImage), _renderGraph.GetView(_sceneImage) };
+	}
+
+	VkFramebufferCreateInfo framebufferInfo{};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = _renderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	framebufferInfo.pAttachments = attachments.data();
+	framebufferInfo.width = _swapChainExtent.width;
+	framebufferInfo.height = _swapChainExtent.height;
+	framebufferInfo.layers = 1;
+
+	if (vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_framebuffer) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreateFramebuffers::CreateFramebuffer" << std::endl;
+		exit(-1);
 	}
 }
 
@@ -1051,83 +1809,174 @@ VkFormat Renderer::_FindSupportedFormat(const std::vector<VkFormat>& candidates,
 	throw std::runtime_error("failed to find supported format!");
 }
 
-void Renderer::_CreateDepthResources() {
-	VkFormat depthFormat = _FindDepthFormat();
-	_CreateImage(_swapChainExtent.width, _swapChainExtent.height, 1, _msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _depthImage, _depthImageMemory);
-	_depthImageView = _CreateImageView(_depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-	
-	// No need to transfer explicitly to a depth attachment but might aswell do it incase the function is copied later
-	_TransitionImageLayout(_depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
-
-}
-
-VkSampleCountFlagBits Renderer::_GetMaxUsableSampleCount() {
+// The highest sample count up to the one asked for that both colour and depth attachments support
+VkSampleCountFlagBits Renderer::_GetUsableSampleCount(VkSampleCountFlagBits wanted) {
 
 	VkPhysicalDeviceProperties physicalDeviceProperties;
 	vkGetPhysicalDeviceProperties(_physicalDevice, &physicalDeviceProperties);
 
 	VkSampleCountFlags counts = physicalDeviceProperties.limits.framebufferColorSampleCounts & physicalDeviceProperties.limits.framebufferDepthSampleCounts;
-	if (counts & VK_SAMPLE_COUNT_64_BIT) { return VK_SAMPLE_COUNT_64_BIT; }
-	if (counts & VK_SAMPLE_COUNT_32_BIT) { return VK_SAMPLE_COUNT_32_BIT; }
-	if (counts & VK_SAMPLE_COUNT_16_BIT) { return VK_SAMPLE_COUNT_16_BIT; }
-	if (counts & VK_SAMPLE_COUNT_8_BIT) { return VK_SAMPLE_COUNT_8_BIT; }
-	if (counts & VK_SAMPLE_COUNT_4_BIT) { return VK_SAMPLE_COUNT_4_BIT; }
-	if (counts & VK_SAMPLE_COUNT_2_BIT) { return VK_SAMPLE_COUNT_2_BIT; }
+	for (VkSampleCountFlags samples = wanted; samples > VK_SAMPLE_COUNT_1_BIT; samples >>= 1) {
+		if (counts & samples) {
+			return static_cast<VkSampleCountFlagBits>(samples);
+		}
+	}
 
 	return VK_SAMPLE_COUNT_1_BIT;
 }
 
-void Renderer::_CreateColourResources() {
+// Declares the frame's images and passes then creates the images, everything but the swapchain image is sized to it
+// and owned by the graph
+void Renderer::_BuildRenderGraph() {
 	VkFormat colorFormat = _swapChainFormat;
 
-	_CreateImage(_swapChainExtent.width, _swapChainExtent.height, 1, _msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _colorImage, _colorImageMemory);
-	_colorImageView = _CreateImageView(_colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
-}
-
-void Renderer::_CreateTextureImage() {
-	int width;
-	int height;
-	int textureChannels;
-
-	// Load the image into memory
-	// STBI_rgb_alpha forces the image loaded to have an alpha channel, prevents some errors with misalignment
-	stbi_uc* pixels = stbi_load("shaders/texture.jpg", &width, &height, &textureChannels, STBI_rgb_alpha);
-
-	// Calculate mipmap levels
-	_mipmapLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
-
-	// Calculate the required device size using w*h*channels
-	VkDeviceSize imageSize = (uint64_t)width * (uint64_t)height * 4;
-
-	if (!pixels) {
-		std::cout << "ERROR::Renderer::CreateTextureImage::LoadFailed" << std::endl;
+	TransientImageDesc depthDesc{};
+	depthDesc.format	= _FindDepthFormat();
+	depthDesc.extent	= _swapChainExtent;
+	depthDesc.samples	= _msaaSamples;
+	depthDesc.aspect	= VK_IMAGE_ASPECT_DEPTH_BIT;
+	_depthImage = _renderGraph.CreateTransient(depthDesc);
+
+	// Full output size, every resolution scale renders to the top left of it
+	TransientImageDesc sceneDesc{};
+	sceneDesc.format	= colorFormat;
+	sceneDesc.extent	= _swapChainExtent;
+	_sceneImage = _renderGraph.CreateTransient(sceneDesc);
+
+	// The multisampled image is only needed to resolve from
+	std::vector<std::pair<uint32_t, ImageUse>> sceneUses = { { _sceneImage, ImageUse::ColorAttachment }, { _depthImage, ImageUse::DepthAttachment } };
+	if (_msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		TransientImageDesc colorDesc = sceneDesc;
+		colorDesc.samples = _msaaSamples;
+		_colorImage = _renderGraph.CreateTransient(colorDesc);
+		sceneUses.push_back({ _colorImage, ImageUse::ColorAttachment });
+	}
+
+	// A different swapchain image is set every frame, the offscreen target is always the same one so what the last
+	// frame did to it carries over
+	_outputImage = _renderGraph.ImportImage(VK_IMAGE_ASPECT_COLOR_BIT);
+	_acquireWaitStage = _fxaa ? VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+	if (_settings.headless) {
+		_renderGraph.SetImage(_outputImage, _swapChainImages[0], 0);
+	}
+
+	_renderGraph.AddPass("Scene", sceneUses, [this](VkCommandBuffer commandBuffer) { _RecordScenePass(commandBuffer); });
+	if (_fxaa) {
+		_renderGraph.AddPass("FXAA", { { _sceneImage, ImageUse::Sampled }, { _outputImage, ImageUse::ColorAttachment } }, [this](VkCommandBuffer commandBuffer) { _RecordPostProcess(commandBuffer); });
+	} else {
+		_renderGraph.AddPass("Upscale", { { _sceneImage, ImageUse::TransferSrc }, { _outputImage, ImageUse::TransferDst } }, [this](VkCommandBuffer commandBuffer) { _RecordUpscale(commandBuffer); });
 	}
 
-	// Setup the host visible buffer
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	// Headless frames are not presented, they are left ready to be copied out for readback
+	_renderGraph.AddPass("Present", { { _outputImage, _settings.headless ? ImageUse::TransferSrc : ImageUse::Present } });
 
-	_CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	_renderGraph.Compile();
 
-	// Copy the pixel data to the buffer
-	void* data;
-	vkMapMemory(_device, stagingBufferMemory, 0, imageSize, 0, &data);
-		memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(_device, stagingBufferMemory);
+	// Not every format can be filtered when blitting, nearest still upscales just more blocky
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(_physicalDevice, colorFormat, &formatProperties);
+	_upscaleFilter = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+}
 
-	stbi_image_free(pixels);
+// Uploads a KTX2 texture straight from the file mapping, every stored mip level is one region of a single copy
+// Called from the asset loader's threads, on failure nothing has been created and the placeholder stays in use
+bool Renderer::_LoadTexture(const std::string& path, KtxFile& texture, TextureResource& resource) {
+	ProfileScope scope(_profiler, "LoadTexture");
 
-	_CreateImage(width, height, _mipmapLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImage, _textureImageMemory);
-	_TransitionImageLayout(_textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _mipmapLevels);
-	_CopyBufferToImage(stagingBuffer, _textureImage, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+	resource.format = texture.GetFormat();
+	uint32_t width = texture.GetWidth();
+	uint32_t height = texture.GetHeight();
 
-	_GenerateMipmaps(_textureImage, VK_FORMAT_R8G8B8A8_SRGB ,width, height, _mipmapLevels);
+	// Block compressed formats are optional, check the device can actually sample this one
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(_physicalDevice, resource.format, &formatProperties);
+	uint32_t blockWidth, blockHeight, blockBytes;
+	KtxFile::GetFormatBlock(resource.format, blockWidth, blockHeight, blockBytes);
+	if ((blockWidth > 1 && !_textureCompressionBCSupported) || !(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+		std::cout << "ERROR::Renderer::LoadTexture::FormatNotSupported " << path << " " << resource.format << std::endl;
+		texture.Close();
+		return false;
+	}
+
+	// Files should come with the whole mip chain, only uncompressed ones without it have it generated on the GPU. That's
+	// one compute dispatch if the mip generator can handle the image, otherwise a blit per level
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	bool generateMipmaps = texture.NeedsMipmapGeneration();
+	bool computeMipmaps = generateMipmaps && _mipGenerator.CanGenerate(resource.format, width, height, usage);
+	if (generateMipmaps) {
+		resource.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+	} else {
+		resource.mipLevels = texture.GetLevelCount();
+	}
+
+	VkImageCreateFlags flags = 0;
+	if (computeMipmaps) {
+		usage |= _mipGenerator.GetImageUsage();
+		flags = _mipGenerator.GetImageFlags(resource.format);
+	} else if (generateMipmaps) {
+		usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+	_CreateImage(width, height, resource.mipLevels, VK_SAMPLE_COUNT_1_BIT, resource.format, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resource.image, resource.memory, flags);
+
+	VkImageSubresourceRange range{};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.baseMipLevel = 0;
+	range.levelCount = resource.mipLevels;
+	range.baseArrayLayer = 0;
+	range.layerCount = 1;
+
+	// The levels sit next to each other in the file (smallest first), so upload the span covering all of them in one go
+	uint64_t dataStart = UINT64_MAX;
+	uint64_t dataEnd = 0;
+	for (uint32_t level = 0; level < texture.GetLevelCount(); level++) {
+		dataStart = std::min(dataStart, texture.GetLevel(level).offset);
+		dataEnd = std::max(dataEnd, texture.GetLevel(level).offset + texture.GetLevel(level).size);
+	}
+
+	std::vector<VkBufferImageCopy> regions(texture.GetLevelCount());
+	for (uint32_t level = 0; level < texture.GetLevelCount(); level++) {
+		VkBufferImageCopy& buffer_image_copy = regions[level];
+		buffer_image_copy.bufferOffset = texture.GetLevel(level).offset - dataStart;
+		buffer_image_copy.bufferRowLength = 0;
+		buffer_image_copy.bufferImageHeight = 0;
+		buffer_image_copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		buffer_image_copy.imageSubresource.mipLevel = level;
+		buffer_image_copy.imageSubresource.baseArrayLayer = 0;
+		buffer_image_copy.imageSubresource.layerCount = 1;
+		buffer_image_copy.imageOffset = { 0, 0, 0 };
+		buffer_image_copy.imageExtent = { std::max(width >> level, 1u), std::max(height >> level, 1u), 1 };
+	}
+
+	// The data is copied into staging memory straight away so the file can be closed after this
+	uint64_t batch;
+	if (generateMipmaps) {
+		VkImage image = resource.image;
+		VkFormat format = resource.format;
+		uint32_t mipmapLevels = resource.mipLevels;
+		batch = _uploadQueue.UploadImage(resource.image, range, regions, texture.GetData() + dataStart, dataEnd - dataStart,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+			[this, image, format, width, height, mipmapLevels, computeMipmaps](VkCommandBuffer commandBuffer) {
+				if (computeMipmaps) {
+					_mipGenerator.Record(commandBuffer, image, format, width, height, mipmapLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+						VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+				} else {
+					_GenerateMipmaps(commandBuffer, image, format, width, height, mipmapLevels);
+				}
+			});
+	} else {
+		batch = _uploadQueue.UploadImage(resource.image, range, regions, texture.GetData() + dataStart, dataEnd - dataStart,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	}
+	resource.uploadBatch = batch;
+	resource.view = _CreateImageView(resource.image, resource.format, VK_IMAGE_ASPECT_COLOR_BIT, resource.mipLevels);
 
-	vkDestroyBuffer(_device, stagingBuffer, nullptr);
-	vkFreeMemory(_device, stagingBufferMemory, nullptr);
+	texture.Close();
+	return true;
 }
 
-void Renderer::_GenerateMipmaps(VkImage image, VkFormat imageFormat, int32_t width, int32_t height, uint32_t mipmapLevels) {
+// Records the blits that fill every mip level from the base level, the whole image must be in transfer dst and ends up shader read only
+// Only used for images the mip generator can't handle (bases over 4096 or formats that can't be storage images)
+void Renderer::_GenerateMipmaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat, int32_t width, int32_t height, uint32_t mipmapLevels) {
 	// Check if image format supports linear blitting
 	VkFormatProperties formatProperties;
 	vkGetPhysicalDeviceFormatProperties(_physicalDevice, imageFormat, &formatProperties);
@@ -1135,8 +1984,6 @@ void Renderer::_GenerateMipmaps(VkImage image, VkFormat imageFormat, int32_t wid
 		throw std::runtime_error("texture image format does not support linear blitting!");
 	}
 
-	VkCommandBuffer commandBuffer = _BeginSingleTimeCommands();
-
 	VkImageMemoryBarrier image_memory_barrier{};
 	image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	image_memory_barrier.image = image;
@@ -1209,13 +2056,12 @@ void Renderer::_GenerateMipmaps(VkImage image, VkFormat imageFormat, int32_t wid
 		0, nullptr,
 		0, nullptr,
 		1, &image_memory_barrier);
-
-	_EndSingleTimeCommands(commandBuffer);
 }
 
-void Renderer::_CreateImage(uint32_t width, uint32_t height, uint32_t mipmapLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+void Renderer::_CreateImage(uint32_t width, uint32_t height, uint32_t mipmapLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory, VkImageCreateFlags flags) {
 	VkImageCreateInfo image_create_info{};
 	image_create_info.sType			= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_create_info.flags			= flags;
 	image_create_info.imageType		= VK_IMAGE_TYPE_2D;
 	image_create_info.extent.width	= width;
 	image_create_info.extent.height	= height;
@@ -1237,121 +2083,13 @@ void Renderer::_CreateImage(uint32_t width, uint32_t height, uint32_t mipmapLeve
 	VkMemoryRequirements memory_requirements;
 	vkGetImageMemoryRequirements(_device, image, &memory_requirements);
 
-	VkMemoryAllocateInfo memory_allocate_info{};
-	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memory_allocate_info.allocationSize = memory_requirements.size;
-	memory_allocate_info.memoryTypeIndex = _FindMemoryType(memory_requirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(_device, &memory_allocate_info, nullptr, &imageMemory) != VK_SUCCESS) {
+	// Sub allocate the image out of a shared block, linear tiled images count as linear for bufferImageGranularity
+	uint32_t memoryType = _FindMemoryType(memory_requirements.memoryTypeBits, properties);
+	if (!_allocator.Allocate(memory_requirements, memoryType, tiling == VK_IMAGE_TILING_LINEAR, imageMemory)) {
 		throw std::runtime_error("failed to allocate image memory!");
 	}
 
-	vkBindImageMemory(_device, image, imageMemory, 0);
-}
-
-void Renderer::_TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipmapLevels) {
-	VkCommandBuffer commandBuffer = _BeginSingleTimeCommands();
-
-	VkImageMemoryBarrier image_memory_barrier{};
-	image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	image_memory_barrier.oldLayout = oldLayout;
-	image_memory_barrier.newLayout = newLayout;
-	image_memory_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	image_memory_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	image_memory_barrier.image = image;
-	image_memory_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	image_memory_barrier.subresourceRange.baseMipLevel = 0;
-	image_memory_barrier.subresourceRange.levelCount = mipmapLevels;
-	image_memory_barrier.subresourceRange.baseArrayLayer = 0;
-	image_memory_barrier.subresourceRange.layerCount = 1;
-	image_memory_barrier.srcAccessMask = 0; // TODO
-	image_memory_barrier.dstAccessMask = 0; // TODO
-
-	VkPipelineStageFlags sourceStage;
-	VkPipelineStageFlags destinationStage;
-
-	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		image_memory_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-
-		if (_HasStencilComponent(format)) {
-			image_memory_barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
-	}
-	else {
-		image_memory_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	}
-
-	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		image_memory_barrier.srcAccessMask = 0;
-		image_memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		image_memory_barrier.srcAccessMask = 0;
-		image_memory_barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-	}
-	else {
-		throw std::invalid_argument("unsupported layout transition!");
-	}
-
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		sourceStage, destinationStage,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &image_memory_barrier
-	);
-
-	_EndSingleTimeCommands(commandBuffer);
-}
-
-void Renderer::_CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-	VkCommandBuffer commandBuffer = _BeginSingleTimeCommands();
-
-	VkBufferImageCopy buffer_image_copy{};
-	buffer_image_copy.bufferOffset = 0;
-	buffer_image_copy.bufferRowLength = 0;
-	buffer_image_copy.bufferImageHeight = 0;
-
-	buffer_image_copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	buffer_image_copy.imageSubresource.mipLevel = 0;
-	buffer_image_copy.imageSubresource.baseArrayLayer = 0;
-	buffer_image_copy.imageSubresource.layerCount = 1;
-
-	buffer_image_copy.imageOffset = { 0, 0, 0 };
-	buffer_image_copy.imageExtent = {
-		width,
-		height,
-		1
-	};
-
-	vkCmdCopyBufferToImage(
-		commandBuffer,
-		buffer,
-		image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1,
-		&buffer_image_copy
-	);
-
-	_EndSingleTimeCommands(commandBuffer);
-}
-
-void Renderer::_CreateTextureImageView() {
-	_textureImageView = _CreateImageView(_textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, _mipmapLevels);
+	vkBindImageMemory(_device, image, imageMemory.memory, imageMemory.offset);
 }
 
 VkImageView Renderer::_CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipmapLevels) {
@@ -1391,7 +2129,7 @@ void Renderer::_CreateTextureSampler() {
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = static_cast<float>(_mipmapLevels);
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE; // Not tied to a texture's mip count so it outlives texture swaps
 
 	if (vkCreateSampler(_device, &samplerInfo, nullptr, &_textureSampler) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create texture sampler!");
@@ -1412,50 +2150,203 @@ uint32_t Renderer::_FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags pr
 	throw std::runtime_error("failed to find suitable memory type!");
 }
 
-void Renderer::_CreateVertexBuffer() {
+// Maps the cooked mesh and queues its vertex and index data for upload, the data goes from the mapping straight into staging memory
+// Called from the asset loader's threads, on failure nothing has been created and the placeholder stays in use
+bool Renderer::_LoadMesh(const std::string& path, MeshFile& mesh, MeshResource& resource) {
+	ProfileScope scope(_profiler, "LoadMesh");
+
+	// The pipeline has a single interleaved vertex binding laid out as Vertex
+	if (mesh.GetStreamCount() != 1 || mesh.GetStream(0).stride != sizeof(Vertex)) {
+		std::cout << "ERROR::Renderer::LoadMesh::VertexLayoutMismatch " << path << std::endl;
+		mesh.Close();
+		return false;
+	}
+
+	// Centred on the bounding box, loose but good enough for culling
+	const Vertex* vertices = reinterpret_cast<const Vertex*>(mesh.GetStreamData(0));
+	uint32_t vertexCount = mesh.GetVertexCount();
+	glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		glm::vec3 position(vertices[i].position[0], vertices[i].position[1], vertices[i].position[2]);
+		minimum = glm::min(minimum, position);
+		maximum = glm::max(maximum, position);
+	}
+	glm::vec3 centre = (minimum + maximum) * 0.5f;
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		glm::vec3 position(vertices[i].position[0], vertices[i].position[1], vertices[i].position[2]);
+		radius = std::max(radius, glm::length(position - centre));
+	}
+	resource.boundingSphere = glm::vec4(centre, radius);
+
+	_CreateVertexBuffer(mesh.GetStreamData(0), mesh.GetStream(0).size, resource);
+	_CreateIndexBuffer(mesh.GetIndexData(), mesh.GetIndexDataSize(), mesh.GetIndexType(), resource);
+	resource.submeshes.assign(mesh.GetSubmeshes(), mesh.GetSubmeshes() + mesh.GetSubmeshCount());
+
+	// The upload queue has its own copy now so the mapping can go
+	mesh.Close();
+	return true;
+}
+
+void Renderer::_CreateVertexBuffer(const void* vertices, VkDeviceSize bufferSize, MeshResource& resource) {
+	// Create the local device buffer (in physical device memory)
+	_CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resource.vertexBuffer, resource.vertexMemory);
 
-	// Create the staging buffer
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	VkDeviceSize bufferSize = sizeof(_vertices[0]) * _vertices.size();
-	_CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	// Queue the copy, it goes through the upload queue's staging memory and is batched with the other uploads
+	uint64_t batch = _uploadQueue.UploadBuffer(resource.vertexBuffer, 0, vertices, bufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	resource.uploadBatch = std::max(resource.uploadBatch, batch);
+}
 
-	// Move the raw vertex data to the staging buffer
-	void* data;
-	vkMapMemory(_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, _vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(_device, stagingBufferMemory);
+void Renderer::_CreateIndexBuffer(const void* indices, VkDeviceSize bufferSize, VkIndexType indexType, MeshResource& resource) {
+	_CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resource.indexBuffer, resource.indexMemory);
+	resource.indexType = indexType;
 
-	// Create the local device buffer (in physical device memory)
-	_CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _vertexBuffer, _vertexBufferMemory);
+	uint64_t batch = _uploadQueue.UploadBuffer(resource.indexBuffer, 0, indices, bufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+	resource.uploadBatch = std::max(resource.uploadBatch, batch);
+}
+
+// A white quad and a single white texel, small enough to be ready on the first frames
+void Renderer::_CreatePlaceholderAssets() {
+	ProfileScope scope(_profiler, "CreatePlaceholderAssets");
+	const Vertex vertices[] = {
+		{ { -0.5f, -0.5f, 0.0f }, { 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f } },
+		{ { 0.5f, -0.5f, 0.0f }, { 1.0f, 1.0f, 1.0f }, { 1.0f, 0.0f } },
+		{ { 0.5f, 0.5f, 0.0f }, { 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f } },
+		{ { -0.5f, 0.5f, 0.0f }, { 1.0f, 1.0f, 1.0f }, { 0.0f, 1.0f } }
+	};
+	const uint16_t indices[] = { 0, 1, 2, 2, 3, 0 };
 
-	// Copy the RAM buffer to device memory
-	_CopyBuffer(stagingBuffer, _vertexBuffer, bufferSize);
+	_CreateVertexBuffer(vertices, sizeof(vertices), _mesh);
+	_CreateIndexBuffer(indices, sizeof(indices), VK_INDEX_TYPE_UINT16, _mesh);
+	_mesh.submeshes = { { 0, 6, 0, 0 } };
+	_mesh.boundingSphere = glm::vec4(0.0f, 0.0f, 0.0f, std::sqrt(0.5f));
 
-	// Cleanup
-	vkDestroyBuffer(_device, stagingBuffer, nullptr);
-	vkFreeMemory(_device, stagingBufferMemory, nullptr);
+	const uint8_t texel[] = { 255, 255, 255, 255 };
+	_texture.format = VK_FORMAT_R8G8B8A8_SRGB;
+	_texture.mipLevels = 1;
+	_CreateImage(1, 1, 1, VK_SAMPLE_COUNT_1_BIT, _texture.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _texture.image, _texture.memory);
+
+	VkImageSubresourceRange range{};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.baseMipLevel = 0;
+	range.levelCount = 1;
+	range.baseArrayLayer = 0;
+	range.layerCount = 1;
+
+	VkBufferImageCopy buffer_image_copy{};
+	buffer_image_copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	buffer_image_copy.imageSubresource.mipLevel = 0;
+	buffer_image_copy.imageSubresource.baseArrayLayer = 0;
+	buffer_image_copy.imageSubresource.layerCount = 1;
+	buffer_image_copy.imageExtent = { 1, 1, 1 };
+
+	_texture.uploadBatch = _uploadQueue.UploadImage(_texture.image, range, { buffer_image_copy }, texel, sizeof(texel),
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	_texture.view = _CreateImageView(_texture.image, _texture.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+	_sceneUploadBatch = std::max(_mesh.uploadBatch, _texture.uploadBatch);
+}
+
+// Mapping the files and checking their headers needs no device so it runs while the device is created,
+// the mapping also starts the OS reading the files in ahead of the loads
+void Renderer::_OpenAssetFiles() {
+	_meshFileOpen = _meshFile.Open(_settings.meshPath);
+	if (!_meshFileOpen) {
+		std::cout << "ERROR::Renderer::OpenAssetFiles::Mesh " << _settings.meshPath << std::endl;
+	}
+
+	_textureFileOpen = _textureFile.Open(_settings.texturePath);
+	if (!_textureFileOpen) {
+		std::cout << "ERROR::Renderer::OpenAssetFiles::Texture " << _settings.texturePath << std::endl;
+	}
+}
+
+// Queues the real mesh and texture on the asset loader, the results are picked up by _InstallLoadedAssets
+// Files that failed to open are skipped and their placeholders stay in use
+void Renderer::_LoadAssetsAsync() {
+	if (_meshFileOpen) {
+		_assetLoader.Submit([this]() {
+			MeshResource mesh;
+			if (_LoadMesh(_settings.meshPath, _meshFile, mesh)) {
+				std::lock_guard<std::mutex> lock(_loadedAssetsMutex);
+				_loadedMeshes.push_back(mesh);
+			}
+		});
+	}
+
+	if (_textureFileOpen) {
+		_assetLoader.Submit([this]() {
+			TextureResource texture;
+			if (_LoadTexture(_settings.texturePath, _textureFile, texture)) {
+				std::lock_guard<std::mutex> lock(_loadedAssetsMutex);
+				_loadedTextures.push_back(texture);
+			}
+		});
+	}
 }
 
-void Renderer::_CreateIndexBuffer() {
-	VkDeviceSize bufferSize = sizeof(_indices[0]) * _indices.size();
+// Swaps in loaded assets whose uploads have been acquired, whatever they replace is retired since in flight frames may still use it
+// Forcing swaps them in straight away, the scene upload batch then holds back drawing until their uploads are acquired
+void Renderer::_InstallLoadedAssets(bool force) {
+	std::lock_guard<std::mutex> lock(_loadedAssetsMutex);
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	_CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	for (auto it = _loadedMeshes.begin(); it != _loadedMeshes.end();) {
+		if (!force && !_uploadQueue.IsComplete(it->uploadBatch)) {
+			++it;
+			continue;
+		}
+
+		MeshResource replaced = _mesh;
+		_RetireResource([this, replaced]() mutable { _DestroyMesh(replaced); });
+		_mesh = *it;
+		_sceneUploadBatch = std::max(_sceneUploadBatch, _mesh.uploadBatch);
+		it = _loadedMeshes.erase(it);
+	}
 
-	void* data;
-	vkMapMemory(_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, _indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(_device, stagingBufferMemory);
+	bool textureChanged = false;
+	for (auto it = _loadedTextures.begin(); it != _loadedTextures.end();) {
+		if (!force && !_uploadQueue.IsComplete(it->uploadBatch)) {
+			++it;
+			continue;
+		}
 
-	_CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _indexBuffer, _indexBufferMemory);
+		// A bindless texture goes into a new slot, the old one is handed back once no frame in flight can sample it
+		TextureResource replaced = _texture;
+		_RetireResource([this, replaced]() mutable {
+			_DestroyTexture(replaced);
+			if (_bindless) {
+				_freeBindlessSlots.push_back(replaced.bindlessSlot);
+			}
+		});
+		_texture = *it;
+		if (_bindless) {
+			_texture.bindlessSlot = _AddBindlessTexture(_texture.view);
+			_materialTextures[0] = _texture.bindlessSlot;
+		}
+		_sceneUploadBatch = std::max(_sceneUploadBatch, _texture.uploadBatch);
+		it = _loadedTextures.erase(it);
+		textureChanged = true;
+	}
 
-	_CopyBuffer(stagingBuffer, _indexBuffer, bufferSize);
+	// The bound set may still be in use so write a new one rather than update it
+	if (textureChanged && !_bindless) {
+		VkDescriptorSet replacedSet = _descriptorSet;
+		_RetireResource([this, replacedSet]() { vkFreeDescriptorSets(_device, _descriptorPool, 1, &replacedSet); });
+		_CreateDescriptorSets();
+	}
+}
 
-	vkDestroyBuffer(_device, stagingBuffer, nullptr);
-	vkFreeMemory(_device, stagingBufferMemory, nullptr);
+void Renderer::_DestroyMesh(MeshResource& mesh) {
+	vkDestroyBuffer(_device, mesh.indexBuffer, nullptr);
+	_allocator.Free(mesh.indexMemory);
+	vkDestroyBuffer(_device, mesh.vertexBuffer, nullptr);
+	_allocator.Free(mesh.vertexMemory);
+}
 
+void Renderer::_DestroyTexture(TextureResource& texture) {
+	vkDestroyImageView(_device, texture.view, nullptr);
+	vkDestroyImage(_device, texture.image, nullptr);
+	_allocator.Free(texture.memory);
 }
 
 // Create single time command buffers
@@ -1499,22 +2390,8 @@ void Renderer::_EndSingleTimeCommands(VkCommandBuffer command_buffer) {
 	vkFreeCommandBuffers(_device, _commandPool, 1, &command_buffer);
 }
 
-// For copying one buffer into another buffer
-void Renderer::_CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-	// Memory transfers are executed using command buffers so create a temporary one
-	// Could use a seperate command pool with memory allocation optimisations ( VK_COMMAND_POOL_CREATE_TRANSIENT_BIT )
-	VkCommandBuffer command_buffer = _BeginSingleTimeCommands();
-
-	// Copy the data
-	VkBufferCopy copy_region{};
-	copy_region.size = size;
-	vkCmdCopyBuffer(command_buffer, srcBuffer, dstBuffer, 1, &copy_region);
-
-	_EndSingleTimeCommands(command_buffer);
-}
-
 // Create a VkBuffer object
-void Renderer::_CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+void Renderer::_CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory) {
  
 	VkBufferCreateInfo buffer_create_info{};
 	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -1529,100 +2406,168 @@ void Renderer::_CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemo
 	VkMemoryRequirements memory_requirements;
 	vkGetBufferMemoryRequirements(_device, buffer, &memory_requirements);
 
-	VkMemoryAllocateInfo memory_allocate_info{};
-	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memory_allocate_info.allocationSize = memory_requirements.size;
-	memory_allocate_info.memoryTypeIndex = _FindMemoryType(memory_requirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(_device, &memory_allocate_info, nullptr, &bufferMemory) != VK_SUCCESS) {
+	// Sub allocate the buffer out of a shared block rather than giving it its own device allocation
+	uint32_t memoryType = _FindMemoryType(memory_requirements.memoryTypeBits, properties);
+	if (!_allocator.Allocate(memory_requirements, memoryType, true, bufferMemory)) {
 		throw std::runtime_error("failed to allocate buffer memory!");
 	}
 
-	vkBindBufferMemory(_device, buffer, bufferMemory, 0);
+	vkBindBufferMemory(_device, buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
-void Renderer::_CreateUniformBuffers() {
-	// Get the size of the UBO
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-
-	// Resize the buffer vectors to the swap chain image size
-	_uniformBuffers.resize(_swapChainImages.size());
-	_uniformBuffersMemory.resize(_swapChainImages.size());
-
-	// For each swap chain image create a buffer and assign it to the vectors
-	for (size_t i = 0; i < _swapChainImages.size(); i++) {
-		_CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _uniformBuffers[i], _uniformBuffersMemory[i]);
-	}
+// Persistently mapped buffers for the instance data and the indirect draw commands, written by the CPU every frame
+void Renderer::_CreateInstanceBuffers() {
+	// Frames are indexed into by instance rather than bound at an offset so their regions don't need aligning
+	_maxInstances = std::max<uint32_t>(static_cast<uint32_t>(_renderObjects.size()), 1024);
+	_instanceFrameSize = sizeof(InstanceData) * _maxInstances;
+	_CreateBuffer(_instanceFrameSize * _max_frames_in_flight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _instanceBuffer, _instanceMemory);
+
+	// Room for one draw count per secondary command buffer ahead of the commands themselves
+	uint32_t maxSlices = (_maxIndirectCommands + _drawsPerSecondary - 1) / _drawsPerSecondary;
+	_indirectCommandsOffset = (sizeof(uint32_t) * maxSlices + 15) & ~15ull;
+	_indirectFrameSize = (_indirectCommandsOffset + sizeof(VkDrawIndexedIndirectCommand) * _maxIndirectCommands + 15) & ~15ull;
+	_CreateBuffer(_indirectFrameSize * _max_frames_in_flight, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _indirectBuffer, _indirectMemory);
 }
 
 void Renderer::_CreateDescriptorPool() {
 
-	// Allocate one descriptor for every frame
-	std::array<VkDescriptorPoolSize, 2> poolSizes{};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(_swapChainImages.size());
-	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(_swapChainImages.size());
+	// Only one descriptor set is in use since the pushed instance offset picks the frame's data, but a texture swap replaces
+	// it while the old one may still be in use by every frame in flight
+	uint32_t maxSets = _max_frames_in_flight + 1;
+	std::vector<VkDescriptorPoolSize> poolSizes(_bindless ? 1 : 2);
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = maxSets;
+	if (!_bindless) {
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[1].descriptorCount = maxSets;
+	}
 
 	VkDescriptorPoolCreateInfo descriptor_pool_create_info{};
 	descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	descriptor_pool_create_info.poolSizeCount = static_cast<uint32_t>(poolSizes.size());;
 	descriptor_pool_create_info.pPoolSizes = poolSizes.data();
-	descriptor_pool_create_info.maxSets = static_cast<uint32_t>(_swapChainImages.size());
+	descriptor_pool_create_info.maxSets = maxSets;
+	descriptor_pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 
 	if (vkCreateDescriptorPool(_device, &descriptor_pool_create_info, nullptr, &_descriptorPool) != VK_SUCCESS) {
 		std::cout << "ERROR::Renderer::CreateDescriptorPool::CreateDescriptorPool" << std::endl;
 		exit(-1);
 	}
+
+	if (!_bindless) {
+		return;
+	}
+
+	// The bindless set lives for the renderer's lifetime in a pool of its own
+	VkDescriptorPoolSize bindlessPoolSize{};
+	bindlessPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindlessPoolSize.descriptorCount = _maxBindlessTextures;
+
+	VkDescriptorPoolCreateInfo bindless_pool_create_info{};
+	bindless_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	bindless_pool_create_info.poolSizeCount = 1;
+	bindless_pool_create_info.pPoolSizes = &bindlessPoolSize;
+	bindless_pool_create_info.maxSets = 1;
+	bindless_pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+
+	if (vkCreateDescriptorPool(_device, &bindless_pool_create_info, nullptr, &_bindlessPool) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreateDescriptorPool::CreateBindlessPool" << std::endl;
+		exit(-1);
+	}
 }
 
 void Renderer::_CreateDescriptorSets() {
-	// Create a descriptor set layout vector for each frame
-	std::vector<VkDescriptorSetLayout> layouts(_swapChainImages.size(), _descriptorSetLayout);
-
 	VkDescriptorSetAllocateInfo descriptor_set_allocate_info{};
 	descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	descriptor_set_allocate_info.descriptorPool = _descriptorPool;
-	descriptor_set_allocate_info.descriptorSetCount = static_cast<uint32_t>(_swapChainImages.size());
-	descriptor_set_allocate_info.pSetLayouts = layouts.data();
+	descriptor_set_allocate_info.descriptorSetCount = 1;
+	descriptor_set_allocate_info.pSetLayouts = &_descriptorSetLayout;
 
-	_descriptorSets.resize(_swapChainImages.size());
-	if (vkAllocateDescriptorSets(_device, &descriptor_set_allocate_info, _descriptorSets.data()) != VK_SUCCESS) {
+	if (vkAllocateDescriptorSets(_device, &descriptor_set_allocate_info, &_descriptorSet) != VK_SUCCESS) {
 		std::cout << "ERROR::Renderer::CreateDescriptorSets::AllocateDescriptorSets" << std::endl;
 		exit(-1);
 	}
 
-	for (size_t i = 0; i < _swapChainImages.size(); i++) {
-		VkDescriptorBufferInfo bufferInfo{};
-		bufferInfo.buffer = _uniformBuffers[i];
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBufferObject);
-
-		VkDescriptorImageInfo imageInfo{};
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = _textureImageView;
-		imageInfo.sampler = _textureSampler;
-
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-
-		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[0].dstSet = _descriptorSets[i];
-		descriptorWrites[0].dstBinding = 0;
-		descriptorWrites[0].dstArrayElement = 0;
-		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrites[0].descriptorCount = 1;
-		descriptorWrites[0].pBufferInfo = &bufferInfo;
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = _texture.view;
+	imageInfo.sampler = _textureSampler;
+
+	VkDescriptorBufferInfo instanceInfo{};
+	instanceInfo.buffer = _instanceBuffer;
+	instanceInfo.offset = 0;
+	instanceInfo.range = _instanceFrameSize * _max_frames_in_flight;
 
+	std::vector<VkWriteDescriptorSet> descriptorWrites(_bindless ? 1 : 2);
+
+	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[0].dstSet = _descriptorSet;
+	descriptorWrites[0].dstBinding = 2;
+	descriptorWrites[0].dstArrayElement = 0;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorWrites[0].descriptorCount = 1;
+	descriptorWrites[0].pBufferInfo = &instanceInfo;
+
+	// Bindless textures are written into their own set instead
+	if (!_bindless) {
 		descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[1].dstSet = _descriptorSets[i];
+		descriptorWrites[1].dstSet = _descriptorSet;
 		descriptorWrites[1].dstBinding = 1;
 		descriptorWrites[1].dstArrayElement = 0;
 		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		descriptorWrites[1].descriptorCount = 1;
 		descriptorWrites[1].pImageInfo = &imageInfo;
+	}
+
+	vkUpdateDescriptorSets(_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void Renderer::_CreateBindlessSet() {
+	VkDescriptorSetAllocateInfo descriptor_set_allocate_info{};
+	descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptor_set_allocate_info.descriptorPool = _bindlessPool;
+	descriptor_set_allocate_info.descriptorSetCount = 1;
+	descriptor_set_allocate_info.pSetLayouts = &_bindlessSetLayout;
+
+	if (vkAllocateDescriptorSets(_device, &descriptor_set_allocate_info, &_bindlessSet) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreateBindlessSet::AllocateDescriptorSets" << std::endl;
+		exit(-1);
+	}
+
+	// The placeholder is the first texture in the array
+	_texture.bindlessSlot = _AddBindlessTexture(_texture.view);
+	_materialTextures[0] = _texture.bindlessSlot;
+}
 
-		vkUpdateDescriptorSets(_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+// Writes the view into a free slot of the bindless array and returns the slot, which is what shaders index with
+uint32_t Renderer::_AddBindlessTexture(VkImageView view) {
+	uint32_t slot;
+	if (!_freeBindlessSlots.empty()) {
+		slot = _freeBindlessSlots.back();
+		_freeBindlessSlots.pop_back();
+	} else if (_bindlessSlotCount < _maxBindlessTextures) {
+		slot = _bindlessSlotCount++;
+	} else {
+		std::cout << "ERROR::Renderer::AddBindlessTexture::OutOfSlots" << std::endl;
+		exit(-1);
 	}
+
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = view;
+	imageInfo.sampler = _textureSampler;
+
+	VkWriteDescriptorSet descriptorWrite{};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = _bindlessSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = slot;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets(_device, 1, &descriptorWrite, 0, nullptr);
+	return slot;
 }
 
 void Renderer::_CreateCommandPool() {
@@ -1633,6 +2578,7 @@ void Renderer::_CreateCommandPool() {
 	// Since the commands will be for drawing use the graphics family
 	VkCommandPoolCreateInfo command_pool_create_info{};
 	command_pool_create_info.sType				= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	command_pool_create_info.flags				= VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // Frame command buffers are re-recorded every frame
 	command_pool_create_info.queueFamilyIndex	= queueFamilyIndices.graphicsFamily.value();
 
 	if (vkCreateCommandPool(_device, &command_pool_create_info, nullptr, &_commandPool) != VK_SUCCESS) {
@@ -1643,9 +2589,10 @@ void Renderer::_CreateCommandPool() {
 }
 
 void Renderer::_CreateCommandBuffers() {
+	ProfileScope scope(_profiler, "CreateCommandBuffers");
 	
-	// Resize the command buffer vector to the number of framebuffers
-	_commandBuffers.resize(_framebuffers.size());
+	// One command buffer per frame in flight, they are recorded in _DrawFrame once the frame's instance data is known
+	_commandBuffers.resize(_max_frames_in_flight);
 
 	// Create the primary command buffer
 	VkCommandBufferAllocateInfo command_buffer_alloc_info{};
@@ -1659,96 +2606,433 @@ void Renderer::_CreateCommandBuffers() {
 		exit(-1);
 	}
 
-	// Begin recording each command buffer
-	for (size_t i = 0; i < _commandBuffers.size(); i++) {
-		VkCommandBufferBeginInfo command_buffer_begin_info{};
-		command_buffer_begin_info.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		command_buffer_begin_info.flags				= 0;
-		command_buffer_begin_info.pInheritanceInfo	= nullptr;
+	// Every worker gets its own pool for each frame in flight so recording needs no locking and a frame's pools
+	// can be reset in one go once the frame has completed. Secondary buffers are allocated from them as needed
+	QueueFamilyIndices queueFamilyIndices = _FindQueueFamilies(_physicalDevice);
+	uint32_t workers = std::max(_threadPool.GetThreadCount(), 1u);
+	_workerCommands.resize(_max_frames_in_flight);
+	for (auto& frameCommands : _workerCommands) {
+		frameCommands.resize(workers);
+		for (auto& commands : frameCommands) {
+			VkCommandPoolCreateInfo command_pool_create_info{};
+			command_pool_create_info.sType				= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			command_pool_create_info.flags				= VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			command_pool_create_info.queueFamilyIndex	= queueFamilyIndices.graphicsFamily.value();
+
+			if (vkCreateCommandPool(_device, &command_pool_create_info, nullptr, &commands.pool) != VK_SUCCESS) {
+				std::cout << "ERROR::Renderer::CreateCommandBuffers::CreateWorkerCommandPool" << std::endl;
+				exit(-1);
+			}
+		}
+	}
+}
+
+// Hands out the next secondary command buffer from the worker's pool for the current frame
+VkCommandBuffer Renderer::_GetSecondaryCommandBuffer(uint32_t worker) {
+	WorkerCommands& commands = _workerCommands[_currentFrame][worker];
+
+	if (commands.used == commands.buffers.size()) {
+		VkCommandBufferAllocateInfo command_buffer_alloc_info{};
+		command_buffer_alloc_info.sType					= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_alloc_info.commandPool			= commands.pool;
+		command_buffer_alloc_info.level					= VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		command_buffer_alloc_info.commandBufferCount	= 1;
 
-		if (vkBeginCommandBuffer(_commandBuffers[i], &command_buffer_begin_info) != VK_SUCCESS) {
-			std::cout << "ERROR::Renderer::CreateCommandBuffers::BeginCommandBuffer" << std::endl;
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(_device, &command_buffer_alloc_info, &commandBuffer) != VK_SUCCESS) {
+			std::cout << "ERROR::Renderer::GetSecondaryCommandBuffer::AllocateCommandBuffers" << std::endl;
 			exit(-1);
 		}
+		commands.buffers.push_back(commandBuffer);
+	}
 
-		// Drawing starts by beginning the render pass
-		VkRenderPassBeginInfo render_pass_begin_info{};
-		render_pass_begin_info.sType				= VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		render_pass_begin_info.renderPass			= _renderPass;
-		render_pass_begin_info.framebuffer			= _framebuffers[i];
-		render_pass_begin_info.renderArea.offset	= { 0, 0 };
-		render_pass_begin_info.renderArea.extent	= _swapChainExtent;
+	return commands.buffers[commands.used++];
+}
 
-		// Define what the clear colour value should be
-		std::array<VkClearValue, 2> clearValues{};
-		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-		clearValues[1].depthStencil = { 1.0f, 0 };
-		render_pass_begin_info.clearValueCount	= static_cast<uint32_t>(clearValues.size());
-		render_pass_begin_info.pClearValues		= clearValues.data();
+// Records a slice of the frame's indirect draw commands into a secondary command buffer that continues the frame's render pass
+void Renderer::_RecordDraws(VkCommandBuffer commandBuffer, uint32_t slice, uint32_t firstCommand, uint32_t commandCount) {
+	ProfileScope scope(_profiler, "RecordDraws");
 
-		// Start recording the render pass for this buffer
-		vkCmdBeginRenderPass(_commandBuffers[i], &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	VkCommandBufferInheritanceInfo command_buffer_inheritance_info{};
+	command_buffer_inheritance_info.sType		= VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	command_buffer_inheritance_info.renderPass	= _renderPass;
+	command_buffer_inheritance_info.subpass		= 0;
+	command_buffer_inheritance_info.framebuffer	= _framebuffer;
 
-			// Bind the graphics pipeline
-			vkCmdBindPipeline(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
+	VkCommandBufferBeginInfo command_buffer_begin_info{};
+	command_buffer_begin_info.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	command_buffer_begin_info.flags				= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	command_buffer_begin_info.pInheritanceInfo	= &command_buffer_inheritance_info;
 
-			VkBuffer vertexBuffers[] = { _vertexBuffer };
-			VkDeviceSize offsets[] = { 0 };
-			vkCmdBindVertexBuffers(_commandBuffers[i], 0, 1, vertexBuffers, offsets);
+	if (vkBeginCommandBuffer(commandBuffer, &command_buffer_begin_info) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::RecordDraws::BeginCommandBuffer" << std::endl;
+		exit(-1);
+	}
 
-			vkCmdBindIndexBuffer(_commandBuffers[i], _indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+	// Secondary command buffers inherit no state so everything is bound again
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
 
-			// Bind the descriptor sets containing the UBO
-			vkCmdBindDescriptorSets(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &_descriptorSets[i], 0, nullptr);
+	// Viewport and scissor cover the region rendered at the current resolution scale
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)_renderExtent.width;
+	viewport.height = (float)_renderExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = _renderExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-			// Actually draw the vertices, finally
-			vkCmdDrawIndexed(_commandBuffers[i], static_cast<uint32_t>(_indices.size()), 1, 0, 0, 0);
+	VkBuffer vertexBuffers[] = { _mesh.vertexBuffer };
+	VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
-		// Finished recording the render pass
-		vkCmdEndRenderPass(_commandBuffers[i]);
+	vkCmdBindIndexBuffer(commandBuffer, _mesh.indexBuffer, 0, _mesh.indexType);
 
-		if (vkEndCommandBuffer(_commandBuffers[i]) != VK_SUCCESS) {
-			std::cout << "ERROR::Renderer::CreateCommandBuffers::EndCommandBuffer" << std::endl;
-			exit(-1);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &_descriptorSet, 0, nullptr);
+	if (_bindless) {
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 1, 1, &_bindlessSet, 0, nullptr);
+	}
+
+	// The frame's instance offset goes straight into the command buffer, no buffer write or descriptor needed
+	DrawConstants drawConstants{};
+	drawConstants.instanceOffset = _currentFrame * _maxInstances;
+	vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants), &drawConstants);
+
+	// Every command draws all the instances of one mesh, the commands and their count come from the indirect buffer
+	VkDeviceSize frameOffset = _currentFrame * _indirectFrameSize;
+	VkDeviceSize commandOffset = frameOffset + _indirectCommandsOffset + firstCommand * sizeof(VkDrawIndexedIndirectCommand);
+	if (_vkCmdDrawIndexedIndirectCount != nullptr) {
+		_vkCmdDrawIndexedIndirectCount(commandBuffer, _indirectBuffer, commandOffset, _indirectBuffer, frameOffset + slice * sizeof(uint32_t), commandCount, sizeof(VkDrawIndexedIndirectCommand));
+	} else if (_multiDrawIndirectSupported) {
+		vkCmdDrawIndexedIndirect(commandBuffer, _indirectBuffer, commandOffset, commandCount, sizeof(VkDrawIndexedIndirectCommand));
+	} else {
+		for (uint32_t i = 0; i < commandCount; i++) {
+			vkCmdDrawIndexedIndirect(commandBuffer, _indirectBuffer, commandOffset + i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
 		}
 	}
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::RecordDraws::EndCommandBuffer" << std::endl;
+		exit(-1);
+	}
+}
+
+// Records the draw commands for this frame into the given command buffer, targeting the framebuffer of imageIndex
+void Renderer::_RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+	vkResetCommandBuffer(commandBuffer, 0);
+
+	VkCommandBufferBeginInfo command_buffer_begin_info{};
+	command_buffer_begin_info.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	command_buffer_begin_info.flags				= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	command_buffer_begin_info.pInheritanceInfo	= nullptr;
+
+	if (vkBeginCommandBuffer(commandBuffer, &command_buffer_begin_info) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::RecordCommandBuffer::BeginCommandBuffer" << std::endl;
+		exit(-1);
+	}
+
+	// Picks up the GPU zones from the last time this frame in flight was used, it has been waited on already
+	_profiler.BeginGpuFrame(commandBuffer, static_cast<uint32_t>(_currentFrame));
+	_profiler.BeginGpuZone(commandBuffer, "Frame");
+
+	// The last GPU time this frame in flight measured picks the resolution scale
+	_dynamicResolution.BeginFrame(commandBuffer, static_cast<uint32_t>(_currentFrame));
+	_renderExtent = _dynamicResolution.GetExtent(_swapChainExtent);
+
+	// Send off anything queued since the last frame and take ownership of whatever has finished uploading
+	_uploadQueue.Flush();
+	_mipGenerator.BeginFrame(static_cast<uint32_t>(_currentFrame));
+	_uploadQueue.RecordAcquires(commandBuffer, _frameNumber, _frameWaitSemaphores, _frameWaitValues, _frameWaitStages);
+
+	// Until the scene's buffers and texture have arrived the frame is just cleared
+	bool sceneReady = _uploadQueue.IsComplete(_sceneUploadBatch);
+
+	// The frame has completed so nothing recorded into its worker pools is still in use
+	for (auto& commands : _workerCommands[_currentFrame]) {
+		vkResetCommandPool(_device, commands.pool, 0);
+		commands.used = 0;
+	}
+
+	// Split the indirect commands into slices and have the workers record them in parallel, each slice goes into its own
+	// secondary command buffer so they can be executed in draw list order whichever worker recorded them
+	uint32_t commandCount = sceneReady ? _indirectCommandCount : 0;
+	uint32_t sliceCount = (commandCount + _drawsPerSecondary - 1) / _drawsPerSecondary;
+	_sceneCommandBuffers.resize(sliceCount);
+
+	_threadPool.ParallelFor(sliceCount, [&](uint32_t slice, uint32_t worker) {
+		uint32_t firstCommand = slice * _drawsPerSecondary;
+		VkCommandBuffer secondary = _GetSecondaryCommandBuffer(worker);
+		_RecordDraws(secondary, slice, firstCommand, std::min(_drawsPerSecondary, commandCount - firstCommand));
+		_sceneCommandBuffers[slice] = secondary;
+	});
+
+	// Every pass with the barriers between them, the scene pass executes the secondary command buffers
+	_imageIndex = imageIndex;
+	if (!_settings.headless) {
+		_renderGraph.SetImage(_outputImage, _swapChainImages[imageIndex], _acquireWaitStage);
+	}
+	_renderGraph.Execute(commandBuffer, _profiler);
+
+	_dynamicResolution.EndFrame(commandBuffer);
+	_profiler.EndGpuZone(commandBuffer);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::RecordCommandBuffer::EndCommandBuffer" << std::endl;
+		exit(-1);
+	}
+}
+
+// Draws the scene into the scene image, its contents all come from the secondary command buffers
+void Renderer::_RecordScenePass(VkCommandBuffer commandBuffer) {
+	VkRenderPassBeginInfo render_pass_begin_info{};
+	render_pass_begin_info.sType				= VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	render_pass_begin_info.renderPass			= _renderPass;
+	render_pass_begin_info.framebuffer			= _framebuffer;
+	render_pass_begin_info.renderArea.offset	= { 0, 0 };
+	render_pass_begin_info.renderArea.extent	= _renderExtent;
+
+	// Define what the clear colour value should be
+	std::array<VkClearValue, 2> clearValues{};
+	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+	render_pass_begin_info.clearValueCount	= static_cast<uint32_t>(clearValues.size());
+	render_pass_begin_info.pClearValues		= clearValues.data();
+
+	vkCmdBeginRenderPass(commandBuffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		if (!_sceneCommandBuffers.empty()) {
+			vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(_sceneCommandBuffers.size()), _sceneCommandBuffers.data());
+		}
+
+	vkCmdEndRenderPass(commandBuffer);
 }
 
-// Creates syncronisation objects used in the rendering (fences and semaphores)
+// Runs FXAA over the rendered region of the scene image and writes the result, scaled up, over the whole of the
+// swapchain image
+void Renderer::_RecordPostProcess(VkCommandBuffer commandBuffer) {
+	VkRenderPassBeginInfo render_pass_begin_info{};
+	render_pass_begin_info.sType				= VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	render_pass_begin_info.renderPass			= _postRenderPass;
+	render_pass_begin_info.framebuffer			= _postFramebuffers[_imageIndex];
+	render_pass_begin_info.renderArea.offset	= { 0, 0 };
+	render_pass_begin_info.renderArea.extent	= _swapChainExtent;
+	vkCmdBeginRenderPass(commandBuffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _postPipeline);
+
+	VkViewport viewport{};
+	viewport.width = (float)_swapChainExtent.width;
+	viewport.height = (float)_swapChainExtent.height;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.extent = _swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _postPipelineLayout, 0, 1, &_postSet, 0, nullptr);
+
+	PostConstants postConstants{};
+	postConstants.uvScaleX		= _renderExtent.width / (float)_swapChainExtent.width;
+	postConstants.uvScaleY		= _renderExtent.height / (float)_swapChainExtent.height;
+	postConstants.texelWidth	= 1.0f / _swapChainExtent.width;
+	postConstants.texelHeight	= 1.0f / _swapChainExtent.height;
+	postConstants.uvMaxX		= (_renderExtent.width - 0.5f) / _swapChainExtent.width;
+	postConstants.uvMaxY		= (_renderExtent.height - 0.5f) / _swapChainExtent.height;
+	vkCmdPushConstants(commandBuffer, _postPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PostConstants), &postConstants);
+
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+// Blits the rendered region of the scene image over the whole of the swapchain image, the render graph has already
+// moved both into the transfer layouts
+void Renderer::_RecordUpscale(VkCommandBuffer commandBuffer) {
+	VkImageBlit image_blit{};
+	image_blit.srcSubresource.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	image_blit.srcSubresource.mipLevel			= 0;
+	image_blit.srcSubresource.baseArrayLayer	= 0;
+	image_blit.srcSubresource.layerCount		= 1;
+	image_blit.srcOffsets[0]					= { 0, 0, 0 };
+	image_blit.srcOffsets[1]					= { static_cast<int32_t>(_renderExtent.width), static_cast<int32_t>(_renderExtent.height), 1 };
+	image_blit.dstSubresource					= image_blit.srcSubresource;
+	image_blit.dstOffsets[0]					= { 0, 0, 0 };
+	image_blit.dstOffsets[1]					= { static_cast<int32_t>(_swapChainExtent.width), static_cast<int32_t>(_swapChainExtent.height), 1 };
+	vkCmdBlitImage(commandBuffer, _renderGraph.GetImage(_sceneImage), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _renderGraph.GetImage(_outputImage), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1, &image_blit, _upscaleFilter);
+}
+
+// Creates syncronisation objects used in the rendering (semaphores)
 void Renderer::_CreateSyncObjects() {
 
 	// Ensure the vectors are the correct size
 	_imageAvailableSemaphores.resize(_max_frames_in_flight);
 	_renderFinishedSemaphores.resize(_max_frames_in_flight);
-	_inFlightFences.resize(_max_frames_in_flight);
-	_imagesInFlight.resize(_swapChainImages.size(), VK_NULL_HANDLE);
+	_imageFrames.resize(_swapChainImages.size(), 0);
 
 	VkSemaphoreCreateInfo semaphore_create_info{};
 	semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	VkFenceCreateInfo fence_create_info{};
-	fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
 	// For each potential frame in flight add sync objects
 	for (size_t i = 0; i < _max_frames_in_flight; i++) {
 		if (vkCreateSemaphore(_device, &semaphore_create_info, nullptr, &_imageAvailableSemaphores[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(_device, &semaphore_create_info, nullptr, &_renderFinishedSemaphores[i]) != VK_SUCCESS ||
-			vkCreateFence(_device, &fence_create_info, nullptr, &_inFlightFences[i]) != VK_SUCCESS) {
+			vkCreateSemaphore(_device, &semaphore_create_info, nullptr, &_renderFinishedSemaphores[i]) != VK_SUCCESS) {
 
 			std::cout << "ERROR::Renderer::CreateSemaphores::CreateSemaphore" << std::endl;
 			exit(-1);
 		}
 	}
+
+	// No frames have completed yet
+	VkSemaphoreTypeCreateInfoKHR semaphore_type_create_info{};
+	semaphore_type_create_info.sType			= VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+	semaphore_type_create_info.semaphoreType	= VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+	semaphore_type_create_info.initialValue		= 0;
+
+	VkSemaphoreCreateInfo timeline_create_info{};
+	timeline_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	timeline_create_info.pNext = &semaphore_type_create_info;
+
+	if (vkCreateSemaphore(_device, &timeline_create_info, nullptr, &_frameTimeline) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::CreateSemaphores::CreateTimelineSemaphore" << std::endl;
+		exit(-1);
+	}
 }
 
-void Renderer::_MainLoop() {
+// Queue an object for destruction once every frame recorded up to now has finished on the GPU
+void Renderer::_RetireResource(std::function<void()> destroy) {
+	_retiredResources.push_back({ _frameNumber, destroy });
+}
+
+void Renderer::_DestroyRetiredResources(uint64_t completedFrames) {
+	while (!_retiredResources.empty() && _retiredResources.front().first < completedFrames) {
+		_retiredResources.front().second();
+		_retiredResources.pop_front();
+	}
+}
+
+// Blocks until at least completedFrames frames have finished on the GPU, returns how many actually have
+uint64_t Renderer::_WaitForFrames(uint64_t completedFrames) {
+	uint64_t value = 0;
+	if (_vkGetSemaphoreCounterValue(_device, _frameTimeline, &value) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::WaitForFrames::GetSemaphoreCounterValue" << std::endl;
+		exit(-1);
+	}
+	if (value >= completedFrames) {
+		return value;
+	}
+
+	VkSemaphoreWaitInfoKHR semaphore_wait_info{};
+	semaphore_wait_info.sType			= VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+	semaphore_wait_info.semaphoreCount	= 1;
+	semaphore_wait_info.pSemaphores		= &_frameTimeline;
+	semaphore_wait_info.pValues			= &completedFrames;
+	if (_vkWaitSemaphores(_device, &semaphore_wait_info, UINT64_MAX) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::WaitForFrames::WaitSemaphores" << std::endl;
+		exit(-1);
+	}
+
+	if (_vkGetSemaphoreCounterValue(_device, _frameTimeline, &value) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::WaitForFrames::GetSemaphoreCounterValue" << std::endl;
+		exit(-1);
+	}
+	return value;
+}
+
+// Submits the frame's command buffer, moving the frame timeline on to _frameNumber + 1 once it's done. signalSemaphore
+// is the binary semaphore present waits on, or null when nothing is presented
+void Renderer::_SubmitFrame(VkSemaphore signalSemaphore) {
+	VkSemaphore signalSemaphores[] = { _frameTimeline, signalSemaphore };
+	uint64_t signalValues[] = { _frameNumber + 1, 0 };
+
+	VkTimelineSemaphoreSubmitInfoKHR timeline_submit_info{};
+	timeline_submit_info.sType						= VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	timeline_submit_info.waitSemaphoreValueCount	= static_cast<uint32_t>(_frameWaitValues.size());
+	timeline_submit_info.pWaitSemaphoreValues		= _frameWaitValues.data();
+	timeline_submit_info.signalSemaphoreValueCount	= signalSemaphore != VK_NULL_HANDLE ? 2 : 1;
+	timeline_submit_info.pSignalSemaphoreValues		= signalValues;
+
+	VkSubmitInfo submit_info{};
+	submit_info.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext					= &timeline_submit_info;
+	submit_info.waitSemaphoreCount		= static_cast<uint32_t>(_frameWaitSemaphores.size());
+	submit_info.pWaitSemaphores			= _frameWaitSemaphores.data();
+	submit_info.pWaitDstStageMask		= _frameWaitStages.data();
+	submit_info.commandBufferCount		= 1;
+	submit_info.pCommandBuffers			= &_commandBuffers[_currentFrame];
+	submit_info.signalSemaphoreCount	= timeline_submit_info.signalSemaphoreValueCount;
+	submit_info.pSignalSemaphores		= signalSemaphores;
+
+	ProfileScope scope(_profiler, "QueueSubmit");
+	if (vkQueueSubmit(_graphicsQueue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		std::cout << "ERROR::Renderer::SubmitFrame::QueueSubmit" << std::endl;
+		exit(-1);
+	}
+}
+
+uint32_t Renderer::_AddStartupStage(TaskGraph& graph, const char* name, std::function<void()> stage, const std::vector<uint32_t>& dependencies) {
+	return graph.Add([this, name, stage]() {
+		auto start = std::chrono::steady_clock::now();
+		stage();
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::lock_guard<std::mutex> lock(_startupTimingsMutex);
+		_startupTimings.push_back({ name, elapsed.count() });
+	}, dependencies);
+}
 
-	while (!glfwWindowShouldClose(_window)) {
-		
+void Renderer::_RecordFrameTime() {
+	auto now = std::chrono::steady_clock::now();
+	if (_frameStarted) {
+		_frameTimes.push_back(std::chrono::duration<double, std::milli>(now - _lastFrameStart).count());
+	}
+	_lastFrameStart = now;
+	_frameStarted = true;
+}
 
-		glfwPollEvents();
-		_DrawFrame();
+void Renderer::_LimitFrameRate() {
+	if (_frameInterval == std::chrono::steady_clock::duration::zero()) {
+		return;
+	}
+
+	// A frame that ran long starts the schedule again from now rather than rushing the next few to catch up
+	auto now = std::chrono::steady_clock::now();
+	if (_nextFrameDeadline < now - _frameInterval) {
+		_nextFrameDeadline = now;
+	}
+	if (_nextFrameDeadline > now) {
+		ProfileScope scope(_profiler, "LimitFrameRate");
+		std::this_thread::sleep_until(_nextFrameDeadline);
+	}
+	_nextFrameDeadline += _frameInterval;
+}
+
+void Renderer::_MainLoop() {
+
+	if (_settings.headless) {
+		// There is no window to close so just render the requested amount of frames
+		uint32_t frames = std::max(_settings.frameCount, 1u);
+		for (uint32_t i = 0; i < frames; i++) {
+			_LimitFrameRate();
+			_DrawOffscreenFrame();
+		}
+	} else {
+		uint32_t frames = 0;
+		while (!glfwWindowShouldClose(_window)) {
+			_LimitFrameRate();
+			glfwPollEvents();
+			_DrawFrame();
+
+			// Stop early if only a fixed amount of frames were requested
+			if (_settings.frameCount && ++frames >= _settings.frameCount) {
+				break;
+			}
+		}
 	}
 
 	// Wait for async operations to finish before cleaning up
@@ -1757,56 +3041,50 @@ void Renderer::_MainLoop() {
 
 // Aquire image from swapchain, execute the command buffer with that image as attachment in the framebuffer and return the image to the swap chain
 void Renderer::_DrawFrame() {
+	ProfileScope scope(_profiler, "DrawFrame");
+	_RecordFrameTime();
 
-	// If the current frame is inflight wait for the signal from the fence for the current frame (GPU-CPU sync)
-	vkWaitForFences(_device, 1, &_inFlightFences[_currentFrame], VK_TRUE, UINT64_MAX);
+	// Wait for the frame that last used this frame in flight's command buffers and semaphores (GPU-CPU sync)
+	_profiler.BeginZone("WaitForFrame");
+	uint64_t completedFrames = _WaitForFrames(_frameNumber + 1 - std::min<uint64_t>(_frameNumber + 1, _max_frames_in_flight));
+	_profiler.EndZone();
 
-	// First aquire an image from the swap chain.
-	// UINT64_MAX for the timeout disables the timeout
-	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(_device, _swapChain, UINT64_MAX, _imageAvailableSemaphores[_currentFrame], VK_NULL_HANDLE, &imageIndex);
+	// Anything the completed frames were using can be reused or destroyed
+	_uploadQueue.Recycle(completedFrames);
+	_DestroyRetiredResources(completedFrames);
 
-	// If the swap chain has become incompatible recreate it and skip this frame
-	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-		_RecreateSwapChain();
+	// Swap in anything the asset loader has finished with
+	_InstallLoadedAssets(false);
+
+	// Low latency aquires the image as late as it can, after the frame's CPU work, so the frame is presented as soon as
+	// possible after it was simulated. Otherwise the image is aquired first
+	bool lateAcquire = _settings.presentProfile == PresentProfile::LowLatency;
+	uint32_t imageIndex;
+	if (!lateAcquire && !_AcquireNextImage(imageIndex, completedFrames)) {
 		return;
-	} else if(result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-		std::cout << "ERROR::Renderer::Mainloop::DrawFrame::FailedToAquireSwapChainImage" << std::endl;
-		exit(-1);
 	}
 
+	// Update the instance data now that the frame's region of the buffer is no longer in use
+	_profiler.BeginZone("UpdateFrameData");
+	_UpdateFrameData();
+	_profiler.EndZone();
+	_profiler.BeginZone("BuildDrawCommands");
+	_BuildDrawCommands();
+	_profiler.EndZone();
 
-	// Check if a frame is already using this image, if there is then wait on that fence
-	if (_imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
-		vkWaitForFences(_device, 1, &_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+	if (lateAcquire && !_AcquireNextImage(imageIndex, completedFrames)) {
+		return;
 	}
-	// Mark the image as being in use by this frame
-	_imagesInFlight[imageIndex] = _inFlightFences[_currentFrame];
-
-	// Update the uniforms for the shaders now that we know what image is going to be aquired 
-	_UpdateUniformBuffer(imageIndex);
 
+	// Then record the frame's commands against the aquired image
+	_profiler.BeginZone("RecordCommandBuffer");
+	_RecordCommandBuffer(_commandBuffers[_currentFrame], imageIndex);
+	_profiler.EndZone();
 
-	VkSemaphore waitSemaphores[] = { _imageAvailableSemaphores[_currentFrame] };
-	VkSemaphore signalSemaphores[] = { _renderFinishedSemaphores[_currentFrame] };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	VkSubmitInfo submit_info{};
-	submit_info.sType				= VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.waitSemaphoreCount	= 1;
-	submit_info.pWaitSemaphores		= waitSemaphores;
-	submit_info.pWaitDstStageMask	= waitStages;
-	submit_info.commandBufferCount	= 1;
-	submit_info.pCommandBuffers		= &_commandBuffers[imageIndex];
-	submit_info.signalSemaphoreCount = 1;
-	submit_info.pSignalSemaphores = signalSemaphores;
-	
-	// Reset the fence for the current frame
-	vkResetFences(_device, 1, &_inFlightFences[_currentFrame]);
 
 	// Submit the command buffer to the graphics queue
-	if (vkQueueSubmit(_graphicsQueue, 1, &submit_info, _inFlightFences[_currentFrame]) != VK_SUCCESS) {
-		throw std::runtime_error("failed to submit draw command buffer!");
-	}
+	VkSemaphore signalSemaphores[] = { _renderFinishedSemaphores[_currentFrame] };
+	_SubmitFrame(signalSemaphores[0]);
 
 	// Now present the frame to the surface
 	VkSwapchainKHR swapChains[] = { _swapChain };
@@ -1820,7 +3098,9 @@ void Renderer::_DrawFrame() {
 	present_info.pResults			= nullptr; // Takes an array of VkResult so success can be validated
 
 	// Submit the request to present an image to the swap chain
-	result = vkQueuePresentKHR(_presentQueue, &present_info);
+	_profiler.BeginZone("QueuePresent");
+	VkResult result = vkQueuePresentKHR(_presentQueue, &present_info);
+	_profiler.EndZone();
 
 	// If window resized then recreate the swapchain for the next frame to be drawn
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || _framebufferResize) {
@@ -1833,26 +3113,233 @@ void Renderer::_DrawFrame() {
 
 	// Increment and loop current frame back round
 	_currentFrame = (_currentFrame + 1) % _max_frames_in_flight;
+	_frameNumber++;
+}
+
+// Aquires the next swapchain image for the current frame and sets up the frame's wait semaphores. Returns false if the
+// swapchain was out of date, it has been recreated and the frame should be skipped
+bool Renderer::_AcquireNextImage(uint32_t& imageIndex, uint64_t completedFrames) {
+
+	// UINT64_MAX for the timeout disables the timeout
+	_profiler.BeginZone("AcquireNextImage");
+	VkResult result = vkAcquireNextImageKHR(_device, _swapChain, UINT64_MAX, _imageAvailableSemaphores[_currentFrame], VK_NULL_HANDLE, &imageIndex);
+	_profiler.EndZone();
+
+	// If the swap chain has become incompatible recreate it and skip this frame
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		_RecreateSwapChain();
+		return false;
+	} else if(result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+		std::cout << "ERROR::Renderer::Mainloop::DrawFrame::FailedToAquireSwapChainImage" << std::endl;
+		exit(-1);
+	}
+
+	// Check if an earlier frame is still rendering to this image, if there is then wait for it
+	if (_imageFrames[imageIndex] > completedFrames) {
+		ProfileScope imageScope(_profiler, "WaitForImage");
+		_WaitForFrames(_imageFrames[imageIndex]);
+	}
+	// Mark the image as being in use by this frame
+	_imageFrames[imageIndex] = _frameNumber + 1;
+
+	// Recording may add the upload timeline to wait on after the image aquire
+	_frameWaitSemaphores = { _imageAvailableSemaphores[_currentFrame] };
+	_frameWaitValues = { 0 };
+	_frameWaitStages = { _acquireWaitStage };
+	return true;
+}
+
+// Render a frame into the offscreen target, there is no swapchain so nothing is aquired or presented
+void Renderer::_DrawOffscreenFrame() {
+	ProfileScope scope(_profiler, "DrawOffscreenFrame");
+	_RecordFrameTime();
+
+	// Wait for the frame that last used this frame in flight's command buffers
+	_profiler.BeginZone("WaitForFrame");
+	uint64_t completedFrames = _WaitForFrames(_frameNumber + 1 - std::min<uint64_t>(_frameNumber + 1, _max_frames_in_flight));
+	_profiler.EndZone();
+	_uploadQueue.Recycle(completedFrames);
+	_DestroyRetiredResources(completedFrames);
+
+	// Swap in anything the asset loader has finished with
+	_InstallLoadedAssets(false);
+
+	// There is only one target image so wait on whichever frame is still rendering to it
+	uint32_t imageIndex = 0;
+	if (_imageFrames[imageIndex] > completedFrames) {
+		ProfileScope imageScope(_profiler, "WaitForImage");
+		_WaitForFrames(_imageFrames[imageIndex]);
+	}
+	_imageFrames[imageIndex] = _frameNumber + 1;
+
+	// Nothing is aquired so the only semaphore waited on is the upload timeline
+	_frameWaitSemaphores.clear();
+	_frameWaitValues.clear();
+	_frameWaitStages.clear();
+
+	_profiler.BeginZone("UpdateFrameData");
+	_UpdateFrameData();
+	_profiler.EndZone();
+	_profiler.BeginZone("BuildDrawCommands");
+	_BuildDrawCommands();
+	_profiler.EndZone();
+	_profiler.BeginZone("RecordCommandBuffer");
+	_RecordCommandBuffer(_commandBuffers[_currentFrame], imageIndex);
+	_profiler.EndZone();
+
+	_SubmitFrame(VK_NULL_HANDLE);
+
+	_currentFrame = (_currentFrame + 1) % _max_frames_in_flight;
+	_frameNumber++;
 }
 
-void Renderer::_UpdateUniformBuffer(uint32_t currentImage) {
+bool Renderer::ReadbackFrame(std::vector<uint8_t>& pixels, uint32_t& width, uint32_t& height) {
+	// Swapchain images are owned by the presentation engine so only the offscreen target can be read back
+	if (!_settings.headless) {
+		std::cout << "ERROR::Renderer::ReadbackFrame::NotHeadless" << std::endl;
+		return false;
+	}
+
+	// Make sure the last frame has finished rendering
+	vkDeviceWaitIdle(_device);
+
+	width = _swapChainExtent.width;
+	height = _swapChainExtent.height;
+	VkDeviceSize imageSize = (VkDeviceSize)width * (VkDeviceSize)height * 4;
+
+	VkBuffer readbackBuffer;
+	Allocation readbackBufferMemory;
+	_CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, readbackBufferMemory);
+
+	// The upscale leaves the target in TRANSFER_SRC_OPTIMAL so it can be copied straight away
+	VkCommandBuffer commandBuffer = _BeginSingleTimeCommands();
+
+	VkBufferImageCopy buffer_image_copy{};
+	buffer_image_copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	buffer_image_copy.imageSubresource.mipLevel = 0;
+	buffer_image_copy.imageSubresource.baseArrayLayer = 0;
+	buffer_image_copy.imageSubresource.layerCount = 1;
+	buffer_image_copy.imageExtent = { width, height, 1 };
+
+	vkCmdCopyImageToBuffer(commandBuffer, _swapChainImages[0], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &buffer_image_copy);
+
+	// Make the transfer visible to the host before mapping
+	VkMemoryBarrier memory_barrier{};
+	memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+	_EndSingleTimeCommands(commandBuffer);
+
+	pixels.resize(static_cast<size_t>(imageSize));
+	memcpy(pixels.data(), readbackBufferMemory.mapped, static_cast<size_t>(imageSize));
+
+	// Swizzle into RGBA if the target ended up being BGRA
+	if (_swapChainFormat == VK_FORMAT_B8G8R8A8_SRGB) {
+		for (size_t i = 0; i < pixels.size(); i += 4) {
+			std::swap(pixels[i], pixels[i + 2]);
+		}
+	}
+
+	vkDestroyBuffer(_device, readbackBuffer, nullptr);
+	_allocator.Free(readbackBufferMemory);
+
+	return true;
+}
+
+AllocatorStats Renderer::GetMemoryStats() {
+	return _allocator.GetStats();
+}
+
+void Renderer::_UpdateFrameData() {
 
 	// Get the time from the start of the rendering
 	static auto startTime = std::chrono::high_resolution_clock::now();
 	auto currentTime = std::chrono::high_resolution_clock::now();
 	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
 
-	UniformBufferObject ubo{};
-	ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.proj = glm::perspective(glm::radians(30.0f), _swapChainExtent.width / (float)_swapChainExtent.height, 0.1f, 10.0f);
+	// The camera only changes when the swapchain is recreated
+	if (_cameraDirty) {
+		_cameraView = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		_cameraProj = glm::perspective(glm::radians(30.0f), _swapChainExtent.width / (float)_swapChainExtent.height, 0.1f, 10.0f);
 
-	// Flip the Y coordinate since GLM is designed for OpenGL and vulkan has the opposite of OpenGL
-	ubo.proj[1][1] *= -1;
+		// Flip the Y coordinate since GLM is designed for OpenGL and vulkan has the opposite of OpenGL
+		_cameraProj[1][1] *= -1;
+		_cameraDirty = false;
+	}
+
+	// Every object spins the same way about its own origin for now
+	float halfAngle = time * glm::radians(90.0f) * 0.5f;
+	float spinZ = std::sin(halfAngle);
+	float spinW = std::cos(halfAngle);
+	uint32_t objectCount = _scene.GetCount();
+	const uint32_t objectsPerTask = 4096;
+
+	_profiler.BeginZone("UpdateTransforms");
+	_threadPool.ParallelFor((objectCount + objectsPerTask - 1) / objectsPerTask, [this, objectCount, objectsPerTask, spinZ, spinW](uint32_t task, uint32_t worker) {
+		uint32_t end = std::min(objectCount, (task + 1) * objectsPerTask);
+		for (uint32_t i = task * objectsPerTask; i < end; i++) {
+			_scene.SetRotation(i, 0.0f, 0.0f, spinZ, spinW);
+		}
+	});
+	_scene.UpdateTransforms(_threadPool);
+	_profiler.EndZone();
+
+	// World space bounding spheres for every object, the spin is about the object's origin so it moves off centre spheres
+	_profiler.BeginZone("UpdateBounds");
+	_scene.ComputeBounds(&_mesh.boundingSphere[0], _objectBounds, _threadPool);
+	_profiler.EndZone();
+
+	// Only what survives culling gets instance data, packed so the draws can use one instance range
+	_profiler.BeginZone("FrustumCull");
+	glm::mat4 viewProj = _cameraProj * _cameraView;
+	_frustumCuller.SetViewProjection(&viewProj[0][0]);
+	_visibleCount = std::min(_frustumCuller.Cull(_objectBounds, _threadPool, _visibleObjects), _maxInstances);
+	_profiler.EndZone();
+
+	// Write this frame's instance data straight into the mapped buffer, split across the workers for big scenes. The model
+	// view projection is worked out here once per object rather than once per vertex in the shader
+	InstanceData* instances = reinterpret_cast<InstanceData*>(static_cast<char*>(_instanceMemory.mapped) + _currentFrame * _instanceFrameSize);
+	uint32_t visibleCount = _visibleCount;
+
+	_profiler.BeginZone("WriteInstances");
+	_threadPool.ParallelFor((visibleCount + objectsPerTask - 1) / objectsPerTask, [&](uint32_t task, uint32_t worker) {
+		uint32_t begin = task * objectsPerTask;
+		uint32_t end = std::min(visibleCount, begin + objectsPerTask);
+		_scene.ComputeModelViewProjections(&viewProj[0][0], &_visibleObjects[begin], end - begin, &instances[begin].modelViewProj[0][0], sizeof(InstanceData));
+		for (uint32_t i = begin; i < end; i++) {
+			instances[i].materialIndex = _materialTextures[_renderObjects[_visibleObjects[i]].materialIndex];
+		}
+	});
+	_profiler.EndZone();
+}
 
-	// Acctually move the data into the ubo memory buffer
-	void* data;
-	vkMapMemory(_device, _uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(_device, _uniformBuffersMemory[currentImage]);
+// Fills this frame's region of the indirect buffer, the visible objects are packed from instance 0 so each submesh is one command
+void Renderer::_BuildDrawCommands() {
+	char* frame = static_cast<char*>(_indirectMemory.mapped) + _currentFrame * _indirectFrameSize;
+	uint32_t* sliceCounts = reinterpret_cast<uint32_t*>(frame);
+	VkDrawIndexedIndirectCommand* commands = reinterpret_cast<VkDrawIndexedIndirectCommand*>(frame + _indirectCommandsOffset);
+
+	// One command per submesh, every visible object is an instance of the whole mesh
+	uint32_t instanceCount = _visibleCount;
+	_indirectCommandCount = 0;
+	for (const MeshSubmesh& submesh : _mesh.submeshes) {
+		if (!instanceCount || _indirectCommandCount == _maxIndirectCommands) {
+			break;
+		}
+
+		VkDrawIndexedIndirectCommand& command = commands[_indirectCommandCount++];
+		command.indexCount = submesh.indexCount;
+		command.instanceCount = instanceCount;
+		command.firstIndex = submesh.firstIndex;
+		command.vertexOffset = submesh.vertexOffset;
+		command.firstInstance = 0;
+	}
+
+	// The count buffer holds how many commands each secondary command buffer draws
+	uint32_t sliceCount = (_indirectCommandCount + _drawsPerSecondary - 1) / _drawsPerSecondary;
+	for (uint32_t slice = 0; slice < sliceCount; slice++) {
+		sliceCounts[slice] = std::min(_drawsPerSecondary, _indirectCommandCount - slice * _drawsPerSecondary);
+	}
 }
@@ -9,6 +9,11 @@
 #include <fstream>
 #include <chrono>
 #include <numeric>
+#include <cstring>
+#include <cfloat>
+#include <deque>
+#include <functional>
+#include <unordered_map>
 
 // Maths headers
 #define GLM_FORCE_RADIANS
@@ -18,25 +23,59 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 // Include structs
+#include "Allocator.h"
+#include "UploadQueue.h"
+#include "PipelineCache.h"
+#include "ThreadPool.h"
+#include "TaskGraph.h"
+#include "Culling.h"
+#include "Scene.h"
+#include "AssetLoader.h"
+#include "Profiler.h"
+#include "DynamicResolution.h"
+#include "RenderGraph.h"
+#include "MipGenerator.h"
+#include "MeshFile.h"
+#include "KtxFile.h"
 #include "Renderer Structs.h"
 
 class Renderer {
 public:
-	Renderer();
+	Renderer(const RendererSettings& settings = RendererSettings());
 	~Renderer();
 
+	// Copies the last rendered frame into tightly packed RGBA8 pixels, only availiable when headless
+	bool ReadbackFrame(std::vector<uint8_t>& pixels, uint32_t& width, uint32_t& height);
+
+	// Usage and fragmentation of the device memory blocks
+	AllocatorStats GetMemoryStats();
+
+	// How long each constructor stage took and the time between consecutive frames, both in milliseconds
+	// Stages run in parallel so the startup time, from construction to the first frame, is less than their sum
+	double GetStartupTime() const { return _startupTime; }
+	const std::vector<std::pair<const char*, double>>& GetStartupTimings() const { return _startupTimings; }
+	const std::vector<double>& GetFrameTimes() const { return _frameTimes; }
+
 private:
+	// The benchmark drives uploads and extra frames through the internals directly
+	friend class Benchmark;
+
+	RendererSettings _settings;
+
 	// Pointer to the window and window width/height
-	GLFWwindow* _window;
+	GLFWwindow* _window = nullptr;
 	uint32_t _width = 800;
 	uint32_t _height = 600;
 
-	// Requested layers for debugging
+	// Requested layers for debugging, disabled at startup if the layers are not installed
 	std::vector<const char*> _requestedLayers = { "VK_LAYER_KHRONOS_validation" };
-	const bool _enableDebug = true;
+	bool _enableDebug = true;
 
 	// Required device extensions
-	std::vector<const char*> _requiredDeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	std::vector<const char*> _requiredDeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME };
+
+	// Enabled when the device supports it, reports whether pipelines came out of the pipeline cache
+	bool _creationFeedbackSupported = false;
 	
 	// All vulkan member attributes
 	VkInstance _instance = nullptr;
@@ -46,6 +85,35 @@ private:
 	VkDevice _device = nullptr;
 	VkQueue _graphicsQueue = nullptr;
 	VkQueue _presentQueue = nullptr;
+	VkQueue _transferQueue = nullptr;
+
+	// CPU zones in the frame loop and initialisation plus GPU timestamps, written out as a Chrome trace on exit
+	Profiler _profiler;
+
+	// All buffer and image memory is sub allocated from here
+	Allocator _allocator;
+
+	// Buffer and image contents are uploaded asynchronously on the transfer queue
+	UploadQueue _uploadQueue;
+
+	// Latest batch holding uploads of the mesh and texture in use, nothing is drawn until it has been acquired
+	uint64_t _sceneUploadBatch = 0;
+
+	// The mesh and texture drawn with, placeholders until the real ones have been loaded in the background and uploaded
+	MeshResource _mesh;
+	TextureResource _texture;
+
+	// Assets finished by the loader's threads, installed by the main thread once their uploads have been acquired
+	AssetLoader _assetLoader;
+	std::mutex _loadedAssetsMutex;
+	std::vector<MeshResource> _loadedMeshes;
+	std::vector<TextureResource> _loadedTextures;
+
+	// Asset files are opened during initialisation and closed by the loads once their data has been staged
+	MeshFile _meshFile;
+	KtxFile _textureFile;
+	bool _meshFileOpen = false;
+	bool _textureFileOpen = false;
 
 	// Swapchain members
 	VkSwapchainKHR _swapChain;
@@ -54,78 +122,152 @@ private:
 	VkExtent2D _swapChainExtent;
 	std::vector<VkImageView> _swapChainImageViews;
 
+	// When headless the single 'swapchain' image is a device owned image backed by this memory
+	Allocation _offscreenImageMemory;
+
 	// Graphics pipeline memebers
+	PipelineCache _pipelineCache;
 	VkRenderPass _renderPass;
 	VkDescriptorSetLayout _descriptorSetLayout;
 	VkPipelineLayout _pipelineLayout;
+
+	// Every variant created so far by key, _pipeline is the scene's variant out of them
+	std::unordered_map<uint64_t, VkPipeline> _pipelines;
+	PipelineVariant _pipelineVariant;
 	VkPipeline _pipeline;
 
-	// Framebuffer members
-	std::vector<VkFramebuffer> _framebuffers;
+	// SPIR-V for the pipeline's shaders, read once at startup
+	std::vector<char> _vertShaderCode;
+	std::vector<char> _fragShaderCode;
+	std::vector<char> _fragBindlessShaderCode;
+	std::vector<char> _fullscreenShaderCode;
+	std::vector<char> _fxaaShaderCode;
+	std::vector<char> _downsampleShaderCode;
 
-	// Commandbuffer stuff
+	// Fills in the mip chains of textures that come without one
+	MipGenerator _mipGenerator;
+
+	// Framebuffer members, every frame renders into the same attachments so there is one framebuffer
+	VkFramebuffer _framebuffer;
+
+	// Commandbuffer stuff, one command buffer per frame in flight recorded every frame
 	VkCommandPool _commandPool;
 	std::vector<VkCommandBuffer> _commandBuffers;
+
+	// Draws are recorded into secondary command buffers by the worker threads, each worker has a pool per frame in flight
+	// Every secondary issues up to _drawsPerSecondary indirect draw commands
+	ThreadPool _threadPool;
+	std::vector<std::vector<WorkerCommands>> _workerCommands;
+	const uint32_t _drawsPerSecondary = 256;
 	
-	// For vertex buffers 
-	VkDeviceMemory _vertexBufferMemory;
-	VkBuffer _vertexBuffer;
-	VkDeviceMemory _indexBufferMemory;
-	VkBuffer _indexBuffer;
-	
-	// For UBO's and stuff
-	std::vector<VkBuffer> _uniformBuffers;
-	std::vector<VkDeviceMemory> _uniformBuffersMemory;
+	// Holds the instance buffer and, without bindless, the texture
 	VkDescriptorPool _descriptorPool;
-	std::vector<VkDescriptorSet> _descriptorSets;
+	VkDescriptorSet _descriptorSet;
 
-	// For syncronising and having frames in flight
+	// Bindless textures, one update after bind array in set 1 indexed by each instance's material. Slots of replaced
+	// textures are reused once they've been retired, _materialTextures maps a material to its texture's slot
+	bool _bindless = false;
+	uint32_t _maxBindlessTextures = 4096;
+	VkDescriptorSetLayout _bindlessSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool _bindlessPool = VK_NULL_HANDLE;
+	VkDescriptorSet _bindlessSet = VK_NULL_HANDLE;
+	uint32_t _bindlessSlotCount = 0;
+	std::vector<uint32_t> _freeBindlessSlots;
+	std::vector<uint32_t> _materialTextures = { 0 };
+
+	// Objects drawn every frame
+	std::vector<RenderObject> _renderObjects;
+	Scene _scene;
+
+	// Bounding spheres of the objects are frustum culled each frame, only the visible ones get instance data
+	BoundingSpheres _objectBounds;
+	FrustumCuller _frustumCuller;
+	std::vector<uint32_t> _visibleObjects;
+	uint32_t _visibleCount = 0;
+
+	// Per instance transforms and material indices, one region per frame in flight selected by the pushed instance offset
+	VkBuffer _instanceBuffer;
+	Allocation _instanceMemory;
+	uint32_t _maxInstances = 0;
+	VkDeviceSize _instanceFrameSize = 0;
+
+	// Indexed indirect draw commands built each frame, one region per frame in flight laid out as
+	// [draw count of each secondary command buffer][VkDrawIndexedIndirectCommand...]
+	VkBuffer _indirectBuffer;
+	Allocation _indirectMemory;
+	const uint32_t _maxIndirectCommands = 1024;
+	VkDeviceSize _indirectCommandsOffset = 0;
+	VkDeviceSize _indirectFrameSize = 0;
+	uint32_t _indirectCommandCount = 0;
+
+	// Optional indirect features, without them commands are issued one vkCmdDrawIndexedIndirect at a time
+	bool _multiDrawIndirectSupported = false;
+	bool _drawIndirectFirstInstanceSupported = false;
+	PFN_vkCmdDrawIndexedIndirectCountKHR _vkCmdDrawIndexedIndirectCount = nullptr;
+
+	// Camera matrices are only recomputed when the view or the swapchain extent changes
+	glm::mat4 _cameraView;
+	glm::mat4 _cameraProj;
+	bool _cameraDirty = true;
+
+	// For syncronising and having frames in flight. Each graphics submission signals _frameTimeline with its frame number + 1,
+	// so the counter is the number of frames that have completed and every CPU wait is for a value of it. The swapchain
+	// only works with binary semaphores so the aquire and present still have one per frame in flight
 	std::vector<VkSemaphore> _imageAvailableSemaphores;
 	std::vector<VkSemaphore> _renderFinishedSemaphores;
-	std::vector<VkFence> _inFlightFences;
-	std::vector<VkFence> _imagesInFlight;
-	const int _max_frames_in_flight = 2;
+	VkSemaphore _frameTimeline = VK_NULL_HANDLE;
+	PFN_vkGetSemaphoreCounterValueKHR _vkGetSemaphoreCounterValue = nullptr;
+	PFN_vkWaitSemaphoresKHR _vkWaitSemaphores = nullptr;
+	std::vector<uint64_t> _imageFrames;
+	int _max_frames_in_flight = 2;
 	size_t _currentFrame = 0;
+	uint64_t _frameNumber = 0;
+
+	// Semaphores the frame's submission waits on, the image aquire plus the upload timeline, values are ignored for binary ones
+	std::vector<VkSemaphore> _frameWaitSemaphores;
+	std::vector<uint64_t> _frameWaitValues;
+	std::vector<VkPipelineStageFlags> _frameWaitStages;
+
+	// Objects that in flight frames may still be using, destroyed once the frame they were retired in has completed
+	std::deque<std::pair<uint64_t, std::function<void()>>> _retiredResources;
 
 	// This is used to handle when the window has been resized
 	bool _framebufferResize = false;
+	VkExtent2D _framebufferSize = { 0, 0 };
 	static void _WindowResized(GLFWwindow*, int, int);
 
-	// Test vertices for now
-	const std::vector<Vertex> _vertices = {
-	{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
-	{{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
-	{{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
-	{{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}},
-
-	{{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
-	{{0.5f, -0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
-	{{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
-	{{-0.5f, 0.5f, -0.5f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}}
-	};
-	const std::vector<uint16_t> _indices = {
-	0, 1, 2, 2, 3, 0,
-	4, 5, 6, 6, 7, 4
-	};
-	
-	// uint16_t since using less than 65535 vertices when changing this the draw command index needs to be changed aswell ( i think )
-
 	// For textures
-	uint32_t _mipmapLevels;
-	VkImage _textureImage;
-	VkDeviceMemory _textureImageMemory;
-	VkImageView _textureImageView;
+	bool _textureCompressionBCSupported = false;
 	VkSampler _textureSampler;
 
-	// For depth attachment
-	VkImage _depthImage;
-	VkDeviceMemory _depthImageMemory;
-	VkImageView _depthImageView;
+	// The frame's passes, the images below are handles into the graph. The output image is the swapchain image being
+	// rendered to (set each frame) or the offscreen target
+	RenderGraph _renderGraph;
+	uint32_t _depthImage = 0;
+	uint32_t _colorImage = 0;
+	uint32_t _outputImage = 0;
+	uint32_t _imageIndex = 0;
+	VkPipelineStageFlags _acquireWaitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	std::vector<VkCommandBuffer> _sceneCommandBuffers;
 
 	VkSampleCountFlagBits _msaaSamples = VK_SAMPLE_COUNT_1_BIT;
-	VkImage _colorImage;
-	VkDeviceMemory _colorImageMemory;
-	VkImageView _colorImageView;
+
+	// The scene is resolved into this full size image then upscaled from the rendered region into the swapchain image
+	DynamicResolution _dynamicResolution;
+	VkExtent2D _renderExtent = { 0, 0 };
+	uint32_t _sceneImage = 0;
+	VkFilter _upscaleFilter = VK_FILTER_LINEAR;
+
+	// FXAA pass, it reads the scene image and writes the swapchain image in place of the upscale blit
+	bool _fxaa = false;
+	VkSampler _postSampler = VK_NULL_HANDLE;
+	VkDescriptorSetLayout _postSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool _postPool = VK_NULL_HANDLE;
+	VkDescriptorSet _postSet = VK_NULL_HANDLE;
+	VkPipelineLayout _postPipelineLayout = VK_NULL_HANDLE;
+	VkRenderPass _postRenderPass = VK_NULL_HANDLE;
+	VkPipeline _postPipeline = VK_NULL_HANDLE;
+	std::vector<VkFramebuffer> _postFramebuffers;
 
 	// Initialisation of Vulkan
 	void _InitWindow();
@@ -145,7 +287,8 @@ private:
 	PhysicalDeviceSurface _GetSwapChainCapabilities(VkPhysicalDevice);
 
 	// Swapchain initialisation methods
-	void _InitSwapChain();
+	void _InitSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
+	void _InitOffscreenTarget();
 	void _DeconstructSwapChain();
 	void _RecreateSwapChain();
 	VkSurfaceFormatKHR _GetSurfaceFormat(std::vector<VkSurfaceFormatKHR>&);
@@ -154,7 +297,16 @@ private:
 
 	// Graphics pipeline
 	void _CreateRenderPass();
+	void _LoadShaderCode();
 	void _CreateGraphicsPipeline();
+	VkPipeline _GetPipeline(const PipelineVariant&);
+	VkPipeline _CreatePipelineVariant(const PipelineVariant&);
+	void _DestroyPipelines();
+
+	// FXAA post process
+	void _CreatePostProcess();
+	void _CreatePostProcessPipeline();
+	void _CreatePostProcessTargets();
 	VkShaderModule _GetShaderModule(const std::vector<char>&);
 
 	// Framebuffer creation methods
@@ -164,48 +316,87 @@ private:
 	bool _HasStencilComponent(VkFormat);
 	VkFormat _FindDepthFormat();
 	VkFormat _FindSupportedFormat(const std::vector<VkFormat>&, VkImageTiling, VkFormatFeatureFlags);
-	void _CreateDepthResources();
 
-	VkSampleCountFlagBits _GetMaxUsableSampleCount();
-	void _CreateColourResources();
+	VkSampleCountFlagBits _GetUsableSampleCount(VkSampleCountFlagBits);
+	void _BuildRenderGraph();
 
 	// For textures
-	void _CreateTextureImage();
-	void _CreateImage(uint32_t, uint32_t, uint32_t, VkSampleCountFlagBits, VkFormat, VkImageTiling, VkImageUsageFlags, VkMemoryPropertyFlags, VkImage&, VkDeviceMemory&);
-	void _TransitionImageLayout(VkImage, VkFormat, VkImageLayout, VkImageLayout, uint32_t);
-	void _CopyBufferToImage(VkBuffer, VkImage, uint32_t, uint32_t);
-	void _CreateTextureImageView();
+	bool _LoadTexture(const std::string& path, KtxFile&, TextureResource&);
+	void _CreateImage(uint32_t, uint32_t, uint32_t, VkSampleCountFlagBits, VkFormat, VkImageTiling, VkImageUsageFlags, VkMemoryPropertyFlags, VkImage&, Allocation&, VkImageCreateFlags flags = 0);
 	VkImageView _CreateImageView(VkImage, VkFormat, VkImageAspectFlags, uint32_t);
 	void _CreateTextureSampler();
-	void _GenerateMipmaps(VkImage, VkFormat, int32_t, int32_t, uint32_t);
+	void _GenerateMipmaps(VkCommandBuffer, VkImage, VkFormat, int32_t, int32_t, uint32_t);
 	
 	// Vertex buffers and helper functions
 	uint32_t _FindMemoryType(uint32_t, VkMemoryPropertyFlags);
-	void _CreateVertexBuffer();
-	void _CreateIndexBuffer();
+	bool _LoadMesh(const std::string& path, MeshFile&, MeshResource&);
+	void _CreateVertexBuffer(const void*, VkDeviceSize, MeshResource&);
+	void _CreateIndexBuffer(const void*, VkDeviceSize, VkIndexType, MeshResource&);
 	VkCommandBuffer _BeginSingleTimeCommands();
 	void _EndSingleTimeCommands(VkCommandBuffer);
-	void _CopyBuffer(VkBuffer, VkBuffer, VkDeviceSize);
-	void _CreateBuffer(VkDeviceSize, VkBufferUsageFlags, VkMemoryPropertyFlags, VkBuffer&, VkDeviceMemory&);
-	void _CreateUniformBuffers();
+	void _CreateBuffer(VkDeviceSize, VkBufferUsageFlags, VkMemoryPropertyFlags, VkBuffer&, Allocation&);
+	void _CreateInstanceBuffers();
 
 	// Descriptor sets are analogous to uniforms in opengl. I think
 	void _CreateDescriptorPool();
 	void _CreateDescriptorSets();
+	void _CreateBindlessSet();
+	uint32_t _AddBindlessTexture(VkImageView);
 	void _CreateDescriptorSetLayout();
 
 	// Commandbuffer stuff
 	void _CreateCommandPool();
 	void _CreateCommandBuffers();
+	void _RecordCommandBuffer(VkCommandBuffer, uint32_t);
+	void _RecordScenePass(VkCommandBuffer);
+	void _RecordUpscale(VkCommandBuffer);
+	void _RecordPostProcess(VkCommandBuffer);
+	VkCommandBuffer _GetSecondaryCommandBuffer(uint32_t worker);
+	void _RecordDraws(VkCommandBuffer, uint32_t slice, uint32_t firstCommand, uint32_t commandCount);
 
 	// Setup semaphores
 	void _CreateSyncObjects();
 
+	// Placeholders are created up front and replaced when the background loads finish
+	void _CreatePlaceholderAssets();
+	void _OpenAssetFiles();
+	void _LoadAssetsAsync();
+	void _InstallLoadedAssets(bool force);
+	void _DestroyMesh(MeshResource&);
+	void _DestroyTexture(TextureResource&);
+
+	// Deferred destruction of objects still referenced by frames in flight
+	void _RetireResource(std::function<void()>);
+	void _DestroyRetiredResources(uint64_t completedFrames);
+	uint64_t _WaitForFrames(uint64_t completedFrames);
+	void _SubmitFrame(VkSemaphore signalSemaphore);
+	bool _AcquireNextImage(uint32_t& imageIndex, uint64_t completedFrames);
+
+	// Adds a constructor stage to the init graph, how long it took is recorded when it runs
+	uint32_t _AddStartupStage(TaskGraph& graph, const char* name, std::function<void()> stage, const std::vector<uint32_t>& dependencies = {});
+	std::vector<std::pair<const char*, double>> _startupTimings;
+	std::mutex _startupTimingsMutex;
+	double _startupTime = 0.0;
+
+	// Wall time between the starts of consecutive frames
+	void _RecordFrameTime();
+	std::vector<double> _frameTimes;
+	std::chrono::steady_clock::time_point _lastFrameStart;
+	bool _frameStarted = false;
+
+	// Sleeps until the next frame is due when the frame rate is limited, deadlines advance by a fixed interval so they
+	// don't drift with how long each sleep overshoots
+	void _LimitFrameRate();
+	std::chrono::steady_clock::duration _frameInterval = std::chrono::steady_clock::duration::zero();
+	std::chrono::steady_clock::time_point _nextFrameDeadline;
+
 	// Post initialisation
 	void _MainLoop();
 	void _DrawFrame();
+	void _DrawOffscreenFrame();
 
-	// For updating shader uniforms
-	void _UpdateUniformBuffer(uint32_t);
+	// For updating the per frame instance data and draw commands
+	void _UpdateFrameData();
+	void _BuildDrawCommands();
 };
 
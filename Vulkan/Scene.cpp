@@ -0,0 +1,280 @@
+#include "Scene.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_SSE
+#include <emmintrin.h>
+#endif
+
+// The transform kernels are written once against these, 4 objects per lane group with SSE and 1 without
+#ifdef SCENE_SSE
+typedef __m128 Lanes;
+static const uint32_t laneCount = 4;
+static inline Lanes Load(const float* p) { return _mm_loadu_ps(p); }
+static inline void Store(float* p, Lanes v) { _mm_storeu_ps(p, v); }
+static inline Lanes Set(float v) { return _mm_set1_ps(v); }
+static inline Lanes Sum(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes Sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes Max(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+static inline Lanes Sqrt(Lanes a) { return _mm_sqrt_ps(a); }
+static inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline Lanes RootMask(const uint32_t* parents) {
+	return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(parents)), _mm_set1_epi32(-1)));
+}
+#else
+typedef float Lanes;
+static const uint32_t laneCount = 1;
+static inline Lanes Load(const float* p) { return *p; }
+static inline void Store(float* p, Lanes v) { *p = v; }
+static inline Lanes Set(float v) { return v; }
+static inline Lanes Sum(Lanes a, Lanes b) { return a + b; }
+static inline Lanes Sub(Lanes a, Lanes b) { return a - b; }
+static inline Lanes Mul(Lanes a, Lanes b) { return a * b; }
+static inline Lanes Max(Lanes a, Lanes b) { return std::max(a, b); }
+static inline Lanes Sqrt(Lanes a) { return std::sqrt(a); }
+static inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return mask != 0.0f ? a : b; }
+static inline Lanes RootMask(const uint32_t* parents) { return *parents == Scene::noParent ? 1.0f : 0.0f; }
+#endif
+
+static const uint32_t paddingMultiple = 4;
+
+uint32_t Scene::Add(uint32_t parent) {
+	uint32_t object = _count;
+	_Resize(_count + 1);
+
+	_parents[object] = parent;
+	_depths[object] = parent == noParent ? 0 : _depths[parent] + 1;
+	if (_depths[object] > 0) {
+		if (_levels.size() < _depths[object]) {
+			_levels.resize(_depths[object]);
+		}
+		_levels[_depths[object] - 1].push_back(object);
+	}
+
+	_localDirty[object] = 1;
+	return object;
+}
+
+void Scene::Reserve(uint32_t count) {
+	size_t padded = (static_cast<size_t>(count) + paddingMultiple - 1) & ~static_cast<size_t>(paddingMultiple - 1);
+	for (std::vector<float>* array : { &_positionX, &_positionY, &_positionZ, &_rotationX, &_rotationY, &_rotationZ, &_rotationW, &_scaleX, &_scaleY, &_scaleZ }) {
+		array->reserve(padded);
+	}
+	for (uint32_t i = 0; i < 12; i++) {
+		_local[i].reserve(padded);
+		_world[i].reserve(padded);
+	}
+	_localDirty.reserve(padded);
+	_worldDirty.reserve(padded);
+	_parents.reserve(padded);
+	_depths.reserve(padded);
+}
+
+void Scene::SetPosition(uint32_t object, float x, float y, float z) {
+	_positionX[object] = x;
+	_positionY[object] = y;
+	_positionZ[object] = z;
+	_localDirty[object] = 1;
+}
+
+void Scene::SetRotation(uint32_t object, float x, float y, float z, float w) {
+	_rotationX[object] = x;
+	_rotationY[object] = y;
+	_rotationZ[object] = z;
+	_rotationW[object] = w;
+	_localDirty[object] = 1;
+}
+
+void Scene::SetScale(uint32_t object, float x, float y, float z) {
+	_scaleX[object] = x;
+	_scaleY[object] = y;
+	_scaleZ[object] = z;
+	_localDirty[object] = 1;
+}
+
+// The padding past _count holds identity transforms with no parent, so the kernels can always run whole lane groups
+void Scene::_Resize(uint32_t count) {
+	_count = count;
+	size_t padded = (static_cast<size_t>(count) + paddingMultiple - 1) & ~static_cast<size_t>(paddingMultiple - 1);
+
+	_positionX.resize(padded, 0.0f);
+	_positionY.resize(padded, 0.0f);
+	_positionZ.resize(padded, 0.0f);
+	_rotationX.resize(padded, 0.0f);
+	_rotationY.resize(padded, 0.0f);
+	_rotationZ.resize(padded, 0.0f);
+	_rotationW.resize(padded, 1.0f);
+	_scaleX.resize(padded, 1.0f);
+	_scaleY.resize(padded, 1.0f);
+	_scaleZ.resize(padded, 1.0f);
+	_localDirty.resize(padded, 0);
+	_worldDirty.resize(padded, 0);
+	_parents.resize(padded, noParent);
+	_depths.resize(padded, 0);
+
+	for (uint32_t row = 0; row < 3; row++) {
+		for (uint32_t column = 0; column < 4; column++) {
+			_local[row * 4 + column].resize(padded, row == column ? 1.0f : 0.0f);
+			_world[row * 4 + column].resize(padded, row == column ? 1.0f : 0.0f);
+		}
+	}
+}
+
+void Scene::UpdateTransforms(ThreadPool& pool) {
+	uint32_t padded = static_cast<uint32_t>(_positionX.size());
+
+	// Local matrices of the changed objects, roots use theirs as their world matrix
+	pool.ParallelFor((padded + _objectsPerTask - 1) / _objectsPerTask, [this, padded](uint32_t task, uint32_t worker) {
+		uint32_t begin = task * _objectsPerTask;
+		_UpdateLocal(begin, std::min(begin + _objectsPerTask, padded));
+	});
+
+	// Then down the hierarchy, a level can only start once the one above it has finished
+	for (const std::vector<uint32_t>& level : _levels) {
+		uint32_t levelCount = static_cast<uint32_t>(level.size());
+		pool.ParallelFor((levelCount + _objectsPerTask - 1) / _objectsPerTask, [this, &level, levelCount](uint32_t task, uint32_t worker) {
+			uint32_t end = std::min((task + 1) * _objectsPerTask, levelCount);
+			for (uint32_t i = task * _objectsPerTask; i < end; i++) {
+				_UpdateChild(level[i]);
+			}
+		});
+	}
+}
+
+void Scene::_UpdateLocal(uint32_t begin, uint32_t end) {
+	const Lanes one = Set(1.0f);
+	const Lanes two = Set(2.0f);
+
+	for (uint32_t i = begin; i < end; i += laneCount) {
+		bool changed = false;
+		for (uint32_t lane = 0; lane < laneCount; lane++) {
+			changed |= _localDirty[i + lane] != 0;
+			_worldDirty[i + lane] = _localDirty[i + lane];
+			_localDirty[i + lane] = 0;
+		}
+		if (!changed) {
+			continue;
+		}
+
+		// Rotation matrix from the quaternion with the scale applied to its columns
+		Lanes qx = Load(&_rotationX[i]), qy = Load(&_rotationY[i]), qz = Load(&_rotationZ[i]), qw = Load(&_rotationW[i]);
+		Lanes sx = Load(&_scaleX[i]), sy = Load(&_scaleY[i]), sz = Load(&_scaleZ[i]);
+
+		Lanes xx = Mul(qx, qx), yy = Mul(qy, qy), zz = Mul(qz, qz);
+		Lanes xy = Mul(qx, qy), xz = Mul(qx, qz), yz = Mul(qy, qz);
+		Lanes wx = Mul(qw, qx), wy = Mul(qw, qy), wz = Mul(qw, qz);
+
+		Lanes local[12];
+		local[0] = Mul(Sub(one, Mul(two, Sum(yy, zz))), sx);
+		local[4] = Mul(Mul(two, Sum(xy, wz)), sx);
+		local[8] = Mul(Mul(two, Sub(xz, wy)), sx);
+		local[1] = Mul(Mul(two, Sub(xy, wz)), sy);
+		local[5] = Mul(Sub(one, Mul(two, Sum(xx, zz))), sy);
+		local[9] = Mul(Mul(two, Sum(yz, wx)), sy);
+		local[2] = Mul(Mul(two, Sum(xz, wy)), sz);
+		local[6] = Mul(Mul(two, Sub(yz, wx)), sz);
+		local[10] = Mul(Sub(one, Mul(two, Sum(xx, yy))), sz);
+		local[3] = Load(&_positionX[i]);
+		local[7] = Load(&_positionY[i]);
+		local[11] = Load(&_positionZ[i]);
+
+		// Unchanged lanes come out the same as before so whole groups are written
+		Lanes root = RootMask(&_parents[i]);
+		for (uint32_t element = 0; element < 12; element++) {
+			Store(&_local[element][i], local[element]);
+			Store(&_world[element][i], Select(root, local[element], Load(&_world[element][i])));
+		}
+	}
+}
+
+// World = parent world * local, both affine
+void Scene::_UpdateChild(uint32_t object) {
+	uint32_t parent = _parents[object];
+	if (!_worldDirty[object] && !_worldDirty[parent]) {
+		return;
+	}
+	_worldDirty[object] = 1;
+
+	for (uint32_t row = 0; row < 3; row++) {
+		float p0 = _world[row * 4 + 0][parent], p1 = _world[row * 4 + 1][parent], p2 = _world[row * 4 + 2][parent], p3 = _world[row * 4 + 3][parent];
+		for (uint32_t column = 0; column < 4; column++) {
+			float value = p0 * _local[column][object] + p1 * _local[4 + column][object] + p2 * _local[8 + column][object];
+			_world[row * 4 + column][object] = column == 3 ? value + p3 : value;
+		}
+	}
+}
+
+void Scene::ComputeBounds(const float sphere[4], BoundingSpheres& bounds, ThreadPool& pool) const {
+	if (bounds.count != _count) {
+		bounds.Resize(_count);
+	}
+	uint32_t padded = static_cast<uint32_t>(_positionX.size());
+
+	pool.ParallelFor((padded + _objectsPerTask - 1) / _objectsPerTask, [this, sphere, &bounds, padded](uint32_t task, uint32_t worker) {
+		const Lanes cx = Set(sphere[0]), cy = Set(sphere[1]), cz = Set(sphere[2]), radius = Set(sphere[3]);
+
+		uint32_t end = std::min((task + 1) * _objectsPerTask, padded);
+		for (uint32_t i = task * _objectsPerTask; i < end; i += laneCount) {
+			Lanes world[12];
+			for (uint32_t element = 0; element < 12; element++) {
+				world[element] = Load(&_world[element][i]);
+			}
+
+			// The centre goes through the whole transform, the radius grows with the largest axis scale
+			Store(&bounds.x[i], Sum(Sum(Mul(world[0], cx), Mul(world[1], cy)), Sum(Mul(world[2], cz), world[3])));
+			Store(&bounds.y[i], Sum(Sum(Mul(world[4], cx), Mul(world[5], cy)), Sum(Mul(world[6], cz), world[7])));
+			Store(&bounds.z[i], Sum(Sum(Mul(world[8], cx), Mul(world[9], cy)), Sum(Mul(world[10], cz), world[11])));
+
+			Lanes scale = Max(Max(
+				Sum(Sum(Mul(world[0], world[0]), Mul(world[4], world[4])), Mul(world[8], world[8])),
+				Sum(Sum(Mul(world[1], world[1]), Mul(world[5], world[5])), Mul(world[9], world[9]))),
+				Sum(Sum(Mul(world[2], world[2]), Mul(world[6], world[6])), Mul(world[10], world[10])));
+			Store(&bounds.radius[i], Mul(radius, Sqrt(scale)));
+		}
+	});
+
+	// The identity transforms in the padding must not turn into visible spheres
+	std::fill(bounds.radius.begin() + _count, bounds.radius.end(), -FLT_MAX);
+}
+
+void Scene::ComputeModelViewProjections(const float viewProjection[16], const uint32_t* objects, uint32_t count, float* out, size_t stride) const {
+#ifdef SCENE_SSE
+	// Each column of the result is a sum of the view projection's columns, so one object is 4 columns of 4 rows at once
+	__m128 column0 = _mm_loadu_ps(viewProjection + 0);
+	__m128 column1 = _mm_loadu_ps(viewProjection + 4);
+	__m128 column2 = _mm_loadu_ps(viewProjection + 8);
+	__m128 column3 = _mm_loadu_ps(viewProjection + 12);
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t object = objects[i];
+		float* matrix = reinterpret_cast<float*>(reinterpret_cast<char*>(out) + stride * i);
+
+		for (uint32_t column = 0; column < 4; column++) {
+			__m128 result = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(column0, _mm_set1_ps(_world[column][object])),
+				_mm_mul_ps(column1, _mm_set1_ps(_world[4 + column][object]))),
+				_mm_mul_ps(column2, _mm_set1_ps(_world[8 + column][object])));
+			if (column == 3) {
+				result = _mm_add_ps(result, column3);
+			}
+			_mm_storeu_ps(matrix + column * 4, result);
+		}
+	}
+#else
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t object = objects[i];
+		float* matrix = reinterpret_cast<float*>(reinterpret_cast<char*>(out) + stride * i);
+
+		for (uint32_t column = 0; column < 4; column++) {
+			for (uint32_t row = 0; row < 4; row++) {
+				float value = viewProjection[row] * _world[column][object] + viewProjection[4 + row] * _world[4 + column][object] + viewProjection[8 + row] * _world[8 + column][object];
+				matrix[column * 4 + row] = column == 3 ? value + viewProjection[12 + row] : value;
+			}
+		}
+	}
+#endif
+}
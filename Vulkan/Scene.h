@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "ThreadPool.h"
+#include "Culling.h"
+
+/*
+
+Scene transforms stored as structure of arrays
+Every object has a local position, rotation (quaternion) and scale and an optional parent. Updates are batched, local
+matrices of changed objects are rebuilt 4 at a time with SSE across the pool's workers, then world matrices are
+pushed down the hierarchy one depth level at a time. Parents have to be added before their children so an object is
+always at a deeper level than its parent
+
+World matrices are affine and only their top three rows are stored, row r column c is World(r, c)[object]
+
+*/
+
+class Scene {
+public:
+	static constexpr uint32_t noParent = UINT32_MAX;
+
+	// New objects have an identity transform, returns the object's index
+	uint32_t Add(uint32_t parent = noParent);
+	void Reserve(uint32_t count);
+	uint32_t GetCount() const { return _count; }
+
+	// Setting any part of the local transform marks the object, and so everything below it, for the next update
+	void SetPosition(uint32_t object, float x, float y, float z);
+	void SetRotation(uint32_t object, float x, float y, float z, float w);
+	void SetScale(uint32_t object, float x, float y, float z);
+
+	// Rebuilds the world matrices of everything changed since the last update
+	void UpdateTransforms(ThreadPool&);
+
+	// World space bounding spheres of every object given one object space sphere (centre xyz, radius w) they all share
+	void ComputeBounds(const float sphere[4], BoundingSpheres&, ThreadPool&) const;
+
+	// Writes viewProjection * world as a column major 4x4 for each of objects, one every stride bytes from out
+	void ComputeModelViewProjections(const float viewProjection[16], const uint32_t* objects, uint32_t count, float* out, size_t stride) const;
+
+	const float* World(uint32_t row, uint32_t column) const { return _world[row * 4 + column].data(); }
+
+private:
+	uint32_t _count = 0;
+
+	// Local transforms
+	std::vector<float> _positionX, _positionY, _positionZ;
+	std::vector<float> _rotationX, _rotationY, _rotationZ, _rotationW;
+	std::vector<float> _scaleX, _scaleY, _scaleZ;
+	std::vector<uint8_t> _localDirty;
+
+	// Hierarchy, objects below the roots are listed by depth so each level can be updated once the one above it is done
+	std::vector<uint32_t> _parents;
+	std::vector<uint32_t> _depths;
+	std::vector<std::vector<uint32_t>> _levels;
+	std::vector<uint8_t> _worldDirty;
+
+	// Top three rows of the local and world matrices, arrays are padded to a multiple of 4
+	std::vector<float> _local[12];
+	std::vector<float> _world[12];
+
+	static const uint32_t _objectsPerTask = 4096;
+
+	void _Resize(uint32_t count);
+	void _UpdateLocal(uint32_t begin, uint32_t end);
+	void _UpdateChild(uint32_t object);
+};
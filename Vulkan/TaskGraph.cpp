@@ -0,0 +1,66 @@
+#include "TaskGraph.h"
+
+#include <algorithm>
+
+uint32_t TaskGraph::Add(std::function<void()> task, const std::vector<uint32_t>& dependencies) {
+	uint32_t id = static_cast<uint32_t>(_tasks.size());
+
+	Task entry;
+	entry.run = std::move(task);
+	entry.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	_tasks.push_back(std::move(entry));
+
+	for (uint32_t dependency : dependencies) {
+		_tasks[dependency].dependents.push_back(id);
+	}
+
+	return id;
+}
+
+void TaskGraph::Run(ThreadPool& pool) {
+	_ready.clear();
+	_waitingOn.resize(_tasks.size());
+	_finished = 0;
+
+	for (uint32_t i = 0; i < _tasks.size(); i++) {
+		_waitingOn[i] = _tasks[i].dependencyCount;
+		if (_waitingOn[i] == 0) {
+			_ready.push_back(i);
+		}
+	}
+
+	// Every worker pulls ready tasks until the whole graph is done, without workers it all runs here in order
+	pool.ParallelFor(std::max(pool.GetThreadCount(), 1u), [this](uint32_t index, uint32_t worker) {
+		_Work();
+	});
+
+	_tasks.clear();
+	_waitingOn.clear();
+}
+
+void TaskGraph::_Work() {
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (true) {
+		_wake.wait(lock, [this]() { return !_ready.empty() || _finished == _tasks.size(); });
+		if (_finished == _tasks.size()) {
+			return;
+		}
+
+		uint32_t id = _ready.front();
+		_ready.pop_front();
+
+		lock.unlock();
+		_tasks[id].run();
+		lock.lock();
+
+		// Anything that was only waiting on this task can start now
+		_finished++;
+		for (uint32_t dependent : _tasks[id].dependents) {
+			if (--_waitingOn[dependent] == 0) {
+				_ready.push_back(dependent);
+			}
+		}
+		_wake.notify_all();
+	}
+}
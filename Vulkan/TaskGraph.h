@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "ThreadPool.h"
+
+/*
+
+Dependency graph of tasks run on a thread pool
+A task starts as soon as every task it depends on has finished, so independent work (file reads, object creation,
+pipeline compiles) overlaps instead of running in the order it was written. Dependencies have to be added before the
+tasks that use them, which keeps the graph free of cycles
+
+*/
+
+class TaskGraph {
+public:
+	// Returns the id later tasks use to depend on this one
+	uint32_t Add(std::function<void()> task, const std::vector<uint32_t>& dependencies = {});
+
+	// Runs every task on the pool's workers and returns once they have all finished, the graph is empty afterwards
+	// Tasks must not use the pool themselves, its workers are all busy running the graph
+	void Run(ThreadPool&);
+
+private:
+	struct Task {
+		std::function<void()> run;
+		std::vector<uint32_t> dependents;
+		uint32_t dependencyCount = 0;
+	};
+
+	std::vector<Task> _tasks;
+
+	// Tasks are queued once their last dependency finishes, idle workers wait on _wake for more
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::deque<uint32_t> _ready;
+	std::vector<uint32_t> _waitingOn;
+	size_t _finished = 0;
+
+	void _Work();
+};
@@ -0,0 +1,77 @@
+#include "ThreadPool.h"
+
+void ThreadPool::Init(uint32_t threadCount) {
+	for (uint32_t i = 0; i < threadCount; i++) {
+		_threads.emplace_back(&ThreadPool::_WorkerLoop, this, i);
+	}
+}
+
+void ThreadPool::Destroy() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+
+	for (auto& thread : _threads) {
+		thread.join();
+	}
+	_threads.clear();
+}
+
+void ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)>& task) {
+	if (count == 0) {
+		return;
+	}
+
+	// Nothing to hand the work to, and waking a thread for a single index costs more than running it
+	if (_threads.empty() || count == 1) {
+		for (uint32_t i = 0; i < count; i++) {
+			task(i, 0);
+		}
+		return;
+	}
+
+	std::lock_guard<std::mutex> dispatchLock(_dispatchMutex);
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_task = &task;
+		_count = count;
+		_next = 0;
+		_busyWorkers = static_cast<uint32_t>(_threads.size());
+		_generation++;
+	}
+	_wake.notify_all();
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done.wait(lock, [this]() { return _busyWorkers == 0; });
+	_task = nullptr;
+}
+
+void ThreadPool::_WorkerLoop(uint32_t worker) {
+	uint64_t generation = 0;
+
+	while (true) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_wake.wait(lock, [&]() { return _stop || _generation != generation; });
+		if (_stop) {
+			return;
+		}
+
+		generation = _generation;
+		const std::function<void(uint32_t, uint32_t)>* task = _task;
+		uint32_t count = _count;
+		lock.unlock();
+
+		// Keep taking the next index until the job runs dry
+		for (uint32_t i = _next.fetch_add(1); i < count; i = _next.fetch_add(1)) {
+			(*task)(i, worker);
+		}
+
+		lock.lock();
+		if (--_busyWorkers == 0) {
+			_done.notify_one();
+		}
+	}
+}
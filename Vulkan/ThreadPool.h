@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/*
+
+Fixed size pool of worker threads
+Work is handed out as a parallel for, each index is run exactly once by whichever worker grabs it next.
+Tasks are told which worker is running them so they can use per worker resources (command pools etc) without locking
+
+*/
+
+class ThreadPool {
+public:
+	void Init(uint32_t threadCount);
+	void Destroy();
+
+	uint32_t GetThreadCount() { return static_cast<uint32_t>(_threads.size()); }
+
+	// Runs task(index, worker) for every index in [0, count) and returns once they have all finished
+	// With no worker threads the tasks run on the calling thread as worker 0
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t worker)>& task);
+
+private:
+	std::vector<std::thread> _threads;
+
+	// Current job, workers wake when the generation changes and pull indices from _next until they run out
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+	const std::function<void(uint32_t, uint32_t)>* _task = nullptr;
+	uint32_t _count = 0;
+	std::atomic<uint32_t> _next{ 0 };
+	uint32_t _busyWorkers = 0;
+	uint64_t _generation = 0;
+	bool _stop = false;
+
+	// Only one parallel for runs at a time
+	std::mutex _dispatchMutex;
+
+	void _WorkerLoop(uint32_t worker);
+};
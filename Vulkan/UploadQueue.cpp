@@ -0,0 +1,490 @@
+#include "UploadQueue.h"
+
+#include <iostream>
+#include <cstring>
+
+// Staging offsets are kept 16 byte aligned, enough for buffer copies and for the texel block size of any image format
+static const VkDeviceSize stagingAlignment = 16;
+
+void UploadQueue::Init(VkPhysicalDevice physicalDevice, VkDevice device, Allocator* allocator, VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily, VkDeviceSize stagingSize) {
+	_device = device;
+	_allocator = allocator;
+	_transferQueue = transferQueue;
+	_transferFamily = transferFamily;
+	_graphicsFamily = graphicsFamily;
+	_stagingSize = stagingSize;
+
+	// Staging memory only needs to be host visible and coherent so writes don't need flushing
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+	VkMemoryPropertyFlags stagingProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	_stagingMemoryType = UINT32_MAX;
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount && _stagingMemoryType == UINT32_MAX; i++) {
+		if ((memoryProperties.memoryTypes[i].propertyFlags & stagingProperties) == stagingProperties) {
+			_stagingMemoryType = i;
+		}
+	}
+	if (_stagingMemoryType == UINT32_MAX) {
+		std::cout << "ERROR::UploadQueue::Init::NoStagingMemoryType" << std::endl;
+		exit(-1);
+	}
+
+	// Command buffers are reset one at a time as batches get reused
+	VkCommandPoolCreateInfo command_pool_create_info{};
+	command_pool_create_info.sType				= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	command_pool_create_info.flags				= VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	command_pool_create_info.queueFamilyIndex	= _transferFamily;
+
+	if (vkCreateCommandPool(_device, &command_pool_create_info, nullptr, &_commandPool) != VK_SUCCESS) {
+		std::cout << "ERROR::UploadQueue::Init::CreateCommandPool" << std::endl;
+		exit(-1);
+	}
+
+	if (!_CreateStagingBuffer(_stagingSize, _stagingBuffer, _stagingMemory)) {
+		std::cout << "ERROR::UploadQueue::Init::CreateStagingBuffer" << std::endl;
+		exit(-1);
+	}
+
+	// The device is created with VK_KHR_timeline_semaphore, batch ids start at 1 so the initial value means nothing has finished
+	_vkGetSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(_device, "vkGetSemaphoreCounterValueKHR");
+	_vkWaitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(_device, "vkWaitSemaphoresKHR");
+
+	VkSemaphoreTypeCreateInfoKHR semaphore_type_create_info{};
+	semaphore_type_create_info.sType			= VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+	semaphore_type_create_info.semaphoreType	= VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+	semaphore_type_create_info.initialValue		= 0;
+
+	VkSemaphoreCreateInfo semaphore_create_info{};
+	semaphore_create_info.sType	= VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphore_create_info.pNext	= &semaphore_type_create_info;
+
+	if (_vkGetSemaphoreCounterValue == nullptr || _vkWaitSemaphores == nullptr || vkCreateSemaphore(_device, &semaphore_create_info, nullptr, &_timeline) != VK_SUCCESS) {
+		std::cout << "ERROR::UploadQueue::Init::CreateTimelineSemaphore" << std::endl;
+		exit(-1);
+	}
+}
+
+void UploadQueue::Destroy() {
+	WaitIdle();
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// Anything still recording never got submitted so it can just be thrown away
+	if (_recording.id) {
+		vkEndCommandBuffer(_recording.commandBuffer);
+		_DestroyBatch(_recording);
+	}
+	for (auto& batch : _finished) {
+		_DestroyBatch(batch);
+	}
+	for (auto& batch : _acquired) {
+		_DestroyBatch(batch);
+	}
+	for (auto& batch : _free) {
+		_DestroyBatch(batch);
+	}
+	_finished.clear();
+	_acquired.clear();
+	_free.clear();
+
+	vkDestroyBuffer(_device, _stagingBuffer, nullptr);
+	_allocator->Free(_stagingMemory);
+
+	// Destroying the pool frees every batch's command buffer
+	vkDestroyCommandPool(_device, _commandPool, nullptr);
+	vkDestroySemaphore(_device, _timeline, nullptr);
+}
+
+uint64_t UploadQueue::UploadBuffer(VkBuffer buffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!_recording.id) {
+		_BeginBatch();
+	}
+
+	VkBuffer srcBuffer;
+	VkDeviceSize srcOffset;
+	_Stage(data, size, srcBuffer, srcOffset);
+
+	VkBufferCopy copy_region{};
+	copy_region.srcOffset = srcOffset;
+	copy_region.dstOffset = dstOffset;
+	copy_region.size = size;
+	vkCmdCopyBuffer(_recording.commandBuffer, srcBuffer, buffer, 1, &copy_region);
+
+	// Release ownership to the graphics queue, the matching acquire is recorded by RecordAcquires
+	if (_transferFamily != _graphicsFamily) {
+		VkBufferMemoryBarrier buffer_memory_barrier{};
+		buffer_memory_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		buffer_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		buffer_memory_barrier.dstAccessMask = 0;
+		buffer_memory_barrier.srcQueueFamilyIndex = _transferFamily;
+		buffer_memory_barrier.dstQueueFamilyIndex = _graphicsFamily;
+		buffer_memory_barrier.buffer = buffer;
+		buffer_memory_barrier.offset = dstOffset;
+		buffer_memory_barrier.size = size;
+
+		vkCmdPipelineBarrier(_recording.commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr,
+			1, &buffer_memory_barrier,
+			0, nullptr);
+	}
+
+	_recording.buffers.push_back({ buffer, dstOffset, size, dstStage, dstAccess });
+	return _recording.id;
+}
+
+uint64_t UploadQueue::UploadImage(VkImage image, const VkImageSubresourceRange& range, const std::vector<VkBufferImageCopy>& regions, const void* data, VkDeviceSize size,
+	VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, std::function<void(VkCommandBuffer)> onAcquire) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!_recording.id) {
+		_BeginBatch();
+	}
+
+	VkBuffer srcBuffer;
+	VkDeviceSize srcOffset;
+	_Stage(data, size, srcBuffer, srcOffset);
+
+	// The image has never been used so its previous contents can be discarded
+	VkImageMemoryBarrier image_memory_barrier{};
+	image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	image_memory_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_memory_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_memory_barrier.image = image;
+	image_memory_barrier.subresourceRange = range;
+	image_memory_barrier.srcAccessMask = 0;
+	image_memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(_recording.commandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &image_memory_barrier);
+
+	// Region offsets are relative to the caller's data, move them to where it was staged
+	std::vector<VkBufferImageCopy> stagedRegions = regions;
+	for (auto& region : stagedRegions) {
+		region.bufferOffset += srcOffset;
+	}
+	vkCmdCopyBufferToImage(_recording.commandBuffer, srcBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(stagedRegions.size()), stagedRegions.data());
+
+	// Release ownership, the layout transition to finalLayout is part of the release and acquire pair
+	if (_transferFamily != _graphicsFamily) {
+		image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		image_memory_barrier.newLayout = finalLayout;
+		image_memory_barrier.srcQueueFamilyIndex = _transferFamily;
+		image_memory_barrier.dstQueueFamilyIndex = _graphicsFamily;
+		image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		image_memory_barrier.dstAccessMask = 0;
+
+		vkCmdPipelineBarrier(_recording.commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &image_memory_barrier);
+	}
+
+	_recording.images.push_back({ image, range, finalLayout, dstStage, dstAccess, onAcquire });
+	return _recording.id;
+}
+
+void UploadQueue::Flush() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_Submit();
+}
+
+void UploadQueue::RecordAcquires(VkCommandBuffer commandBuffer, uint64_t frameNumber, std::vector<VkSemaphore>& waitSemaphores, std::vector<uint64_t>& waitValues, std::vector<VkPipelineStageFlags>& waitStages) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// Never waits, only batches the timeline has already passed are picked up
+	_Poll();
+	if (_finished.empty()) {
+		return;
+	}
+
+	bool ownershipTransfer = _transferFamily != _graphicsFamily;
+	std::vector<VkBufferMemoryBarrier> bufferBarriers;
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+	VkPipelineStageFlags dstStages = 0;
+
+	for (auto& batch : _finished) {
+		for (auto& pending : batch.buffers) {
+			VkBufferMemoryBarrier buffer_memory_barrier{};
+			buffer_memory_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			buffer_memory_barrier.srcAccessMask = ownershipTransfer ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT;
+			buffer_memory_barrier.dstAccessMask = pending.dstAccess;
+			buffer_memory_barrier.srcQueueFamilyIndex = ownershipTransfer ? _transferFamily : VK_QUEUE_FAMILY_IGNORED;
+			buffer_memory_barrier.dstQueueFamilyIndex = ownershipTransfer ? _graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+			buffer_memory_barrier.buffer = pending.buffer;
+			buffer_memory_barrier.offset = pending.offset;
+			buffer_memory_barrier.size = pending.size;
+
+			bufferBarriers.push_back(buffer_memory_barrier);
+			dstStages |= pending.dstStage;
+		}
+
+		for (auto& pending : batch.images) {
+			VkImageMemoryBarrier image_memory_barrier{};
+			image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			image_memory_barrier.newLayout = pending.finalLayout;
+			image_memory_barrier.srcAccessMask = ownershipTransfer ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT;
+			image_memory_barrier.dstAccessMask = pending.dstAccess;
+			image_memory_barrier.srcQueueFamilyIndex = ownershipTransfer ? _transferFamily : VK_QUEUE_FAMILY_IGNORED;
+			image_memory_barrier.dstQueueFamilyIndex = ownershipTransfer ? _graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+			image_memory_barrier.image = pending.image;
+			image_memory_barrier.subresourceRange = pending.range;
+
+			imageBarriers.push_back(image_memory_barrier);
+			dstStages |= pending.dstStage;
+		}
+	}
+
+	// The timeline has already reached the newest batch so waiting on it costs nothing, it just orders the acquires after
+	// the releases. One wait covers every batch since they finish in id order
+	waitSemaphores.push_back(_timeline);
+	waitValues.push_back(_finished.back().id);
+	waitStages.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+	// All acquires of all finished batches go in one barrier
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, dstStages ? dstStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+		0, nullptr,
+		static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+		static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+	// Follow up work such as mipmap generation needs the graphics queue
+	for (auto& batch : _finished) {
+		for (auto& pending : batch.images) {
+			if (pending.onAcquire) {
+				pending.onAcquire(commandBuffer);
+			}
+		}
+
+		batch.buffers.clear();
+		batch.images.clear();
+		batch.acquireFrame = frameNumber;
+		_lastAcquiredBatch = batch.id;
+		_acquired.push_back(std::move(batch));
+	}
+	_finished.clear();
+}
+
+void UploadQueue::Recycle(uint64_t completedFrames) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	while (!_acquired.empty() && _acquired.front().acquireFrame < completedFrames) {
+		_free.push_back(std::move(_acquired.front()));
+		_acquired.pop_front();
+	}
+}
+
+bool UploadQueue::IsComplete(uint64_t batch) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return batch <= _lastAcquiredBatch;
+}
+
+void UploadQueue::WaitIdle() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!_submitted.empty()) {
+		VkSemaphoreWaitInfoKHR semaphore_wait_info{};
+		semaphore_wait_info.sType			= VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+		semaphore_wait_info.semaphoreCount	= 1;
+		semaphore_wait_info.pSemaphores		= &_timeline;
+		semaphore_wait_info.pValues			= &_submitted.back().id;
+		if (_vkWaitSemaphores(_device, &semaphore_wait_info, UINT64_MAX) != VK_SUCCESS) {
+			std::cout << "ERROR::UploadQueue::WaitIdle::WaitSemaphores" << std::endl;
+			exit(-1);
+		}
+	}
+	_Poll();
+}
+
+void UploadQueue::_BeginBatch() {
+	if (!_free.empty()) {
+		_recording = std::move(_free.back());
+		_free.pop_back();
+
+		vkResetCommandBuffer(_recording.commandBuffer, 0);
+	} else {
+		_recording = Batch();
+
+		VkCommandBufferAllocateInfo command_buffer_allocate_info{};
+		command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		command_buffer_allocate_info.commandPool = _commandPool;
+		command_buffer_allocate_info.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(_device, &command_buffer_allocate_info, &_recording.commandBuffer) != VK_SUCCESS) {
+			std::cout << "ERROR::UploadQueue::BeginBatch::CreateBatch" << std::endl;
+			exit(-1);
+		}
+	}
+
+	_recording.id = _nextBatch++;
+	_recording.usesRing = false;
+	_recording.acquireFrame = 0;
+
+	VkCommandBufferBeginInfo command_buffer_begin_info{};
+	command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(_recording.commandBuffer, &command_buffer_begin_info);
+}
+
+bool UploadQueue::_CreateStagingBuffer(VkDeviceSize size, VkBuffer& buffer, Allocation& bufferMemory) {
+	VkBufferCreateInfo buffer_create_info{};
+	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_create_info.size = size;
+	buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(_device, &buffer_create_info, nullptr, &buffer) != VK_SUCCESS) {
+		return false;
+	}
+
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(_device, buffer, &memory_requirements);
+
+	if (!(memory_requirements.memoryTypeBits & (1 << _stagingMemoryType)) || !_allocator->Allocate(memory_requirements, _stagingMemoryType, true, bufferMemory)) {
+		vkDestroyBuffer(_device, buffer, nullptr);
+		return false;
+	}
+
+	vkBindBufferMemory(_device, buffer, bufferMemory.memory, bufferMemory.offset);
+	return true;
+}
+
+// Carve size bytes out of the staging ring, fails if the ring does not have a contiguous range that big free
+bool UploadQueue::_AllocateStaging(VkDeviceSize size, VkDeviceSize& offset) {
+	// Head meeting tail means nothing is in flight, start again from the beginning so the whole ring is available
+	if (_stagingHead == _stagingTail) {
+		_stagingHead = 0;
+		_stagingTail = 0;
+	}
+
+	VkDeviceSize start = (_stagingHead + stagingAlignment - 1) & ~(stagingAlignment - 1);
+
+	// The head never catches up with the tail exactly, otherwise a full ring would look empty
+	if (_stagingHead >= _stagingTail) {
+		if (start + size <= _stagingSize) {
+			offset = start;
+		} else if (size < _stagingTail) {
+			offset = 0;
+		} else {
+			return false;
+		}
+	} else {
+		if (start + size < _stagingTail) {
+			offset = start;
+		} else {
+			return false;
+		}
+	}
+
+	_stagingHead = offset + size;
+	return true;
+}
+
+// Copy data into staging memory owned by the recording batch
+void UploadQueue::_Stage(const void* data, VkDeviceSize size, VkBuffer& srcBuffer, VkDeviceSize& srcOffset) {
+	VkDeviceSize offset;
+	bool staged = _AllocateStaging(size, offset);
+
+	// The ring may just be waiting on batches that have since finished
+	if (!staged) {
+		_Poll();
+		staged = _AllocateStaging(size, offset);
+	}
+
+	if (staged) {
+		memcpy(static_cast<char*>(_stagingMemory.mapped) + offset, data, static_cast<size_t>(size));
+		_recording.usesRing = true;
+		_recording.stagingEnd = _stagingHead;
+
+		srcBuffer = _stagingBuffer;
+		srcOffset = offset;
+		return;
+	}
+
+	// Still no room, rather than wait for the transfer queue give this upload its own staging buffer
+	VkBuffer buffer;
+	Allocation bufferMemory;
+	if (!_CreateStagingBuffer(size, buffer, bufferMemory)) {
+		std::cout << "ERROR::UploadQueue::Stage::CreateStagingBuffer" << std::endl;
+		exit(-1);
+	}
+	memcpy(bufferMemory.mapped, data, static_cast<size_t>(size));
+	_recording.dedicatedStaging.push_back({ buffer, bufferMemory });
+
+	srcBuffer = buffer;
+	srcOffset = 0;
+}
+
+void UploadQueue::_Submit() {
+	if (!_recording.id) {
+		return;
+	}
+
+	vkEndCommandBuffer(_recording.commandBuffer);
+
+	// The timeline is moved on to the batch's id, the graphics submission that records the acquires waits for that value
+	VkTimelineSemaphoreSubmitInfoKHR timeline_submit_info{};
+	timeline_submit_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	timeline_submit_info.signalSemaphoreValueCount = 1;
+	timeline_submit_info.pSignalSemaphoreValues = &_recording.id;
+
+	VkSubmitInfo submit_info{};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = &timeline_submit_info;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &_recording.commandBuffer;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &_timeline;
+
+	if (vkQueueSubmit(_transferQueue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		std::cout << "ERROR::UploadQueue::Submit::QueueSubmit" << std::endl;
+		exit(-1);
+	}
+
+	_submitted.push_back(std::move(_recording));
+	_recording = Batch();
+}
+
+// Retire submitted batches whose copies have finished, in submission order so the ring tail only moves forward
+void UploadQueue::_Poll() {
+	uint64_t finishedBatch = 0;
+	if (_vkGetSemaphoreCounterValue(_device, _timeline, &finishedBatch) != VK_SUCCESS) {
+		std::cout << "ERROR::UploadQueue::Poll::GetSemaphoreCounterValue" << std::endl;
+		exit(-1);
+	}
+
+	while (!_submitted.empty() && _submitted.front().id <= finishedBatch) {
+		Batch& batch = _submitted.front();
+
+		if (batch.usesRing) {
+			_stagingTail = batch.stagingEnd;
+		}
+		for (auto& [buffer, bufferMemory] : batch.dedicatedStaging) {
+			vkDestroyBuffer(_device, buffer, nullptr);
+			_allocator->Free(bufferMemory);
+		}
+		batch.dedicatedStaging.clear();
+
+		_finished.push_back(std::move(batch));
+		_submitted.pop_front();
+	}
+}
+
+void UploadQueue::_DestroyBatch(Batch& batch) {
+	for (auto& [buffer, bufferMemory] : batch.dedicatedStaging) {
+		vkDestroyBuffer(_device, buffer, nullptr);
+		_allocator->Free(bufferMemory);
+	}
+	batch = Batch();
+}
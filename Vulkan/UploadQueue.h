@@ -0,0 +1,129 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <functional>
+
+#include "Allocator.h"
+
+/*
+
+Asynchronous upload queue
+Copies into device local buffers and images are staged through a persistently mapped ring buffer and batched into
+one submission on the transfer queue. Every submission signals a timeline semaphore with its batch id, so completion
+is polled by reading the counter and the frame loop never waits on an upload. Once a batch is done its queue family
+ownership acquires are recorded into the next graphics command buffer, whose submission waits on the same counter
+
+*/
+
+class UploadQueue {
+public:
+	// transferFamily may equal graphicsFamily when the device has no dedicated transfer queue, ownership transfers are skipped then
+	void Init(VkPhysicalDevice, VkDevice, Allocator*, VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily, VkDeviceSize stagingSize = 32ull * 1024 * 1024);
+	void Destroy();
+
+	// Queue a copy into a buffer, dstStage/dstAccess describe how the graphics queue will first use it
+	// Returns the batch the copy belongs to, the data is copied into staging memory before returning
+	uint64_t UploadBuffer(VkBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	// Queue copies into an image, region buffer offsets are relative to data. The subresource range is moved from undefined to
+	// transfer dst for the copies and is handed to the graphics queue in finalLayout. onAcquire is recorded straight after the acquire barrier
+	uint64_t UploadImage(VkImage, const VkImageSubresourceRange&, const std::vector<VkBufferImageCopy>& regions, const void* data, VkDeviceSize size,
+		VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, std::function<void(VkCommandBuffer)> onAcquire = nullptr);
+
+	// Submit everything queued since the last flush as one batch, does nothing if nothing is queued
+	void Flush();
+
+	// Records the acquires of every finished batch into a graphics command buffer. The transfer timeline and the value to wait for are
+	// appended to waitSemaphores/waitValues and must be waited on by the submission of commandBuffer, which belongs to frame frameNumber
+	void RecordAcquires(VkCommandBuffer commandBuffer, uint64_t frameNumber, std::vector<VkSemaphore>& waitSemaphores, std::vector<uint64_t>& waitValues, std::vector<VkPipelineStageFlags>& waitStages);
+
+	// Every frame before completedFrames has finished executing on the graphics queue, so the batches they acquired can be reused
+	void Recycle(uint64_t completedFrames);
+
+	// True once the acquires of batch have been recorded, anything uploaded in it can be used by commands recorded after that
+	bool IsComplete(uint64_t batch);
+
+	// Blocks until every submitted batch has finished on the transfer queue, only meant for startup and shutdown
+	void WaitIdle();
+
+private:
+	// A copy waiting to have its ownership acquired on the graphics queue
+	struct PendingBuffer {
+		VkBuffer buffer;
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		VkPipelineStageFlags dstStage;
+		VkAccessFlags dstAccess;
+	};
+
+	struct PendingImage {
+		VkImage image;
+		VkImageSubresourceRange range;
+		VkImageLayout finalLayout;
+		VkPipelineStageFlags dstStage;
+		VkAccessFlags dstAccess;
+		std::function<void(VkCommandBuffer)> onAcquire;
+	};
+
+	// The id is also the value the transfer timeline reaches when the batch has finished
+	struct Batch {
+		uint64_t id = 0;
+		VkCommandBuffer commandBuffer = nullptr;
+
+		// End of this batch's staging range in the ring, the ring tail moves here when the batch retires
+		bool usesRing = false;
+		VkDeviceSize stagingEnd = 0;
+
+		// Uploads too big for the ring get their own staging buffer which lives until the batch retires
+		std::vector<std::pair<VkBuffer, Allocation>> dedicatedStaging;
+
+		std::vector<PendingBuffer> buffers;
+		std::vector<PendingImage> images;
+
+		// Frame whose submission waits on the timeline, the batch is reused once that frame completes
+		uint64_t acquireFrame = 0;
+	};
+
+	VkDevice _device = nullptr;
+	Allocator* _allocator = nullptr;
+	VkQueue _transferQueue = nullptr;
+	uint32_t _transferFamily = 0;
+	uint32_t _graphicsFamily = 0;
+	uint32_t _stagingMemoryType = 0;
+	VkCommandPool _commandPool = nullptr;
+
+	// Signalled with the id of each batch as it finishes on the transfer queue
+	VkSemaphore _timeline = nullptr;
+	PFN_vkGetSemaphoreCounterValueKHR _vkGetSemaphoreCounterValue = nullptr;
+	PFN_vkWaitSemaphoresKHR _vkWaitSemaphores = nullptr;
+
+	// Staging ring, head is where the next copy is written and tail is the start of the oldest range still in use
+	VkBuffer _stagingBuffer = nullptr;
+	Allocation _stagingMemory;
+	VkDeviceSize _stagingSize = 0;
+	VkDeviceSize _stagingHead = 0;
+	VkDeviceSize _stagingTail = 0;
+
+	// Batches move from recording -> submitted (waiting on the transfer queue) -> finished (waiting to be acquired)
+	// -> acquired (waiting on the graphics queue) -> free
+	Batch _recording;
+	std::deque<Batch> _submitted;
+	std::deque<Batch> _finished;
+	std::deque<Batch> _acquired;
+	std::vector<Batch> _free;
+	uint64_t _nextBatch = 1;
+	uint64_t _lastAcquiredBatch = 0;
+
+	std::mutex _mutex;
+
+	void _BeginBatch();
+	bool _CreateStagingBuffer(VkDeviceSize size, VkBuffer&, Allocation&);
+	bool _AllocateStaging(VkDeviceSize size, VkDeviceSize& offset);
+	void _Stage(const void* data, VkDeviceSize size, VkBuffer& srcBuffer, VkDeviceSize& srcOffset);
+	void _Submit();
+	void _Poll();
+	void _DestroyBatch(Batch&);
+};
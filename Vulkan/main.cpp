@@ -1,6 +1,108 @@
 #include "Renderer.h"
 
-int main() {
-	Renderer renderer;
+#include <string>
+
+// Writes RGBA8 pixels out as a binary PPM, the alpha channel is dropped
+bool WritePPM(const std::string& filename, const std::vector<uint8_t>& pixels, uint32_t width, uint32_t height) {
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "ERROR::WritePPM::CannotOpenFile " << filename << std::endl;
+		return false;
+	}
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	for (size_t i = 0; i < pixels.size(); i += 4) {
+		file.write(reinterpret_cast<const char*>(&pixels[i]), 3);
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv) {
+	RendererSettings settings;
+	std::string output;
+
+	// --headless renders without a window, --frames N stops after N frames and --output writes the last headless frame to a PPM
+	// --threads N sets how many worker threads record draw commands, --mesh and --texture load different assets
+	// --profile writes a Chrome trace (chrome://tracing or ui.perfetto.dev) of the run, --objects N fills the scene with a grid of N objects
+	// --present low-latency|throughput|power-save picks the present profile, --fps N caps the frame rate with sleeps
+	// --no-texturing and --no-vertex-colour pick a pipeline variant with those shader paths compiled out
+	// --aa off|msaa2|msaa4|fxaa picks the anti-aliasing tier
+	// --dynamic-resolution BUDGET_MS scales the render resolution to keep the GPU frame time under budget, --min-scale S bounds it
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--headless") {
+			settings.headless = true;
+		} else if (arg == "--frames" && i + 1 < argc) {
+			settings.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--width" && i + 1 < argc) {
+			settings.width = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--height" && i + 1 < argc) {
+			settings.height = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--threads" && i + 1 < argc) {
+			settings.workerThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--objects" && i + 1 < argc) {
+			settings.objectCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--mesh" && i + 1 < argc) {
+			settings.meshPath = argv[++i];
+		} else if (arg == "--texture" && i + 1 < argc) {
+			settings.texturePath = argv[++i];
+		} else if (arg == "--profile" && i + 1 < argc) {
+			settings.profilePath = argv[++i];
+		} else if (arg == "--present" && i + 1 < argc) {
+			std::string profile = argv[++i];
+			if (profile == "low-latency") {
+				settings.presentProfile = PresentProfile::LowLatency;
+			} else if (profile == "throughput") {
+				settings.presentProfile = PresentProfile::Throughput;
+			} else if (profile == "power-save") {
+				settings.presentProfile = PresentProfile::PowerSave;
+			} else {
+				std::cout << "Unknown present profile " << profile << std::endl;
+				return -1;
+			}
+		} else if (arg == "--no-texturing") {
+			settings.texturing = false;
+		} else if (arg == "--no-vertex-colour") {
+			settings.vertexColour = false;
+		} else if (arg == "--aa" && i + 1 < argc) {
+			std::string tier = argv[++i];
+			if (tier == "off") {
+				settings.antiAliasing = AntiAliasing::Off;
+			} else if (tier == "msaa2") {
+				settings.antiAliasing = AntiAliasing::MSAA2;
+			} else if (tier == "msaa4") {
+				settings.antiAliasing = AntiAliasing::MSAA4;
+			} else if (tier == "fxaa") {
+				settings.antiAliasing = AntiAliasing::FXAA;
+			} else {
+				std::cout << "Unknown anti-aliasing tier " << tier << std::endl;
+				return -1;
+			}
+		} else if (arg == "--dynamic-resolution" && i + 1 < argc) {
+			settings.dynamicResolution = true;
+			settings.gpuFrameBudget = std::stof(argv[++i]);
+		} else if (arg == "--min-scale" && i + 1 < argc) {
+			settings.minResolutionScale = std::stof(argv[++i]);
+		} else if (arg == "--fps" && i + 1 < argc) {
+			settings.frameRateLimit = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--output" && i + 1 < argc) {
+			output = argv[++i];
+		} else {
+			std::cout << "Unknown argument " << arg << std::endl;
+			return -1;
+		}
+	}
+
+	Renderer renderer(settings);
+
+	if (settings.headless && !output.empty()) {
+		std::vector<uint8_t> pixels;
+		uint32_t width, height;
+		if (!renderer.ReadbackFrame(pixels, width, height) || !WritePPM(output, pixels, width, height)) {
+			return -1;
+		}
+	}
+
 	return 0;
 }
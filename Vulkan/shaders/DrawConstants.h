@@ -0,0 +1,51 @@
+#ifndef DRAW_CONSTANTS_H
+#define DRAW_CONSTANTS_H
+
+/*
+
+Push constants shared between C++ and the shaders
+This file is included by Renderer Structs.h and by the GLSL through GL_GOOGLE_include_directive, so the structs are only
+ever declared once. Only scalar members are used, they are laid out the same by the C++ compiler and by the push
+constant (std430) rules so no padding needs to be kept in step by hand
+
+*/
+
+// Members are declared with the C++ type, GLSL spells it uint. The macro only exists on the GLSL side so nothing is
+// added to the global namespace of the C++ files that include this
+#ifdef __cplusplus
+#include <cstdint>
+#else
+#define uint32_t uint
+#endif
+
+// Pushed before each indirect draw call. Every call draws all the visible objects as instances, so there is no per
+// object data to push, only where this frame's region of the instance buffer (which holds every frame in flight) starts
+struct DrawConstants {
+	uint32_t instanceOffset;
+};
+
+// Pushed for the FXAA pass. The output covers the whole target and is mapped onto the region of the scene image that
+// was rendered at the current resolution scale, texel sizes and uvMax are in the scene image's uv space
+struct PostConstants {
+	float uvScaleX;
+	float uvScaleY;
+	float texelWidth;
+	float texelHeight;
+	float uvMaxX;
+	float uvMaxY;
+};
+
+// Pushed for each mip chain generated by downsample.comp, the size of the base level and how many levels the image has
+struct DownsampleConstants {
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipLevels;
+};
+
+#ifdef __cplusplus
+static_assert(sizeof(DrawConstants) <= 128, "Push constants past 128 bytes aren't guaranteed to be supported");
+static_assert(sizeof(PostConstants) <= 128, "Push constants past 128 bytes aren't guaranteed to be supported");
+static_assert(sizeof(DownsampleConstants) <= 128, "Push constants past 128 bytes aren't guaranteed to be supported");
+#endif
+
+#endif
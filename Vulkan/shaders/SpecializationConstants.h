@@ -0,0 +1,37 @@
+#ifndef SPECIALIZATION_CONSTANTS_H
+#define SPECIALIZATION_CONSTANTS_H
+
+/*
+
+Specialization constants shared between C++ and the shaders
+The GLSL declares each constant with layout(constant_id = ...) using the ids below, and pipelines are created with the
+values from SpecializationConstants. The driver compiles every variant with its constants folded in, so a disabled
+path is removed from the shader rather than branched over on every fragment. Every member is a 32 bit bool (VkBool32)
+to match how GLSL lays out a bool constant
+
+*/
+
+#define TEXTURING_CONSTANT_ID 0
+#define VERTEX_COLOUR_CONSTANT_ID 1
+
+// Used by downsample.comp, ids only have to be unique within a shader
+#define DOWNSAMPLE_FILTER_CONSTANT_ID 0
+#define DOWNSAMPLE_SRGB_CONSTANT_ID 1
+
+#ifdef __cplusplus
+#include <cstdint>
+
+// Data pointed to by the pipeline's VkSpecializationInfo, offsets are taken with offsetof
+struct SpecializationConstants {
+	uint32_t texturing;
+	uint32_t vertexColour;
+};
+
+// The mip generator's constants, filter is a DownsampleFilter rather than a bool
+struct DownsampleSpecializationConstants {
+	uint32_t filter;
+	uint32_t srgb;
+};
+#endif
+
+#endif
@@ -1,4 +1,8 @@
 @echo off
 "C:\VulkanSDK\1.2.141.2\Bin32\glslc.exe" shader.vert -o vert.spv
 "C:\VulkanSDK\1.2.141.2\Bin32\glslc.exe" shader.frag -o frag.spv
+"C:\VulkanSDK\1.2.141.2\Bin32\glslc.exe" shader_bindless.frag -o frag_bindless.spv
+"C:\VulkanSDK\1.2.141.2\Bin32\glslc.exe" fullscreen.vert -o fullscreen_vert.spv
+"C:\VulkanSDK\1.2.141.2\Bin32\glslc.exe" fxaa.frag -o fxaa_frag.spv
+"C:\VulkanSDK\1.2.141.2\Bin32\glslc.exe" downsample.comp -o downsample_comp.spv
 pause
\ No newline at end of file
@@ -0,0 +1,62 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "DrawConstants.h"
+
+layout(binding = 0) uniform sampler2D sceneImage;
+
+layout(push_constant) uniform PostConstantsBlock {
+    PostConstants post;
+};
+
+layout(location = 0) in vec2 fragUV;
+
+layout(location = 0) out vec4 outColor;
+
+float Luma(vec3 colour) {
+    return dot(colour, vec3(0.299, 0.587, 0.114));
+}
+
+// Taps are kept inside the rendered region so nothing left over from a larger resolution scale bleeds in
+vec3 Sample(vec2 uv) {
+    vec2 halfTexel = vec2(post.texelWidth, post.texelHeight) * 0.5;
+    return textureLod(sceneImage, clamp(uv, halfTexel, vec2(post.uvMaxX, post.uvMaxY)), 0.0).rgb;
+}
+
+// FXAA in a single pass, the output pixel is mapped into the rendered region so the filter also upscales it
+void main() {
+    vec2 texel = vec2(post.texelWidth, post.texelHeight);
+    vec2 uv = fragUV * vec2(post.uvScaleX, post.uvScaleY);
+
+    vec3 colourM = Sample(uv);
+    float lumaM = Luma(colourM);
+    float lumaNW = Luma(Sample(uv + vec2(-1.0, -1.0) * texel));
+    float lumaNE = Luma(Sample(uv + vec2(1.0, -1.0) * texel));
+    float lumaSW = Luma(Sample(uv + vec2(-1.0, 1.0) * texel));
+    float lumaSE = Luma(Sample(uv + vec2(1.0, 1.0) * texel));
+
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+    // Low contrast pixels aren't on an edge worth filtering
+    if (lumaMax - lumaMin < max(0.0312, lumaMax * 0.125)) {
+        outColor = vec4(colourM, 1.0);
+        return;
+    }
+
+    // The edge runs across the steepest luma gradient, blur along it
+    vec2 direction;
+    direction.x = -((lumaNW + lumaNE) - (lumaSW + lumaSE));
+    direction.y = (lumaNW + lumaSW) - (lumaNE + lumaSE);
+    float directionReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * (0.25 / 8.0), 1.0 / 128.0);
+    float inverseDirectionMin = 1.0 / (min(abs(direction.x), abs(direction.y)) + directionReduce);
+    direction = clamp(direction * inverseDirectionMin, vec2(-8.0), vec2(8.0)) * texel;
+
+    vec3 colourA = 0.5 * (Sample(uv + direction * (1.0 / 3.0 - 0.5)) + Sample(uv + direction * (2.0 / 3.0 - 0.5)));
+    vec3 colourB = colourA * 0.5 + 0.25 * (Sample(uv - direction * 0.5) + Sample(uv + direction * 0.5));
+
+    // The wider blur is only kept if it didn't pull in something from across the edge
+    float lumaB = Luma(colourB);
+    outColor = vec4((lumaB < lumaMin || lumaB > lumaMax) ? colourA : colourB, 1.0);
+}
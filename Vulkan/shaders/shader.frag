@@ -1,5 +1,11 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "SpecializationConstants.h"
+
+layout(constant_id = TEXTURING_CONSTANT_ID) const bool texturing = true;
+layout(constant_id = VERTEX_COLOUR_CONSTANT_ID) const bool vertexColour = true;
 
 layout(binding = 1) uniform sampler2D texSampler;
 
@@ -9,5 +15,12 @@ layout(location = 1) in vec2 fragTexCoord;
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(texSampler, fragTexCoord) * vec4(fragColor, 1.0);
+    // The constants are known when the pipeline is compiled so only one path is left in each variant
+    outColor = vec4(1.0);
+    if (texturing) {
+        outColor = texture(texSampler, fragTexCoord);
+    }
+    if (vertexColour) {
+        outColor.rgb *= fragColor;
+    }
 }
\ No newline at end of file
@@ -1,11 +1,21 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
-} ubo;
+#include "DrawConstants.h"
+
+struct InstanceData {
+    mat4 modelViewProj;
+    uint materialIndex;
+};
+
+layout(std430, binding = 2) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+};
+
+layout(push_constant) uniform DrawConstantsBlock {
+    DrawConstants draw;
+};
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
@@ -13,9 +23,12 @@ layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragMaterialIndex;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    InstanceData instance = instances[draw.instanceOffset + gl_InstanceIndex];
+    gl_Position = instance.modelViewProj * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
+    fragMaterialIndex = instance.materialIndex;
 }
\ No newline at end of file
@@ -0,0 +1,28 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : enable
+
+#include "SpecializationConstants.h"
+
+layout(constant_id = TEXTURING_CONSTANT_ID) const bool texturing = true;
+layout(constant_id = VERTEX_COLOUR_CONSTANT_ID) const bool vertexColour = true;
+
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragMaterialIndex;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // The constants are known when the pipeline is compiled so only one path is left in each variant
+    outColor = vec4(1.0);
+    if (texturing) {
+        outColor = texture(textures[nonuniformEXT(fragMaterialIndex)], fragTexCoord);
+    }
+    if (vertexColour) {
+        outColor.rgb *= fragColor;
+    }
+}
\ No newline at end of file